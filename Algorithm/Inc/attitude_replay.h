@@ -0,0 +1,92 @@
+#ifndef __ATTITUDE_REPLAY_H
+#define __ATTITUDE_REPLAY_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : attitude_replay.h
+  * @brief          : Prototypes of the replay of the attitude engines.
+  *
+  ******************************************************************************
+  * @attention      : 1. call Attitude_Replay_Run() on the target, e.g. before osKernelStart(),
+  *                      and read Attitude_Replay_TypeDef in the debugger
+  *                   2. the truth is integrated by the exponential map in double,
+  *                      ATTITUDE_REPLAY_SUBSTEPS per gyro sample
+  *                   3. the drifts run the closed form QuatEKF without accel,
+  *                      so only the propagation of the gyro is measured
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "quaternion.h"
+#include "mahony.h"
+#include "gyro_preint.h"
+#include "IMU_Task.h"
+
+/* Exported defines -----------------------------------------------------------*/
+/**
+ * @brief read the cycle counter, the DWT cycle counter by default.
+ */
+#ifndef ATTITUDE_REPLAY_CYCLES
+  #define ATTITUDE_REPLAY_CYCLES()  (DWT->CYCCNT)
+#endif
+
+/**
+ * @brief length of a replay in seconds, the errors skip the first second.
+ */
+#define ATTITUDE_REPLAY_TIME  10.f
+
+/**
+ * @brief truth steps per gyro sample.
+ */
+#define ATTITUDE_REPLAY_SUBSTEPS  16U
+
+/**
+ * @brief attitude engines of the replay, in the order of IMU_ENGINE.
+ */
+#define ATTITUDE_REPLAY_ENGINE_NUM  4U
+
+/**
+ * @brief update rates of the drifts, 1000, 500 and 250 Hz.
+ */
+#define ATTITUDE_REPLAY_RATE_NUM  3U
+
+/**
+ * @brief output data rate of the gyro, BMI088_GYRO_2000_230_HZ.
+ */
+#define ATTITUDE_REPLAY_GYRO_RATE  2000U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief results of the replay of the attitude engines.
+ */
+typedef struct
+{
+  uint32_t Updates;           /*!< updates per replay */
+
+  float EngineTiltError[ATTITUDE_REPLAY_ENGINE_NUM]; /*!< max tilt error in degrees, 1 kHz, spin and wobble with bias and noise,
+                                                          QuatEKF, closed form, ESKF, Mahony */
+  uint32_t EngineCycles[ATTITUDE_REPLAY_ENGINE_NUM]; /*!< mean cycles per update, QuatEKF, closed form, ESKF, Mahony */
+
+  float SpinDrift[ATTITUDE_REPLAY_RATE_NUM];      /*!< max attitude error in degrees, 10 rad/s spin, mean rate of every update */
+  float ConingDrift[ATTITUDE_REPLAY_RATE_NUM];    /*!< max attitude error in degrees, 5 Hz coning, mean rate of every update */
+  float DecimatedDrift[ATTITUDE_REPLAY_RATE_NUM]; /*!< max attitude error in degrees, 5 Hz coning, the last 2 kHz gyro sample of every update */
+  float PreIntDrift[ATTITUDE_REPLAY_RATE_NUM];    /*!< max attitude error in degrees, 5 Hz coning, every 2 kHz gyro sample through GyroPreInt */
+
+  float NominalDtDrift;       /*!< max attitude error in degrees, jittered and skipped periods, propagated with IMU_TASK_PERIOD */
+  float MeasuredDtDrift;      /*!< max attitude error in degrees, jittered and skipped periods, propagated with IMU_Period_Update() */
+  IMU_Timing_Typedef Timing;  /*!< statistics of the jittered and skipped periods */
+  bool TimingValid;           /*!< count, overrun, min/max and histogram of Timing as the schedule */
+}Attitude_Replay_TypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief Replay the synthetic rotation profiles through the attitude engines.
+  */
+extern void Attitude_Replay_Run(Attitude_Replay_TypeDef *replay);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __FAST_MATH_H
+#define __FAST_MATH_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : fast_math.h
+  * @brief          : Prototypes of fast approximate math functions.
+  * 
+  ******************************************************************************
+  * @attention      : the absolute error of every function is bounded, see the
+  *                   notes in fast_math.c, the hardware VSQRT is used for sqrt.
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stdint.h"
+#include "arm_math.h"
+
+/* Exported defines -----------------------------------------------------------*/
+/**
+ * @brief error bounds of the functions, float rounding included.
+ */
+#define FAST_MATH_INVERSE_SQRT_ERROR  2e-7f  /*!< relative, |Fast_InverseSqrt(x)·sqrt(x) - 1| */
+#define FAST_MATH_ACOS_ERROR          5e-7f  /*!< absolute, rad */
+#define FAST_MATH_ASIN_ERROR          3e-7f  /*!< absolute, rad */
+#define FAST_MATH_ATAN_ERROR          2e-7f  /*!< absolute, rad */
+#define FAST_MATH_ATAN2_ERROR         3e-7f  /*!< absolute, rad */
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  inverse square root, 1.f/sqrt(x), relative |error| < 2e-7,
+  *         0 for x <= 0, NaN or +inf.
+  */
+extern float Fast_InverseSqrt(float x);
+/**
+  * @brief  arc cosine of x in [-1,1], |error| < 5e-7 rad.
+  */
+extern float Fast_Acos(float x);
+/**
+  * @brief  arc sine of x in [-1,1], |error| < 3e-7 rad.
+  */
+extern float Fast_Asin(float x);
+/**
+  * @brief  arc tangent of x, |error| < 2e-7 rad.
+  */
+extern float Fast_Atan(float x);
+/**
+  * @brief  arc tangent of y/x in the quadrant of (x,y), |error| < 3e-7 rad.
+  */
+extern float Fast_Atan2(float y,float x);
+
+#endif
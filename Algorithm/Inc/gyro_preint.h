@@ -0,0 +1,61 @@
+#ifndef __GYRO_PREINT_H
+#define __GYRO_PREINT_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : gyro_preint.h
+  * @brief          : Prototypes of coning-compensated gyro pre-integration.
+  * 
+  ******************************************************************************
+  * @attention      : none
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stdint.h"
+
+/* Exported typedef ----------------------------------------------------------*/
+/**
+ * @brief structure that contains the informations of gyro pre-integration.
+ */
+typedef struct
+{
+  float alpha[3];      /*!< sum of the rotation increments */
+  float beta[3];       /*!< coning correction */
+  float last_delta[3]; /*!< rotation increment of the last sample */
+  float dt;            /*!< accumulated time */
+  uint16_t count;      /*!< number of the accumulated samples */
+}GyroPreInt_Typedef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Reset the gyro pre-integration.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  */
+extern void GyroPreInt_Reset(GyroPreInt_Typedef *preint);
+
+/**
+  * @brief  Accumulate a gyro sample.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  * @param  gyro: point to the gyro measurement
+  * @param  dt: sample period
+  */
+extern void GyroPreInt_Update(GyroPreInt_Typedef *preint,const float gyro[3],float dt);
+
+/**
+  * @brief  Get the constant rate of the accumulated rotation and restart the accumulation.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  * @param  rate: point to the rate, rotation vector / accumulated time
+  * @retval accumulated time
+  */
+extern float GyroPreInt_Fetch(GyroPreInt_Typedef *preint,float rate[3]);
+
+#endif
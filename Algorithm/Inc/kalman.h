@@ -8,6 +8,8 @@
   * 
   ******************************************************************************
   * @attention      : 1. redefine user_malloc, allocate space in freertos heap(configTOTAL_HEAP_SIZE) instead of SRAM heap
+  *                   2. all matrices of a filter share one contiguous block, use KALMAN_STORAGE_DEF
+  *                      and Kalman_Filter_Static_Init() to avoid heap allocation
   *
   * Copyright 2024 COD USTL.
   * All rights reserved.
@@ -35,6 +37,83 @@
   #endif
 #endif
 
+/**
+ * @brief place the static kalman storage in a specified section, 
+ *        e.g. __attribute__((section(".ccmram"))) when the scatter file provides CCM RAM.
+ */
+#ifndef KALMAN_STORAGE_SECTION
+  #define KALMAN_STORAGE_SECTION
+#endif
+
+/**
+ * @brief the larger of two sizes.
+ */
+#define KALMAN_MAX_SIZE(a,b)  (((a) > (b)) ? (a) : (b))
+
+/**
+ * @brief number of floats used by the matrices of a kalman filter.
+ * @note  MeasureInput,z(z) + xhat,xhatminus,Output(3x) + ControlInput,u(2u) + B(xu)
+ *        + A,AT,P,Pminus,Q(5x^2) + H,K(2xz) + R(z^2) + S,calc_matrix(3n^2) + calc_vector(2n)
+ *        n = max(xhatSize,zSize)
+ */
+#define KALMAN_STORAGE_FLOATS(xhatSize,uSize,zSize)                                   \
+  ( 2U*(zSize) + 3U*(xhatSize) + 2U*(uSize) + (xhatSize)*(uSize)                      \
+  + 5U*(xhatSize)*(xhatSize) + 2U*(xhatSize)*(zSize) + (zSize)*(zSize)                \
+  + 3U*KALMAN_MAX_SIZE(xhatSize,zSize)*KALMAN_MAX_SIZE(xhatSize,zSize)                \
+  + 2U*KALMAN_MAX_SIZE(xhatSize,zSize) )
+
+/**
+ * @brief number of bytes used by the matrices of a kalman filter.
+ */
+#define KALMAN_STORAGE_BYTES(xhatSize,uSize,zSize) \
+  (sizeof(float) * KALMAN_STORAGE_FLOATS(xhatSize,uSize,zSize))
+
+/**
+ * @brief define a statically allocated storage block for a kalman filter.
+ * @note  pass name and KALMAN_STORAGE_FLOATS(...) to Kalman_Filter_Static_Init()
+ */
+#define KALMAN_STORAGE_DEF(name,xhatSize,uSize,zSize) \
+  static KALMAN_STORAGE_SECTION float name[KALMAN_STORAGE_FLOATS(xhatSize,uSize,zSize)] __ALIGNED(8)
+
+/**
+ * @brief measure the DWT cycles of every step and user function, 
+ *        the DWT cycle counter is enabled by Kalman_Filter_Static_Init().
+ */
+#ifndef KALMAN_PROFILE_ENABLE
+  #define KALMAN_PROFILE_ENABLE 0
+#endif
+
+/**
+ * @brief store the DWT cycles since start, the source includes "stm32f4xx.h"
+ *        when KALMAN_PROFILE_ENABLE is set.
+ */
+#if KALMAN_PROFILE_ENABLE
+  #define KALMAN_PROFILE_STORE(cycles,start)  ((cycles) = DWT->CYCCNT - (start))
+  #define KALMAN_PROFILE_START()              (DWT->CYCCNT)
+#else
+  #define KALMAN_PROFILE_STORE(cycles,start)  ((void)(start))
+  #define KALMAN_PROFILE_START()              (0U)
+#endif
+
+/**
+ * @brief sticky error flags of the kalman filter, see Kalman_Telemetry_TypeDef.
+ */
+#define KALMAN_ERROR_STEP(n)   (1U << ((n) - 1U))   /*!< step 1-5 */
+#define KALMAN_ERROR_HOOK(n)   (1U << ((n) + 8U))   /*!< User_Function0-6 */
+#define KALMAN_ERROR_NANINF    (1U << 15)           /*!< xhat is not finite */
+
+/**
+ * @brief number of floats used by the UD factors of a kalman filter.
+ * @note  UD: x², UD factor of Q: x², Gram-Schmidt matrix W: 2x², weights of W: 2x
+ */
+#define KALMAN_UD_STORAGE_FLOATS(xhatSize) \
+  ( 4U*(xhatSize)*(xhatSize) + 2U*(xhatSize) )
+
+/**
+ * @brief all measurements are fresh, see MeasureValid.
+ */
+#define KALMAN_MEASURE_ALL  0xFFFFFFFFU
+
 /**
  * @brief  matrix calculation.
  */
@@ -48,6 +127,16 @@
 #define Matrix_Inverse     arm_mat_inverse_f32
 #define Matrix_Inverse_64  arm_mat_inverse_f64
 
+/**
+ * @brief mask of the model matrices, see Kalman_Filter_SetConstant().
+ */
+#define KALMAN_MATRIX_A  (1U << 0)
+#define KALMAN_MATRIX_H  (1U << 1)
+#define KALMAN_MATRIX_Q  (1U << 2)
+#define KALMAN_MATRIX_R  (1U << 3)
+#define KALMAN_MATRIX_B  (1U << 4)
+#define KALMAN_MATRIX_ALL (KALMAN_MATRIX_A | KALMAN_MATRIX_H | KALMAN_MATRIX_Q | KALMAN_MATRIX_R | KALMAN_MATRIX_B)
+
 /* Exported types ------------------------------------------------------------*/
 /**
  * @brief informations of the Chi Square Test.
@@ -60,9 +149,29 @@ typedef struct
   float ChiSquareTestThresholds;    /*!< test Thresholds */
   uint8_t ChiSquareCnt;   /*!< test count */
   bool result;   /*!< test result */
+  float Weight;  /*!< weight of the kalman gain of the accepted measurement */
 }ChiSquareTest_Typedef;
 
 
+/**
+ * @brief runtime telemetry of the kalman filter.
+ */
+typedef struct
+{
+  uint16_t ErrorFlags;    /*!< sticky, steps and user functions that failed, see KALMAN_ERROR_x */
+  uint16_t ActiveFlag;    /*!< step or user function being updated */
+  arm_status LastError;   /*!< sticky, last failure status */
+  uint32_t SingularCnt;   /*!< count of singular matrices */
+  uint32_t NaNCnt;        /*!< count of updates with a non-finite state */
+  uint32_t UpdateCnt;     /*!< count of updates */
+#if KALMAN_PROFILE_ENABLE
+  uint32_t StepCycles[5]; /*!< DWT cycles of step 1-5 in the last update */
+  uint32_t HookCycles[7]; /*!< DWT cycles of User_Function0-6 in the last update */
+  uint32_t TotalCycles;   /*!< DWT cycles of the last update */
+  uint32_t MaxCycles;     /*!< max DWT cycles of an update */
+#endif
+}Kalman_Telemetry_TypeDef;
+
 /**
  * @brief informations of the kalman filter.
  */
@@ -74,8 +183,11 @@ typedef struct KF_Info_TypeDef
   uint8_t uSize;      /*!< size of control vector */
   uint8_t zSize;      /*!< size of measurement vector */
 
+  uint32_t MemorySize; /*!< bytes of the matrix storage block */
+
   float dt;   /*!< system latency */
   float *MeasureInput; /*!< pointer to measure input  */
+  uint32_t MeasureValid; /*!< bit i: measurement i is fresh, 0 runs the prediction only */
   float *ControlInput;  /*!< pointer to control input  */
 
   ChiSquareTest_Typedef ChiSquareTest;  /*!< Chi Square Test */
@@ -91,7 +203,7 @@ typedef struct KF_Info_TypeDef
     matrix z;                 /*!< measurement  */
     matrix B;                 /*!< input-state  */ 
     matrix A,AT;              /*!< state transition  */
-    matrix H,HT;              /*!< state-measurement  */
+    matrix H;                 /*!< state-measurement  */
     matrix P;                 /*!< posteriori covariance  */
     matrix Pminus;            /*!< priori covariance  */
     matrix Q;                 /*!< process noise covariance  */ 
@@ -104,6 +216,23 @@ typedef struct KF_Info_TypeDef
 
   arm_status ErrorStatus;   /*!< Error status. */
 
+  Kalman_Telemetry_TypeDef Telemetry;   /*!< sticky errors and cycle counts */
+
+  uint8_t ConstantMatrix;   /*!< matrices that never change, see KALMAN_MATRIX_x */
+  uint8_t DirtyMatrix;      /*!< constant matrices changed since their derived data was calculated */
+  bool RDiagonal;           /*!< R is diagonal, cached for the sequential update */
+
+  /**
+   * @brief static sparsity pattern of the model matrices, 
+   *        nonzero columns of every row, NULL if dense.
+   */
+  struct
+  {
+    const uint32_t *A;
+    const uint32_t *H;
+    const uint32_t *B;
+  }Sparsity;
+
   /**
    * @brief points to the data of the matrix.
    */
@@ -114,7 +243,7 @@ typedef struct KF_Info_TypeDef
     float *z;              
     float *B;              
     float *A,*AT;          
-    float *H,*HT;          
+    float *H;              
     float *P;              
     float *Pminus;         
     float *Q;              
@@ -125,13 +254,35 @@ typedef struct KF_Info_TypeDef
     float *calc_vector[2];
   }pdata;
 
+  /**
+   * @brief UD factors of the covariance, P = U·D·UT, see Kalman_Filter_UD_Init().
+   *        U is unit upper triangular, stored above the diagonal, D on the diagonal.
+   */
+  struct
+  {
+    float *UD;     /*!< UD factor of P */
+    float *QUD;    /*!< UD factor of Q */
+    float *W;      /*!< [A·U | UQ], xhatSize x 2·xhatSize */
+    float *DW;     /*!< [D | DQ] */
+  }Factor;
+
   /*!< flag to skip the specified step of kalman filter */
   uint8_t SkipStep1 : 1;
   uint8_t SkipStep2 : 1;
   uint8_t SkipStep3 : 1;
   uint8_t SkipStep4 : 1;
   uint8_t SkipStep5 : 1;
-  uint8_t reserve   : 3;
+
+  /*!< flag to propagate the covariance as a symmetric matrix, only the upper triangle is calculated */
+  uint8_t SymmetricP : 1;
+  /*!< flag to update the posteriori covariance in Joseph form: (I-KH)·Pminus·(I-KH)T + K·R·KT */
+  uint8_t JosephForm : 1;
+  /*!< flag to process the measurements as scalar updates when R is diagonal and xhatSize <= 32, replaces step 3-5 */
+  uint8_t SequentialUpdate : 1;
+  /*!< flag to run with the constant gain K, set by Kalman_Filter_SteadyState_Init/Load() */
+  uint8_t SteadyState : 1;
+  /*!< flag to propagate the UD factors of the covariance, set by Kalman_Filter_UD_Init() */
+  uint8_t UDFactor : 1;
 
   /**
    * @brief user functions that can replace steps of kalman filter.
@@ -153,6 +304,62 @@ typedef struct KF_Info_TypeDef
   * @brief Initializes the kalman filter.
   */
 extern void Kalman_Filter_Init(Kalman_Info_TypeDef *kf,uint8_t xhatSize,uint8_t uSize,uint8_t zSize);
+/**
+  * @brief Initializes the kalman filter in a user provided storage block.
+  */
+extern void Kalman_Filter_Static_Init(Kalman_Info_TypeDef *kf,uint8_t xhatSize,uint8_t uSize,uint8_t zSize,float *pool,uint32_t poolSize);
+/**
+  * @brief Declare the model matrices that never change.
+  */
+extern void Kalman_Filter_SetConstant(Kalman_Info_TypeDef *kf,uint8_t mask);
+/**
+  * @brief Mark constant model matrices as changed.
+  */
+extern void Kalman_Filter_SetDirty(Kalman_Info_TypeDef *kf,uint8_t mask);
+/**
+  * @brief Iterate the riccati recursion and run with the converged gain.
+  */
+extern arm_status Kalman_Filter_SteadyState_Init(Kalman_Info_TypeDef *kf,uint16_t maxIterations,float tolerance);
+/**
+  * @brief Run with a precomputed constant gain.
+  */
+extern void Kalman_Filter_SteadyState_Load(Kalman_Info_TypeDef *kf,const float *K);
+/**
+  * @brief Check the constant gain against one step of the riccati recursion.
+  */
+extern float Kalman_Filter_SteadyState_Check(Kalman_Info_TypeDef *kf);
+/**
+  * @brief Propagate the covariance in UD factored form.
+  */
+extern arm_status Kalman_Filter_UD_Init(Kalman_Info_TypeDef *kf,float *pool,uint32_t poolSize);
+/**
+  * @brief Register the static sparsity pattern of a model matrix.
+  */
+extern void Kalman_Filter_SetSparsity(Kalman_Info_TypeDef *kf,uint8_t mask,const uint32_t *rowMask);
+/**
+  * @brief Matrix multiplication with a sparse left operand.
+  */
+extern arm_status Kalman_Sparse_Multiply(const matrix *pSrcA,const uint32_t *rowMask,const matrix *pSrcB,matrix *pDst);
+/**
+  * @brief Cholesky decomposition of a symmetric positive definite matrix.
+  */
+extern arm_status Kalman_Cholesky_Decompose(float *pData,uint8_t size);
+/**
+  * @brief Solve L·LT·X = B in place.
+  */
+extern void Kalman_Cholesky_Solve(const float *L,uint8_t size,float *pData,uint8_t numCols);
+/**
+  * @brief Chi Square Test of the innovation.
+  */
+extern bool Kalman_ChiSquare_Test(Kalman_Info_TypeDef *kf);
+/**
+  * @brief Gate the measurement update with a Chi Square value.
+  */
+extern bool Kalman_ChiSquare_Gate(Kalman_Info_TypeDef *kf);
+/**
+  * @brief Clear the telemetry of the kalman filter.
+  */
+extern void Kalman_Filter_ClearTelemetry(Kalman_Info_TypeDef *kf);
 /**
   * @brief Update the Kalman Filter.
   */
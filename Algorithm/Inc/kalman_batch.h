@@ -0,0 +1,118 @@
+#ifndef __KALMAN_BATCH_H
+#define __KALMAN_BATCH_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : kalman_batch.h
+  * @brief          : Prototypes of batched kalman filter.
+  *
+  ******************************************************************************
+  * @attention      : 1. N filters of the same size share the model matrices A, B, H, Q, R,
+  *                      such as the velocity estimators of identical motors
+  *                   2. vectors and matrices of the filters are stored as structure-of-arrays,
+  *                      element i of filter n is data[i*count + n], the loops over the
+  *                      filters are innermost and contiguous
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman.h"
+
+/* Exported defines -----------------------------------------------------------*/
+/**
+ * @brief max number of filters in a batch, one bit of SingularMask per filter.
+ */
+#define KALMAN_BATCH_MAX_COUNT  32U
+
+/**
+ * @brief number of floats used by a batch of kalman filters.
+ * @note  xhat,xhatminus,u,z,residual: (2x + u + 2z)·N
+ *        P,Pminus: 2x²·N, K: xz·N, L: z²·N, AP/HP: x·max(x,z)·N
+ */
+#define KALMAN_BATCH_STORAGE_FLOATS(xhatSize,uSize,zSize,count)                        \
+  ( (2U*(xhatSize) + (uSize) + 2U*(zSize) + 2U*(xhatSize)*(xhatSize)                 \
+  + (xhatSize)*(zSize) + (zSize)*(zSize) + (xhatSize)*KALMAN_MAX_SIZE(xhatSize,zSize)) \
+  * (count) )
+
+/**
+ * @brief define a statically allocated storage block for a batch of kalman filters.
+ */
+#define KALMAN_BATCH_STORAGE_DEF(name,xhatSize,uSize,zSize,count) \
+  static KALMAN_STORAGE_SECTION float name[KALMAN_BATCH_STORAGE_FLOATS(xhatSize,uSize,zSize,count)] __ALIGNED(8)
+
+/**
+ * @brief element i of filter n in a structure-of-arrays vector or matrix.
+ */
+#define KALMAN_BATCH_AT(kb,data,i,n)  ((kb)->data[(uint32_t)(i)*(kb)->count + (n)])
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief informations of a batch of kalman filters.
+ */
+typedef struct
+{
+  uint8_t xhatSize;   /*!< size of state vector */
+  uint8_t uSize;      /*!< size of control vector */
+  uint8_t zSize;      /*!< size of measurement vector */
+  uint8_t count;      /*!< number of filters */
+
+  uint32_t MemorySize; /*!< bytes of the storage block */
+
+  /**
+   * @brief shared model matrices, row major, owned by the user.
+   */
+  const float *A;     /*!< state transition, xhatSize x xhatSize */
+  const float *B;     /*!< input-state, xhatSize x uSize, NULL if no control */
+  const float *H;     /*!< state-measurement, zSize x xhatSize */
+  const float *Q;     /*!< process noise covariance, xhatSize x xhatSize */
+  const float *R;     /*!< measurement noise covariance, zSize x zSize */
+
+  /**
+   * @brief structure-of-arrays data of the filters.
+   */
+  float *xhat,*xhatminus;
+  float *u;
+  float *z;
+  float *P,*Pminus;
+  float *K;
+  float *L;           /*!< cholesky factor of S = H·Pminus·HT + R */
+  float *calc_matrix; /*!< A·P or H·Pminus */
+  float *calc_vector; /*!< z - H·xhatminus */
+
+  arm_status ErrorStatus;   /*!< Error status. */
+  uint32_t SingularMask;    /*!< filters whose S is not positive definite in the last update */
+
+}Kalman_Batch_Info_TypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief Initializes a batch of kalman filters in a user provided storage block.
+  */
+extern void Kalman_Batch_Init(Kalman_Batch_Info_TypeDef *kb,uint8_t xhatSize,uint8_t uSize,uint8_t zSize,uint8_t count,float *pool,uint32_t poolSize);
+/**
+  * @brief Set the shared model matrices.
+  */
+extern void Kalman_Batch_SetModel(Kalman_Batch_Info_TypeDef *kb,const float *A,const float *B,const float *H,const float *Q,const float *R);
+/**
+  * @brief Reset the state and covariance of a filter.
+  */
+extern void Kalman_Batch_Reset(Kalman_Batch_Info_TypeDef *kb,uint8_t n,const float *xhat,const float *P);
+/**
+  * @brief Store the measurement and control input of a filter.
+  */
+extern void Kalman_Batch_Input(Kalman_Batch_Info_TypeDef *kb,uint8_t n,const float *z,const float *u);
+/**
+  * @brief Read the posteriori state estimate of a filter.
+  */
+extern void Kalman_Batch_Output(Kalman_Batch_Info_TypeDef *kb,uint8_t n,float *xhat);
+/**
+  * @brief Update all filters of the batch.
+  */
+extern void Kalman_Batch_Update(Kalman_Batch_Info_TypeDef *kb);
+
+#endif
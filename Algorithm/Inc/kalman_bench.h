@@ -0,0 +1,108 @@
+#ifndef __KALMAN_BENCH_H
+#define __KALMAN_BENCH_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : kalman_bench.h
+  * @brief          : Prototypes of the kalman filter benchmark.
+  *
+  ******************************************************************************
+  * @attention      : 1. call Kalman_Bench_Run() on the target, e.g. before osKernelStart(),
+  *                      and read Kalman_Bench_TypeDef in the debugger
+  *                   2. the step cycles need KALMAN_PROFILE_ENABLE
+  *                   3. the errors compare a variant with the dense filter fed
+  *                      with the same measurements
+  *                   4. the fast math errors compare fast_math.c with the double
+  *                      libm over the inputs of the attitude filters
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman.h"
+#include "kalman_batch.h"
+#include "kalman_quatekf.h"
+#include "fast_math.h"
+
+/* Exported defines -----------------------------------------------------------*/
+/**
+ * @brief read the cycle counter, the DWT cycle counter by default.
+ */
+#ifndef KALMAN_BENCH_CYCLES
+  #define KALMAN_BENCH_CYCLES()  (DWT->CYCCNT)
+#endif
+
+/**
+ * @brief filters of the batch scaling, N = 1 ~ KALMAN_BENCH_BATCH_MAX.
+ */
+#define KALMAN_BENCH_BATCH_MAX  16U
+
+/**
+ * @brief updates of the ill-conditioned replay of the covariance forms.
+ */
+#define KALMAN_BENCH_REPLAY_ITERATIONS  20000U
+
+/**
+ * @brief points of the fast math sweeps.
+ */
+#define KALMAN_BENCH_FAST_MATH_POINTS  4096U
+
+/* Exported types ------------------------------------------------------------*/
+/**
+ * @brief results of the kalman filter benchmark, mean cycles per update.
+ */
+typedef struct
+{
+  uint32_t Iterations;        /*!< updates per measurement */
+
+  uint32_t VaryingCycles;     /*!< 6x6 attitude filter, time-varying model matrices */
+  uint32_t ConstantCycles;    /*!< 6x6 attitude filter, constant model matrices */
+  uint32_t SparseCycles;      /*!< 6x6 attitude filter, time-varying model matrices, sparsity of A and H */
+  uint32_t SymmetricCycles;   /*!< 6x6 attitude filter, time-varying model matrices, SymmetricP */
+  uint32_t JosephCycles;      /*!< 6x6 attitude filter, time-varying model matrices, JosephForm */
+  uint32_t SequentialCycles;  /*!< 6x6 attitude filter, time-varying model matrices, SequentialUpdate */
+  uint32_t FactorCycles;      /*!< 6x6 attitude filter, ill-conditioned replay, UDFactor */
+  uint32_t FactorConstantCycles; /*!< 6x6 attitude filter, ill-conditioned replay, UDFactor, constant model matrices */
+  uint32_t HookedCycles;      /*!< 6x6 attitude filter in the layout of the QuatEKF, Kalman_Filter_Update() */
+  uint32_t GeneratedCycles;   /*!< 6x6 attitude filter in the layout of the QuatEKF, Kalman_QuatEKF_Update() */
+#if KALMAN_PROFILE_ENABLE
+  uint32_t VaryingStepCycles[5];  /*!< step 1-5, time-varying model matrices */
+  uint32_t ConstantStepCycles[5]; /*!< step 1-5, constant model matrices */
+  uint32_t SparseStepCycles[5];   /*!< step 1-5, sparsity of A and H */
+  uint32_t SymmetricStepCycles[5];/*!< step 1-5, SymmetricP */
+  uint32_t JosephStepCycles[5];   /*!< step 1-5, JosephForm */
+  uint32_t SequentialStepCycles[5];/*!< step 1-5, SequentialUpdate, step 3 holds 3-5 */
+  uint32_t HookedStepCycles[5];   /*!< step 1-5, layout of the QuatEKF, Kalman_Filter_Update() */
+  uint32_t GeneratedStepCycles[5];/*!< step 1-5, layout of the QuatEKF, Kalman_QuatEKF_Update() */
+#endif
+
+  float SymmetricError;       /*!< max |xhat,P - dense xhat,P| after Iterations updates, SymmetricP */
+  float JosephError;          /*!< max |xhat,P - dense xhat,P| after Iterations updates, JosephForm */
+  float SequentialError;      /*!< max |xhat,P - dense xhat,P| after Iterations updates, SequentialUpdate */
+  float GeneratedError;       /*!< max |xhat,P - Kalman_Filter_Update() xhat,P| after Iterations updates, Kalman_QuatEKF_Update() */
+
+  uint32_t DenseIndefiniteCnt;  /*!< updates of the ill-conditioned replay leaving P not positive definite, dense */
+  uint32_t FactorIndefiniteCnt; /*!< updates of the ill-conditioned replay leaving P not positive definite, UDFactor */
+
+  float InverseSqrtError;     /*!< max |Fast_InverseSqrt(x)·sqrt(x) - 1|, x = 1e-8 ~ 1e4, the squared norms of q, gyro and accel */
+  float AcosError;            /*!< max |Fast_Acos(x) - acos(x)| rad, x = -1 ~ 1 */
+  float AsinError;            /*!< max |Fast_Asin(x) - asin(x)| rad, x = -1 ~ 1 */
+  float AtanError;            /*!< max |Fast_Atan(x) - atan(x)| rad, x = tan(-89.99 ~ 89.99 deg) */
+  float Atan2Error;           /*!< max |Fast_Atan2(y,x) - atan2(y,x)| rad, full circle of radius 1e-3, 1 and 1e3 */
+  bool FastMathValid;         /*!< every error within the bounds of fast_math.h */
+
+  uint32_t SingleCycles[KALMAN_BENCH_BATCH_MAX]; /*!< 2x2 motor filters, N-1: N Kalman_Filter_Update() */
+  uint32_t BatchCycles[KALMAN_BENCH_BATCH_MAX];  /*!< 2x2 motor filters, N-1: one Kalman_Batch_Update() of N */
+}Kalman_Bench_TypeDef;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief Measure the cycles per update of the kalman filter variants.
+  */
+extern void Kalman_Bench_Run(Kalman_Bench_TypeDef *bench,uint32_t iterations);
+
+#endif
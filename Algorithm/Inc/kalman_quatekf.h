@@ -0,0 +1,28 @@
+#ifndef __KALMAN_QUATEKF_H
+#define __KALMAN_QUATEKF_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : kalman_quatekf.h
+  * @brief          : Prototypes of the specialized update of the quaternion extended kalman filter kalman filter.
+  *
+  ******************************************************************************
+  * @attention      : generated by script/kalman_codegen.py, do not edit
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman.h"
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief Update the QuatEKF kalman filter, drop-in for Kalman_Filter_Update().
+  */
+extern float *Kalman_QuatEKF_Update(Kalman_Info_TypeDef *kf);
+
+#endif
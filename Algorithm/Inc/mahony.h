@@ -0,0 +1,48 @@
+#ifndef __MAHONY_H
+#define __MAHONY_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : mahony.h
+  * @brief          : Prototypes of Mahony complementary filter.
+  * 
+  ******************************************************************************
+  * @attention      : the outputs are the same as the Quaternion EKF,
+  *                   read them by Quat_Get_Angle() and so on.
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "quaternion.h"
+
+/**
+ * @brief the accel is used only if its norm is within GravityAccel ± MAHONY_ACCEL_TOLERANCE
+ */
+#define MAHONY_ACCEL_TOLERANCE  (0.2f*GravityAccel)
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief Initializes the Mahony filter.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @param Kp: proportional gain of the accel error
+  * @param Ki: integral gain of the accel error, the integral is the gyro bias
+  */
+extern void Mahony_Init(Quat_Info_Typedef *quat,float Kp,float Ki);
+
+/**
+  * @brief  Update the Mahony filter
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to integrate the gyro only
+  * @param dt: system latency
+  */
+extern void Mahony_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt);
+
+#endif
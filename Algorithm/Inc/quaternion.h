@@ -21,7 +21,49 @@
 
 #define GravityAccel 9.8035f
 
+/**
+ * @brief size of the Quaternion EKF.
+ */
+#define QUATEKF_XHAT_SIZE 6
+#define QUATEKF_U_SIZE    0
+#define QUATEKF_Z_SIZE    3
+
+/**
+ * @brief size of the Quaternion error-state EKF, rotation error and gyro biases.
+ */
+#define QUATESKF_XHAT_SIZE 6
+#define QUATESKF_U_SIZE    0
+#define QUATESKF_Z_SIZE    3
+
+/**
+ * @brief update the Quaternion EKF with the kernel generated from script/quatekf.json,
+ *        0: Kalman_Filter_Update()
+ */
+#ifndef QUATEKF_GENERATED_UPDATE
+#define QUATEKF_GENERATED_UPDATE 1
+#endif
+
+/**
+ * @brief propagate the quaternion by the exponential map of the gyro over dt,
+ *        0: first-order Runge-Kutta
+ */
+#ifndef QUATEKF_EXACT_PROPAGATION
+#define QUATEKF_EXACT_PROPAGATION 1
+#endif
+
 /* Exported typedef ----------------------------------------------------------*/
+/**
+ * @brief index of the outputs derived from the quaternion on demand.
+ */
+typedef enum
+{
+  QUAT_OUTPUT_RELATION = 0U, /*!< relation matrix */
+  QUAT_OUTPUT_ANGLE,         /*!< yaw, pitch and roll */
+  QUAT_OUTPUT_YAW,           /*!< yaw only */
+  QUAT_OUTPUT_GRAVITY,       /*!< direction of gravity */
+  QUAT_OUTPUT_NUM,
+}Quat_Output_Index_e;
+
 /**
  * @brief structure that contains the Informations of quaternion.
  */
@@ -32,18 +74,28 @@ typedef struct
   float quat[4];       /*!< quaternion value */
   float biasgyro[3];   /*!< bias of gyro */
   matrix relation;     /*!< relation matrix */
+  float relation_data[9]; /*!< data of relation matrix */
 
   float Q1,Q2,R;       /*!< data of process and measurement noise */
+  float Kp,Ki;         /*!< gains of the Mahony filter */
   float *pdata_A;      /*!< point to data of state transition */
   float *pdata_P;      /*!< point to data of posteriori covariance */
   Kalman_Info_TypeDef QuatEKF;  /*!< Extended Kalman Filter */
+  float QuatEKF_Storage[KALMAN_STORAGE_FLOATS(QUATEKF_XHAT_SIZE,QUATEKF_U_SIZE,QUATEKF_Z_SIZE)]; /*!< matrix storage of the EKF */
 
   float accel[3];      /*!< data of accel */
   float gyro[3];       /*!< data of gyro */
   float accelInvNorm;  /*!< inverse of accel norm */
   float gyroInvNorm;   /*!< inverse of gyro norm */
   float halfgyrodt[3]; /*!< 0.5f*gyro*dt */
-  float angle[3];      /*!< angle in radians: */
+
+  uint32_t version;    /*!< stamp of quat and biasgyro, increased every update */
+  uint32_t output_version[QUAT_OUTPUT_NUM]; /*!< stamp of every derived output */
+  float angle[3];      /*!< angle in radians: yaw, pitch, roll */
+  float gravity[3];    /*!< unit gravity in the body frame */
+  float last_yaw;      /*!< yaw of the last update */
+  int32_t YawRoundCount; /*!< rounds of the yaw */
+  float yaw_total;     /*!< continuous yaw in radians */
 }Quat_Info_Typedef;
 
 /* Exported functions prototypes ---------------------------------------------*/
@@ -68,6 +120,95 @@ extern void QuatEKF_Init(Quat_Info_Typedef *quat,float Q1,float Q2,float R,float
   * @param dt: system latency
   */
 extern void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt);
+
+/**
+  * @brief  Update the Extended Kalman Filter in closed form, same filter as QuatEKF_Update
+  *         with an identity pdata_A.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
+  * @param dt: system latency
+  */
+extern void QuatEKF_ClosedForm_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt);
+
+/**
+  * @brief Initializes the Quaternion error-state EKF.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param Q1: process noise of the quaternion, the rotation error uses 4.f*Q1
+  * @param Q2: process noise of the gyro bias
+  * @param R: measurement noise
+  * @param pdata_P: point to the data of posteriori covariance
+  */
+extern void QuatESKF_Init(Quat_Info_Typedef *quat,float Q1,float Q2,float R,float *pdata_P);
+
+/**
+  * @brief  Update the error-state Extended Kalman Filter
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
+  * @param dt: system latency
+  */
+extern void QuatESKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt);
+
+/**
+  * @brief  Initializes the outputs derived from the quaternion,
+  *         called by the initialization of every attitude filter.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  */
+extern void Quat_Output_Init(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Stamp an update of the quaternion and count the rounds of the yaw,
+  *         called at the end of every update of the attitude filters.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  */
+extern void Quat_Output_Update(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Get the relation matrix, body frame to earth frame,
+  *         calculated only once per update of the quaternion.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the relation matrix
+  */
+extern const matrix *Quat_Get_Relation(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Get the angle in radians, calculated only once per update of the quaternion.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the yaw, pitch and roll
+  */
+extern const float *Quat_Get_Angle(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Get the yaw in radians without the pitch and roll.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval yaw in [-pi,pi]
+  */
+extern float Quat_Get_Yaw(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Get the unit gravity in the body frame.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the gravity
+  */
+extern const float *Quat_Get_Gravity(Quat_Info_Typedef *quat);
+
+/**
+  * @brief  Get the continuous yaw in radians, the rounds are counted by every update.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval yaw plus the rounds
+  */
+extern float Quat_Get_YawTotal(Quat_Info_Typedef *quat);
 //------------------------------------------------------------------------------
 
 #endif
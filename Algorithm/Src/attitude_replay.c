@@ -0,0 +1,541 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : attitude_replay.c
+  * Description        : Replay of synthetic rotation profiles through the attitude engines.
+  ******************************************************************************
+  * @attention      : the quaternion rotates the body frame to the earth frame,
+  *                   q(t+dt) = q(t)·exp(0.5f·gyro·dt) as in quaternion.c
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "attitude_replay.h"
+#include "stm32f4xx.h"
+#include "string.h"
+#include "math.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+ * @brief gyro samples per second of the engine replay, the rate of IMU_Task.
+ */
+#define ATTITUDE_REPLAY_ENGINE_RATE  1000U
+
+/**
+ * @brief radian to degrees, 180/PI
+ */
+#define ATTITUDE_REPLAY_DEGREES  57.295779513082
+
+/**
+ * @brief periods of the jittered schedule, repeated over the replay.
+ */
+#define ATTITUDE_REPLAY_SCHEDULE_NUM  10U
+
+/* Private typedef -----------------------------------------------------------*/
+/**
+ * @brief body rate of a rotation profile at the time t.
+ */
+typedef void (*Attitude_Replay_Profile)(double t,double rate[3]);
+
+/**
+ * @brief update of an attitude engine.
+ */
+typedef void (*Attitude_Replay_Engine)(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt);
+
+/**
+ * @brief gyro input of the drifts.
+ */
+typedef enum
+{
+  ATTITUDE_REPLAY_GYRO_MEAN = 0U,  /*!< mean rate of every update, an integrating gyro at the update rate */
+  ATTITUDE_REPLAY_GYRO_DECIMATED,  /*!< the last 2 kHz sample of every update */
+  ATTITUDE_REPLAY_GYRO_PREINT,     /*!< every 2 kHz sample through GyroPreInt */
+}Attitude_Replay_Gyro_e;
+
+/* Private variables ---------------------------------------------------------*/
+/**
+ * @brief data of the state transition and covariance of the engines, as IMU_Task.
+ */
+static float Attitude_Replay_A[36] = {1, 0, 0, 0, 0, 0,
+                                      0, 1, 0, 0, 0, 0,
+                                      0, 0, 1, 0, 0, 0,
+                                      0, 0, 0, 1, 0, 0,
+                                      0, 0, 0, 0, 1, 0,
+                                      0, 0, 0, 0, 0, 1};
+
+static float Attitude_Replay_EKF_P[36] = {100000, 0.1, 0.1, 0.1, 0.1, 0.1,
+                                          0.1, 100000, 0.1, 0.1, 0.1, 0.1,
+                                          0.1, 0.1, 100000, 0.1, 0.1, 0.1,
+                                          0.1, 0.1, 0.1, 100000, 0.1, 0.1,
+                                          0.1, 0.1, 0.1, 0.1, 100, 0.1,
+                                          0.1, 0.1, 0.1, 0.1, 0.1, 100};
+
+static float Attitude_Replay_ESKF_P[36] = {1, 0, 0, 0, 0, 0,
+                                           0, 1, 0, 0, 0, 0,
+                                           0, 0, 1, 0, 0, 0,
+                                           0, 0, 0, 100, 0, 0,
+                                           0, 0, 0, 0, 100, 0,
+                                           0, 0, 0, 0, 0, 100};
+
+/**
+ * @brief updates of the engines, in the order of IMU_ENGINE.
+ */
+static const Attitude_Replay_Engine Attitude_Replay_Engines[ATTITUDE_REPLAY_ENGINE_NUM] =
+{
+  QuatEKF_Update,
+  QuatEKF_ClosedForm_Update,
+  QuatESKF_Update,
+  Mahony_Update,
+};
+
+/**
+ * @brief gyro bias of the engine replay in rad/s.
+ */
+static const float Attitude_Replay_Bias[3] = {0.005f, -0.003f, 0.004f};
+
+/**
+ * @brief update rates of the drifts in Hz.
+ */
+static const uint32_t Attitude_Replay_Rates[ATTITUDE_REPLAY_RATE_NUM] = {1000U, 500U, 250U};
+
+/**
+ * @brief jitter of the schedule in IMU_PERIOD_HIST_WIDTH, the last period is a skipped one.
+ */
+static const float Attitude_Replay_Jitter[ATTITUDE_REPLAY_SCHEDULE_NUM] =
+{
+  0.f, 0.f, -1.2f, 1.2f, 0.f, 2.4f, 0.f, 0.f, -1.2f, IMU_TASK_PERIOD/IMU_PERIOD_HIST_WIDTH,
+};
+
+/**
+ * @brief bins of the histogram of the schedule, the skipped period is out of range.
+ */
+static const uint8_t Attitude_Replay_Bins[ATTITUDE_REPLAY_SCHEDULE_NUM] =
+{
+  IMU_PERIOD_HIST_NUM/2U,      IMU_PERIOD_HIST_NUM/2U, IMU_PERIOD_HIST_NUM/2U - 1U, IMU_PERIOD_HIST_NUM/2U + 1U,
+  IMU_PERIOD_HIST_NUM/2U,      IMU_PERIOD_HIST_NUM/2U + 2U, IMU_PERIOD_HIST_NUM/2U, IMU_PERIOD_HIST_NUM/2U,
+  IMU_PERIOD_HIST_NUM/2U - 1U, IMU_PERIOD_HIST_NUM - 1U,
+};
+
+/**
+ * @brief gyro pre-integration of the drifts.
+ */
+static GyroPreInt_Typedef Attitude_Replay_PreInt;
+
+/**
+ * @brief attitude engine of the replay.
+ */
+static Quat_Info_Typedef Attitude_Replay_Quat;
+
+/**
+ * @brief state of the noise generator.
+ */
+static uint32_t Attitude_Replay_Seed;
+
+/* Private function ----------------------------------------------------------*/
+/**
+  * @brief  uniform noise in [-1,1), a linear congruential generator.
+  * @retval noise
+  */
+static float Attitude_Replay_Noise(void)
+{
+  Attitude_Replay_Seed = Attitude_Replay_Seed * 1664525U + 1013904223U;
+
+  return (float)(Attitude_Replay_Seed >> 8) * (2.f / 16777216.f) - 1.f;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  spin about the z axis with a wobble of the x and y axes.
+  * @param  t: time in seconds
+  * @param  rate: body rate in rad/s
+  * @retval none
+  */
+static void Attitude_Replay_Wobble(double t,double rate[3])
+{
+  rate[0] = 0.8 * sin(2.0 * PI * 0.5 * t);
+  rate[1] = 0.6 * cos(2.0 * PI * 0.3 * t);
+  rate[2] = 1.0;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  spin of 10 rad/s about a fixed axis.
+  * @param  t: time in seconds
+  * @param  rate: body rate in rad/s
+  * @retval none
+  */
+static void Attitude_Replay_Spin(double t,double rate[3])
+{
+  (void)t;
+
+  rate[0] = 3.6;
+  rate[1] = 4.8;
+  rate[2] = 8.0;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  5 Hz coning, the rate vector turns in the x-y plane.
+  * @param  t: time in seconds
+  * @param  rate: body rate in rad/s
+  * @retval none
+  */
+static void Attitude_Replay_Coning(double t,double rate[3])
+{
+  rate[0] = 0.1 * 2.0 * PI * 5.0 * cos(2.0 * PI * 5.0 * t);
+  rate[1] = 0.1 * 2.0 * PI * 5.0 * sin(2.0 * PI * 5.0 * t);
+  rate[2] = 0.0;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  propagate the quaternion by the exponential map of a constant rate.
+  * @param  q: quaternion
+  * @param  rate: body rate in rad/s
+  * @param  dt: time step
+  * @retval none
+  */
+static void Attitude_Replay_Propagate(double q[4],const double rate[3],double dt)
+{
+  double h[3] = {0.5 * rate[0] * dt, 0.5 * rate[1] * dt, 0.5 * rate[2] * dt};
+  double theta = sqrt(h[0]*h[0] + h[1]*h[1] + h[2]*h[2]);
+  double c = cos(theta), s = (theta > 1e-12) ? sin(theta) / theta : 1.0;
+  double p[4] = {q[0], q[1], q[2], q[3]};
+  double norm = 0;
+
+  /* q = q·(cos θ, sin θ·h/θ) */
+  q[0] = c * p[0] - s * (p[1]*h[0] + p[2]*h[1] + p[3]*h[2]);
+  q[1] = c * p[1] + s * (p[0]*h[0] + p[2]*h[2] - p[3]*h[1]);
+  q[2] = c * p[2] + s * (p[0]*h[1] + p[3]*h[0] - p[1]*h[2]);
+  q[3] = c * p[3] + s * (p[0]*h[2] + p[1]*h[1] - p[2]*h[0]);
+
+  norm = 1.0 / sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  q[0] *= norm;
+  q[1] *= norm;
+  q[2] *= norm;
+  q[3] *= norm;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  integrate the truth over a gyro sample.
+  * @param  q: quaternion of the truth
+  * @param  profile: rotation profile
+  * @param  t: time of the start of the sample
+  * @param  dt: period of the sample
+  * @param  mean: mean body rate over the sample, the output of an integrating gyro
+  * @retval none
+  */
+static void Attitude_Replay_Truth(double q[4],Attitude_Replay_Profile profile,double t,double dt,double mean[3])
+{
+  double h = dt / ATTITUDE_REPLAY_SUBSTEPS;
+  double rate[3] = {0};
+
+  memset(mean, 0, 3 * sizeof(double));
+
+  /* rate at the middle of the substeps */
+  for(uint32_t i = 0; i < ATTITUDE_REPLAY_SUBSTEPS; i++)
+  {
+    profile(t + (i + 0.5) * h,rate);
+    Attitude_Replay_Propagate(q,rate,h);
+
+    mean[0] += rate[0] / ATTITUDE_REPLAY_SUBSTEPS;
+    mean[1] += rate[1] / ATTITUDE_REPLAY_SUBSTEPS;
+    mean[2] += rate[2] / ATTITUDE_REPLAY_SUBSTEPS;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  unit gravity in the body frame, the last row of the relation matrix.
+  * @param  q: quaternion
+  * @param  gravity: unit gravity
+  * @retval none
+  */
+static void Attitude_Replay_Gravity(const double q[4],double gravity[3])
+{
+  gravity[0] = 2.0 * (q[1]*q[3] - q[0]*q[2]);
+  gravity[1] = 2.0 * (q[2]*q[3] + q[0]*q[1]);
+  gravity[2] = 1.0 - 2.0 * (q[1]*q[1] + q[2]*q[2]);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  angle between the gravity of the truth and the estimate.
+  * @param  q: quaternion of the truth
+  * @param  quat: estimated quaternion
+  * @retval tilt error in degrees
+  */
+static double Attitude_Replay_Tilt(const double q[4],const float quat[4])
+{
+  double p[4] = {quat[0], quat[1], quat[2], quat[3]};
+  double a[3] = {0}, b[3] = {0};
+  double cross[3] = {0};
+
+  Attitude_Replay_Gravity(q,a);
+  Attitude_Replay_Gravity(p,b);
+
+  cross[0] = a[1]*b[2] - a[2]*b[1];
+  cross[1] = a[2]*b[0] - a[0]*b[2];
+  cross[2] = a[0]*b[1] - a[1]*b[0];
+
+  /* atan2 keeps the precision of the small angles */
+  return atan2(sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]),
+               a[0]*b[0] + a[1]*b[1] + a[2]*b[2]) * ATTITUDE_REPLAY_DEGREES;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  rotation between the truth and the estimate.
+  * @param  q: quaternion of the truth
+  * @param  quat: estimated quaternion
+  * @retval attitude error in degrees
+  */
+static double Attitude_Replay_Angle(const double q[4],const float quat[4])
+{
+  double e[4] = {0};
+
+  /* e = conj(quat)·q */
+  e[0] = quat[0]*q[0] + quat[1]*q[1] + quat[2]*q[2] + quat[3]*q[3];
+  e[1] = quat[0]*q[1] - quat[1]*q[0] - quat[2]*q[3] + quat[3]*q[2];
+  e[2] = quat[0]*q[2] + quat[1]*q[3] - quat[2]*q[0] - quat[3]*q[1];
+  e[3] = quat[0]*q[3] - quat[1]*q[2] + quat[2]*q[1] - quat[3]*q[0];
+
+  return 2.0 * atan2(sqrt(e[1]*e[1] + e[2]*e[2] + e[3]*e[3]),fabs(e[0])) * ATTITUDE_REPLAY_DEGREES;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  accuracy and cycles per update of every attitude engine at 1 kHz,
+  *         gyro with bias and noise, accel with noise.
+  * @param  replay: point to a Attitude_Replay_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Attitude_Replay_Engine_Run(Attitude_Replay_TypeDef *replay)
+{
+  const double dt = 1.0 / ATTITUDE_REPLAY_ENGINE_RATE;
+  double q[4] = {0}, mean[3] = {0}, gravity[3] = {0};
+  double error = 0, t = 0;
+  float gyro[3] = {0.f}, accel[3] = {0.f};
+  uint32_t start = 0, cycles = 0;
+
+  for(uint8_t engine = 0; engine < ATTITUDE_REPLAY_ENGINE_NUM; engine++)
+  {
+    memset(&Attitude_Replay_Quat, 0, sizeof(Attitude_Replay_Quat));
+
+    /* the parameters of IMU_Task */
+    switch(engine)
+    {
+      case 0:
+      case 1:
+        QuatEKF_Init(&Attitude_Replay_Quat,10.f,0.001f,1000000.f,Attitude_Replay_A,Attitude_Replay_EKF_P);
+      break;
+
+      case 2:
+        QuatESKF_Init(&Attitude_Replay_Quat,10.f,0.001f,1000000.f,Attitude_Replay_ESKF_P);
+      break;
+
+      default:
+        Mahony_Init(&Attitude_Replay_Quat,1.f,0.05f);
+      break;
+    }
+
+    /* the same profile and noise for every engine */
+    Attitude_Replay_Seed = 1U;
+    q[0] = 1.0; q[1] = 0.0; q[2] = 0.0; q[3] = 0.0;
+    error = 0;
+    cycles = 0;
+
+    for(uint32_t i = 0; i < replay->Updates; i++)
+    {
+      t = i * dt;
+      Attitude_Replay_Truth(q,Attitude_Replay_Wobble,t,dt,mean);
+      Attitude_Replay_Gravity(q,gravity);
+
+      for(uint8_t k = 0; k < 3; k++)
+      {
+        gyro[k] = (float)mean[k] + Attitude_Replay_Bias[k] + 0.005f * Attitude_Replay_Noise();
+        accel[k] = GravityAccel * (float)gravity[k] + 0.05f * Attitude_Replay_Noise();
+      }
+
+      start = ATTITUDE_REPLAY_CYCLES();
+      Attitude_Replay_Engines[engine](&Attitude_Replay_Quat,gyro,accel,(float)dt);
+      cycles += ATTITUDE_REPLAY_CYCLES() - start;
+
+      /* skip the convergence */
+      if(t >= 1.0)
+      {
+        error = fmax(error,Attitude_Replay_Tilt(q,Attitude_Replay_Quat.quat));
+      }
+    }
+
+    replay->EngineTiltError[engine] = (float)error;
+    replay->EngineCycles[engine] = cycles / replay->Updates;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  drift of the propagation, the closed form QuatEKF without accel.
+  * @param  profile: rotation profile
+  * @param  rate: updates per second
+  * @param  gyro_input: gyro input of the updates
+  * @retval max attitude error in degrees
+  */
+static float Attitude_Replay_Drift(Attitude_Replay_Profile profile,uint32_t rate,Attitude_Replay_Gyro_e gyro_input)
+{
+  uint32_t samples = (gyro_input == ATTITUDE_REPLAY_GYRO_MEAN) ? 1U : ATTITUDE_REPLAY_GYRO_RATE / rate;
+  double dt = 1.0 / (rate * samples);
+  double q[4] = {1.0, 0.0, 0.0, 0.0}, mean[3] = {0};
+  double error = 0, t = 0;
+  float sample[3] = {0.f}, gyro[3] = {0.f};
+  float filter_dt = 0.f;
+
+  memset(&Attitude_Replay_Quat, 0, sizeof(Attitude_Replay_Quat));
+  QuatEKF_Init(&Attitude_Replay_Quat,10.f,0.001f,1000000.f,Attitude_Replay_A,Attitude_Replay_EKF_P);
+  GyroPreInt_Reset(&Attitude_Replay_PreInt);
+
+  for(uint32_t i = 0; i < (uint32_t)(ATTITUDE_REPLAY_TIME * rate); i++)
+  {
+    /* the gyro samples of the update, mean rate over every sample */
+    for(uint32_t n = 0; n < samples; n++)
+    {
+      Attitude_Replay_Truth(q,profile,t,dt,mean);
+      t += dt;
+
+      sample[0] = (float)mean[0];
+      sample[1] = (float)mean[1];
+      sample[2] = (float)mean[2];
+      GyroPreInt_Update(&Attitude_Replay_PreInt,sample,(float)dt);
+    }
+
+    /* the period of the update, the last sample holds without the pre-integration */
+    filter_dt = GyroPreInt_Fetch(&Attitude_Replay_PreInt,gyro);
+    if(gyro_input != ATTITUDE_REPLAY_GYRO_PREINT)
+    {
+      memcpy(gyro,sample,sizeof(gyro));
+    }
+
+    QuatEKF_ClosedForm_Update(&Attitude_Replay_Quat,gyro,NULL,filter_dt);
+
+    error = fmax(error,Attitude_Replay_Angle(q,Attitude_Replay_Quat.quat));
+  }
+
+  return (float)error;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  jittered and skipped periods through IMU_Period_Update(), the wobble
+  *         propagated with the measured and the nominal period.
+  * @param  replay: point to a Attitude_Replay_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Attitude_Replay_Timing(Attitude_Replay_TypeDef *replay)
+{
+  uint32_t periods = (uint32_t)(ATTITUDE_REPLAY_TIME / IMU_TASK_PERIOD);
+  uint32_t cycles = 0, timestamp = 0;
+  uint32_t histogram[IMU_PERIOD_HIST_NUM] = {0};
+  double q[4] = {0}, mean[3] = {0};
+  double error = 0, t = 0, period = 0;
+  float gyro[3] = {0.f};
+  float dt = 0.f;
+
+  periods -= periods % ATTITUDE_REPLAY_SCHEDULE_NUM;
+
+  for(uint8_t measured = 0; measured < 2; measured++)
+  {
+    memset(&Attitude_Replay_Quat, 0, sizeof(Attitude_Replay_Quat));
+    QuatEKF_Init(&Attitude_Replay_Quat,10.f,0.001f,1000000.f,Attitude_Replay_A,Attitude_Replay_EKF_P);
+
+    /* as IMU_Task_Init, the timestamps wrap after 50 ms */
+    memset(&replay->Timing, 0, sizeof(replay->Timing));
+    replay->Timing.dt_min = IMU_DT_MAX;
+    timestamp = 0U - (uint32_t)(0.05f * SystemCoreClock);
+    replay->Timing.timestamp = timestamp;
+
+    q[0] = 1.0; q[1] = 0.0; q[2] = 0.0; q[3] = 0.0;
+    error = 0;
+    t = 0;
+
+    for(uint32_t i = 0; i < periods; i++)
+    {
+      /* DWT timestamp at the end of the period */
+      cycles = (uint32_t)((IMU_TASK_PERIOD + Attitude_Replay_Jitter[i % ATTITUDE_REPLAY_SCHEDULE_NUM] * IMU_PERIOD_HIST_WIDTH) * SystemCoreClock + 0.5f);
+      timestamp += cycles;
+      period = (double)cycles / SystemCoreClock;
+
+      Attitude_Replay_Truth(q,Attitude_Replay_Wobble,t,period,mean);
+      t += period;
+
+      gyro[0] = (float)mean[0];
+      gyro[1] = (float)mean[1];
+      gyro[2] = (float)mean[2];
+
+      dt = IMU_Period_Update(&replay->Timing,timestamp);
+      QuatEKF_ClosedForm_Update(&Attitude_Replay_Quat,gyro,NULL,(measured != 0U) ? dt : IMU_TASK_PERIOD);
+
+      error = fmax(error,Attitude_Replay_Angle(q,Attitude_Replay_Quat.quat));
+    }
+
+    if(measured != 0U)
+    {
+      replay->MeasuredDtDrift = (float)error;
+    }
+    else
+    {
+      replay->NominalDtDrift = (float)error;
+    }
+  }
+
+  /* the statistics of the schedule */
+  for(uint32_t i = 0; i < ATTITUDE_REPLAY_SCHEDULE_NUM; i++)
+  {
+    histogram[Attitude_Replay_Bins[i]] += periods / ATTITUDE_REPLAY_SCHEDULE_NUM;
+  }
+
+  replay->TimingValid = (replay->Timing.count == periods)
+                     && (replay->Timing.overrun == periods / ATTITUDE_REPLAY_SCHEDULE_NUM)
+                     && (fabsf(replay->Timing.dt_min - (IMU_TASK_PERIOD - 1.2f * IMU_PERIOD_HIST_WIDTH)) < 1e-6f)
+                     && (fabsf(replay->Timing.dt_max - 2.f * IMU_TASK_PERIOD) < 1e-6f)
+                     && (memcmp(histogram,replay->Timing.histogram,sizeof(histogram)) == 0);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Replay the synthetic rotation profiles through the attitude engines.
+  * @param replay: point to a Attitude_Replay_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+void Attitude_Replay_Run(Attitude_Replay_TypeDef *replay)
+{
+  /* enable the DWT cycle counter */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  replay->Updates = (uint32_t)(ATTITUDE_REPLAY_TIME * ATTITUDE_REPLAY_ENGINE_RATE);
+
+  /* accuracy against cycles of the engines */
+  Attitude_Replay_Engine_Run(replay);
+
+  /* drift of the propagation at the update rates */
+  for(uint8_t i = 0; i < ATTITUDE_REPLAY_RATE_NUM; i++)
+  {
+    replay->SpinDrift[i] = Attitude_Replay_Drift(Attitude_Replay_Spin,Attitude_Replay_Rates[i],ATTITUDE_REPLAY_GYRO_MEAN);
+    replay->ConingDrift[i] = Attitude_Replay_Drift(Attitude_Replay_Coning,Attitude_Replay_Rates[i],ATTITUDE_REPLAY_GYRO_MEAN);
+    replay->DecimatedDrift[i] = Attitude_Replay_Drift(Attitude_Replay_Coning,Attitude_Replay_Rates[i],ATTITUDE_REPLAY_GYRO_DECIMATED);
+    replay->PreIntDrift[i] = Attitude_Replay_Drift(Attitude_Replay_Coning,Attitude_Replay_Rates[i],ATTITUDE_REPLAY_GYRO_PREINT);
+  }
+
+  /* measured period of the jittered schedule */
+  Attitude_Replay_Timing(replay);
+}
+//------------------------------------------------------------------------------
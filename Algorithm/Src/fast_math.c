@@ -0,0 +1,213 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : fast_math.c
+  * Description        : Implementation of fast approximate math functions.
+  ******************************************************************************
+  * @attention      : 1. acos/asin: Abramowitz and Stegun 4.4.46,
+  *                      acos(x) = sqrt(1-x)·(a0 + a1·x + ... + a7·x^7), 0 <= x <= 1, |e| <= 2e-8
+  *                   2. atan: Abramowitz and Stegun 4.4.49,
+  *                      atan(x) = x·(1 + a2·x^2 + ... + a16·x^16), 0 <= x <= 1, |e| <= 2e-8
+  *                   3. the bounds in fast_math.h include the float rounding
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "fast_math.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+ * @brief pi/2
+ */
+#define FAST_MATH_HALF_PI  1.57079632679f
+
+/* Private function ----------------------------------------------------------*/
+/**
+  * @brief  arc cosine of x in [0,1]
+  * @param  x: input, 0 <= x <= 1
+  * @retval acos(x)
+  */
+static float Fast_Acos_Positive(float x)
+{
+  float root = 0.f;
+  float poly = -0.0012624911f;
+
+  /* a7 ... a0 in Horner form */
+  poly = poly * x + 0.0066700901f;
+  poly = poly * x - 0.0170881256f;
+  poly = poly * x + 0.0308918810f;
+  poly = poly * x - 0.0501743046f;
+  poly = poly * x + 0.0889789874f;
+  poly = poly * x - 0.2145988016f;
+  poly = poly * x + 1.5707963050f;
+
+  /* sqrt(1 - x) by the hardware */
+  arm_sqrt_f32(1.f - x, &root);
+
+  return root * poly;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  arc tangent of x in [0,1]
+  * @param  x: input, 0 <= x <= 1
+  * @retval atan(x)
+  */
+static float Fast_Atan_Unit(float x)
+{
+  float x2 = x * x;
+  float poly = 0.0028662257f;
+
+  /* a16 ... a2 in Horner form of x^2 */
+  poly = poly * x2 - 0.0161657367f;
+  poly = poly * x2 + 0.0429096138f;
+  poly = poly * x2 - 0.0752896400f;
+  poly = poly * x2 + 0.1065626393f;
+  poly = poly * x2 - 0.1420889944f;
+  poly = poly * x2 + 0.1999355085f;
+  poly = poly * x2 - 0.3333314528f;
+
+  return x + x * x2 * poly;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  inverse square root by the hardware square root
+  * @param  x: input
+  * @retval 1.f/sqrt(x), 0 for x <= 0, NaN or +inf
+  */
+float Fast_InverseSqrt(float x)
+{
+  float root = 0.f;
+
+  /* arm_sqrt_f32 returns 0 for x <= 0 and NaN */
+  arm_sqrt_f32(x, &root);
+
+  /* no inverse of a zero norm, the caller sees 0 instead of +inf */
+  if(!(root > 0.f))
+  {
+    return 0.f;
+  }
+
+  return 1.f / root;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  arc cosine
+  * @param  x: input, clamped to [-1,1]
+  * @retval acos(x) in [0,pi]
+  */
+float Fast_Acos(float x)
+{
+  /* clamp the rounding error of the input */
+  if(x > 1.f)
+  {
+    x = 1.f;
+  }
+  else if(x < -1.f)
+  {
+    x = -1.f;
+  }
+
+  /* acos(-x) = pi - acos(x) */
+  if(x < 0.f)
+  {
+    return 2.f * FAST_MATH_HALF_PI - Fast_Acos_Positive(-x);
+  }
+
+  return Fast_Acos_Positive(x);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  arc sine
+  * @param  x: input, clamped to [-1,1]
+  * @retval asin(x) in [-pi/2,pi/2]
+  */
+float Fast_Asin(float x)
+{
+  /* clamp the rounding error of the input */
+  if(x > 1.f)
+  {
+    x = 1.f;
+  }
+  else if(x < -1.f)
+  {
+    x = -1.f;
+  }
+
+  /* asin(x) = pi/2 - acos(x), asin(-x) = -asin(x) */
+  if(x < 0.f)
+  {
+    return Fast_Acos_Positive(-x) - FAST_MATH_HALF_PI;
+  }
+
+  return FAST_MATH_HALF_PI - Fast_Acos_Positive(x);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  arc tangent
+  * @param  x: input
+  * @retval atan(x) in [-pi/2,pi/2]
+  */
+float Fast_Atan(float x)
+{
+  float ax = fabsf(x);
+  float angle = 0.f;
+
+  /* atan(x) = pi/2 - atan(1/x) for |x| > 1 */
+  if(ax > 1.f)
+  {
+    angle = FAST_MATH_HALF_PI - Fast_Atan_Unit(1.f / ax);
+  }
+  else
+  {
+    angle = Fast_Atan_Unit(ax);
+  }
+
+  return (x < 0.f) ? -angle : angle;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  arc tangent of y/x in the quadrant of (x,y)
+  * @param  y: ordinate
+  * @param  x: abscissa
+  * @retval atan2(y,x) in [-pi,pi], 0 for x = y = 0
+  */
+float Fast_Atan2(float y,float x)
+{
+  float ax = fabsf(x), ay = fabsf(y);
+  float angle = 0.f;
+
+  if(ax == 0.f && ay == 0.f)
+  {
+    return 0.f;
+  }
+
+  /* reduce to the first octant */
+  if(ay > ax)
+  {
+    angle = FAST_MATH_HALF_PI - Fast_Atan_Unit(ax / ay);
+  }
+  else
+  {
+    angle = Fast_Atan_Unit(ay / ax);
+  }
+
+  /* the second and third quadrant */
+  if(x < 0.f)
+  {
+    angle = 2.f * FAST_MATH_HALF_PI - angle;
+  }
+
+  return (y < 0.f) ? -angle : angle;
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,114 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : gyro_preint.c
+  * Description        : Implementation of coning-compensated gyro pre-integration.
+  ******************************************************************************
+  * @attention      : 1. rotation vector of the interval: phi = alpha + beta,
+  *                      alpha = sum of the increments, beta = coning correction
+  *                   2. beta(m) = beta(m-1) + 0.5f*(alpha(m-1) + delta(m-1)/6) x delta(m),
+  *                      see P. G. Savage, "Strapdown Inertial Navigation Integration
+  *                      Algorithm Design Part 1: Attitude Algorithms"
+  *                   3. the filter propagates the quaternion by the exponential map
+  *                      of a constant rate, feed it phi/T over T
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "gyro_preint.h"
+#include "string.h"
+
+/**
+  * @brief  Reset the gyro pre-integration.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  * @retval none
+  */
+void GyroPreInt_Reset(GyroPreInt_Typedef *preint)
+{
+  memset(preint->alpha, 0, sizeof(preint->alpha));
+  memset(preint->beta, 0, sizeof(preint->beta));
+  memset(preint->last_delta, 0, sizeof(preint->last_delta));
+
+  preint->dt = 0.f;
+  preint->count = 0;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Accumulate a gyro sample.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  * @param  gyro: point to the gyro measurement
+  * @param  dt: sample period
+  * @retval none
+  */
+void GyroPreInt_Update(GyroPreInt_Typedef *preint,const float gyro[3],float dt)
+{
+  float delta[3] = {0.f}, a[3] = {0.f};
+
+  /* rotation increment of the sample */
+  delta[0] = gyro[0] * dt;
+  delta[1] = gyro[1] * dt;
+  delta[2] = gyro[2] * dt;
+
+  /* a = alpha(m-1) + delta(m-1)/6, the last increment is zero for the first sample */
+  a[0] = preint->alpha[0] + preint->last_delta[0] * 0.16666667f;
+  a[1] = preint->alpha[1] + preint->last_delta[1] * 0.16666667f;
+  a[2] = preint->alpha[2] + preint->last_delta[2] * 0.16666667f;
+
+  /* beta += 0.5f * a x delta */
+  preint->beta[0] += 0.5f * (a[1]*delta[2] - a[2]*delta[1]);
+  preint->beta[1] += 0.5f * (a[2]*delta[0] - a[0]*delta[2]);
+  preint->beta[2] += 0.5f * (a[0]*delta[1] - a[1]*delta[0]);
+
+  /* alpha += delta */
+  preint->alpha[0] += delta[0];
+  preint->alpha[1] += delta[1];
+  preint->alpha[2] += delta[2];
+
+  memcpy(preint->last_delta, delta, sizeof(delta));
+
+  preint->dt += dt;
+  preint->count++;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the constant rate of the accumulated rotation and restart the accumulation.
+  * @param  preint: point to a GyroPreInt_Typedef structure that
+  *         contains the informations of gyro pre-integration
+  * @param  rate: point to the rate, rotation vector / accumulated time
+  * @retval accumulated time
+  */
+float GyroPreInt_Fetch(GyroPreInt_Typedef *preint,float rate[3])
+{
+  float dt = preint->dt;
+  float invdt = 0.f;
+
+  if(preint->count == 0 || dt <= 0.f)
+  {
+    memset(rate, 0, 3 * sizeof(float));
+    return 0.f;
+  }
+
+  /* rate = (alpha + beta) / T */
+  invdt = 1.f / dt;
+  rate[0] = (preint->alpha[0] + preint->beta[0]) * invdt;
+  rate[1] = (preint->alpha[1] + preint->beta[1]) * invdt;
+  rate[2] = (preint->alpha[2] + preint->beta[2]) * invdt;
+
+  /* the last increment is kept for the coning correction of the next interval */
+  memset(preint->alpha, 0, sizeof(preint->alpha));
+  memset(preint->beta, 0, sizeof(preint->beta));
+  preint->dt = 0.f;
+  preint->count = 0;
+
+  return dt;
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,605 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : kalman_batch.c
+  * Description        : Implementation of batched kalman filter.
+  ******************************************************************************
+  * @attention      : N identical filters are updated in one call:
+  *       1.xhatminus(k) = A·xhat(k-1) + B·u(k)
+  *       2.Pminus(k) = A·P(k-1)·AT + Q
+  *       3.K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R)
+  *       4.xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k))
+  *       5.P(k) = (I - K(k)·H)·Pminus(k)
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman_batch.h"
+
+/* Private function ----------------------------------------------------------*/
+/**
+  * @brief take the specified number of floats from the storage block.
+  * @param pool: point to the next free float of the storage block
+  * @param size: number of floats
+  * @retval point to the taken floats
+  */
+static float *Kalman_Batch_Take(float **pool,uint32_t size)
+{
+  float *data = *pool;
+
+  *pool += size;
+
+  return data;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Initialize a batch of kalman filters in a user provided storage block.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @param xhatSize: size of state vector
+  * @param uSize: size of control vector
+  * @param zSize: size of measurement vector
+  * @param count: number of filters, up to KALMAN_BATCH_MAX_COUNT
+  * @param pool: point to the storage block, see KALMAN_BATCH_STORAGE_DEF
+  * @param poolSize: number of floats in the storage block
+  * @retval none
+  */
+void Kalman_Batch_Init(Kalman_Batch_Info_TypeDef *kb,uint8_t xhatSize,uint8_t uSize,uint8_t zSize,uint8_t count,float *pool,uint32_t poolSize)
+{
+  uint32_t N = count;
+
+  kb->ErrorStatus = ARM_MATH_SUCCESS;
+  kb->SingularMask = 0;
+
+  /* check the size of the filters and the storage block */
+  if(xhatSize == 0 || zSize == 0 || count == 0 || count > KALMAN_BATCH_MAX_COUNT
+  || pool == NULL || poolSize < KALMAN_BATCH_STORAGE_FLOATS((uint32_t)xhatSize,(uint32_t)uSize,(uint32_t)zSize,N))
+  {
+    kb->ErrorStatus = ARM_MATH_LENGTH_ERROR;
+    kb->MemorySize = 0;
+    return;
+  }
+
+  /* store the size of the filters */
+  kb->xhatSize = xhatSize;
+  kb->uSize = uSize;
+  kb->zSize = zSize;
+  kb->count = count;
+
+  /* store the bytes of the storage block */
+  kb->MemorySize = sizeof(float) * KALMAN_BATCH_STORAGE_FLOATS((uint32_t)xhatSize,(uint32_t)uSize,(uint32_t)zSize,N);
+
+  /* clear the storage block */
+  memset(pool, 0, kb->MemorySize);
+
+  /* the model matrices are set by Kalman_Batch_SetModel() */
+  kb->A = NULL;
+  kb->B = NULL;
+  kb->H = NULL;
+  kb->Q = NULL;
+  kb->R = NULL;
+
+  /* take the structure-of-arrays data */
+  kb->xhat        = Kalman_Batch_Take(&pool, xhatSize * N);
+  kb->xhatminus   = Kalman_Batch_Take(&pool, xhatSize * N);
+  kb->u           = Kalman_Batch_Take(&pool, uSize * N);
+  kb->z           = Kalman_Batch_Take(&pool, zSize * N);
+  kb->P           = Kalman_Batch_Take(&pool, xhatSize * xhatSize * N);
+  kb->Pminus      = Kalman_Batch_Take(&pool, xhatSize * xhatSize * N);
+  kb->K           = Kalman_Batch_Take(&pool, xhatSize * zSize * N);
+  kb->L           = Kalman_Batch_Take(&pool, zSize * zSize * N);
+  kb->calc_matrix = Kalman_Batch_Take(&pool, xhatSize * KALMAN_MAX_SIZE(xhatSize,zSize) * N);
+  kb->calc_vector = Kalman_Batch_Take(&pool, zSize * N);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Set the shared model matrices of the batch.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @param A: state transition, xhatSize x xhatSize
+  * @param B: input-state, xhatSize x uSize, NULL if uSize is 0
+  * @param H: state-measurement, zSize x xhatSize
+  * @param Q: process noise covariance, xhatSize x xhatSize
+  * @param R: measurement noise covariance, zSize x zSize
+  * @note  the matrices are row major and not copied, they must stay valid
+  * @retval none
+  */
+void Kalman_Batch_SetModel(Kalman_Batch_Info_TypeDef *kb,const float *A,const float *B,const float *H,const float *Q,const float *R)
+{
+  kb->A = A;
+  kb->B = B;
+  kb->H = H;
+  kb->Q = Q;
+  kb->R = R;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Reset the state and covariance of a filter.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @param n: index of the filter
+  * @param xhat: initial state, NULL for zero
+  * @param P: initial covariance, row major xhatSize x xhatSize
+  * @retval none
+  */
+void Kalman_Batch_Reset(Kalman_Batch_Info_TypeDef *kb,uint8_t n,const float *xhat,const float *P)
+{
+  if(n >= kb->count)
+  {
+    return;
+  }
+
+  for(uint8_t i = 0; i < kb->xhatSize; i++)
+  {
+    KALMAN_BATCH_AT(kb, xhat, i, n) = (xhat != NULL) ? xhat[i] : 0.f;
+  }
+
+  for(uint16_t i = 0; i < kb->xhatSize * kb->xhatSize; i++)
+  {
+    KALMAN_BATCH_AT(kb, P, i, n) = P[i];
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Store the measurement and control input of a filter.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @param n: index of the filter
+  * @param z: measurement, zSize
+  * @param u: control input, uSize, NULL if uSize is 0
+  * @retval none
+  */
+void Kalman_Batch_Input(Kalman_Batch_Info_TypeDef *kb,uint8_t n,const float *z,const float *u)
+{
+  if(n >= kb->count)
+  {
+    return;
+  }
+
+  for(uint8_t i = 0; i < kb->zSize; i++)
+  {
+    KALMAN_BATCH_AT(kb, z, i, n) = z[i];
+  }
+
+  for(uint8_t i = 0; u != NULL && i < kb->uSize; i++)
+  {
+    KALMAN_BATCH_AT(kb, u, i, n) = u[i];
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Read the posteriori state estimate of a filter.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @param n: index of the filter
+  * @param xhat: point to the output, xhatSize
+  * @retval none
+  */
+void Kalman_Batch_Output(Kalman_Batch_Info_TypeDef *kb,uint8_t n,float *xhat)
+{
+  if(n >= kb->count)
+  {
+    return;
+  }
+
+  for(uint8_t i = 0; i < kb->xhatSize; i++)
+  {
+    xhat[i] = KALMAN_BATCH_AT(kb, xhat, i, n);
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the priori state estimate of all filters
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  xhatminus(k) = A·xhat(k-1) + B·u(k)
+  * @retval none
+  */
+static void Kalman_Batch_xhatminus_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  const uint32_t N = kb->count;
+  float *xm = NULL;
+  float a = 0.f;
+
+  for(uint8_t i = 0; i < kb->xhatSize; i++)
+  {
+    xm = &kb->xhatminus[i*N];
+    for(uint32_t n = 0; n < N; n++)
+    {
+      xm[n] = 0.f;
+    }
+
+    /* xhatminus(i) = Σ A(i,l)·xhat(l), zeros of A are skipped */
+    for(uint8_t l = 0; l < kb->xhatSize; l++)
+    {
+      a = kb->A[i*kb->xhatSize + l];
+      if(a == 0.f) continue;
+      for(uint32_t n = 0; n < N; n++)
+      {
+        xm[n] += a * kb->xhat[l*N + n];
+      }
+    }
+
+    /* xhatminus(i) += Σ B(i,l)·u(l) */
+    for(uint8_t l = 0; kb->B != NULL && l < kb->uSize; l++)
+    {
+      a = kb->B[i*kb->uSize + l];
+      if(a == 0.f) continue;
+      for(uint32_t n = 0; n < N; n++)
+      {
+        xm[n] += a * kb->u[l*N + n];
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the priori covariance of all filters
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  Pminus(k) = A·P(k-1)·AT + Q, upper triangle calculated and mirrored
+  * @retval none
+  */
+static void Kalman_Batch_Pminus_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  const uint32_t N = kb->count;
+  const uint8_t x = kb->xhatSize;
+  float *AP = kb->calc_matrix, *dst = NULL;
+  float a = 0.f;
+
+  /* calc_matrix = A·P(k-1) */
+  for(uint8_t i = 0; i < x; i++)
+  {
+    for(uint8_t j = 0; j < x; j++)
+    {
+      dst = &AP[(i*x + j)*N];
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = 0.f;
+      }
+      for(uint8_t l = 0; l < x; l++)
+      {
+        a = kb->A[i*x + l];
+        if(a == 0.f) continue;
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] += a * kb->P[(l*x + j)*N + n];
+        }
+      }
+    }
+  }
+
+  /* Pminus(k) = A·P(k-1)·AT + Q */
+  for(uint8_t i = 0; i < x; i++)
+  {
+    for(uint8_t j = i; j < x; j++)
+    {
+      dst = &kb->Pminus[(i*x + j)*N];
+      /* keep Q symmetric */
+      a = 0.5f * (kb->Q[i*x + j] + kb->Q[j*x + i]);
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = a;
+      }
+      for(uint8_t l = 0; l < x; l++)
+      {
+        a = kb->A[j*x + l];
+        if(a == 0.f) continue;
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] += AP[(i*x + l)*N + n] * a;
+        }
+      }
+      if(j != i)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          kb->Pminus[(j*x + i)*N + n] = dst[n];
+        }
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the kalman gain of all filters
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R), solved by the cholesky factor of S,
+  *        the gain of a filter whose S is not positive definite is cleared.
+  * @retval none
+  */
+static void Kalman_Batch_K_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  const uint32_t N = kb->count;
+  const uint8_t x = kb->xhatSize, z = kb->zSize;
+  float *HP = kb->calc_matrix, *L = kb->L, *dst = NULL;
+  float a = 0.f;
+
+  /* calc_matrix = H·Pminus(k) */
+  for(uint8_t i = 0; i < z; i++)
+  {
+    for(uint8_t j = 0; j < x; j++)
+    {
+      dst = &HP[(i*x + j)*N];
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = 0.f;
+      }
+      for(uint8_t l = 0; l < x; l++)
+      {
+        a = kb->H[i*x + l];
+        if(a == 0.f) continue;
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] += a * kb->Pminus[(l*x + j)*N + n];
+        }
+      }
+    }
+  }
+
+  /* L = lower triangle of S = H·Pminus(k)·HT + R */
+  for(uint8_t i = 0; i < z; i++)
+  {
+    for(uint8_t j = 0; j <= i; j++)
+    {
+      dst = &L[(i*z + j)*N];
+      a = 0.5f * (kb->R[i*z + j] + kb->R[j*z + i]);
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = a;
+      }
+      for(uint8_t l = 0; l < x; l++)
+      {
+        a = kb->H[j*x + l];
+        if(a == 0.f) continue;
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] += HP[(i*x + l)*N + n] * a;
+        }
+      }
+    }
+  }
+
+  /* L = cholesky(S), column by column */
+  kb->SingularMask = 0;
+  for(uint8_t j = 0; j < z; j++)
+  {
+    /* diagonal */
+    dst = &L[(j*z + j)*N];
+    for(uint8_t k = 0; k < j; k++)
+    {
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] -= L[(j*z + k)*N + n] * L[(j*z + k)*N + n];
+      }
+    }
+    for(uint32_t n = 0; n < N; n++)
+    {
+      if(!(dst[n] > 0.f))
+      {
+        /* keep the factor finite, the gain is cleared later */
+        kb->SingularMask |= 1UL << n;
+        dst[n] = 1.f;
+      }
+      dst[n] = sqrtf(dst[n]);
+    }
+
+    /* below the diagonal */
+    for(uint8_t i = j + 1; i < z; i++)
+    {
+      dst = &L[(i*z + j)*N];
+      for(uint8_t k = 0; k < j; k++)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] -= L[(i*z + k)*N + n] * L[(j*z + k)*N + n];
+        }
+      }
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] /= L[(j*z + j)*N + n];
+      }
+    }
+  }
+
+  /* K(k) = (inverse(L·LT)·H·Pminus(k))T, one row of K at a time */
+  for(uint8_t c = 0; c < x; c++)
+  {
+    /* L·y = (H·Pminus(k)) column c */
+    for(uint8_t i = 0; i < z; i++)
+    {
+      dst = &kb->K[(c*z + i)*N];
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = HP[(i*x + c)*N + n];
+      }
+      for(uint8_t k = 0; k < i; k++)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] -= L[(i*z + k)*N + n] * kb->K[(c*z + k)*N + n];
+        }
+      }
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] /= L[(i*z + i)*N + n];
+      }
+    }
+
+    /* LT·K = y */
+    for(int16_t i = z - 1; i >= 0; i--)
+    {
+      dst = &kb->K[(c*z + i)*N];
+      for(uint8_t k = i + 1; k < z; k++)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] -= L[(k*z + i)*N + n] * kb->K[(c*z + k)*N + n];
+        }
+      }
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] /= L[(i*z + i)*N + n];
+      }
+    }
+  }
+
+  /* no gain from an invalid innovation covariance */
+  kb->ErrorStatus = ARM_MATH_SUCCESS;
+  if(kb->SingularMask != 0)
+  {
+    kb->ErrorStatus = ARM_MATH_SINGULAR;
+    for(uint32_t n = 0; n < N; n++)
+    {
+      if((kb->SingularMask & (1UL << n)) == 0) continue;
+      for(uint16_t i = 0; i < x * z; i++)
+      {
+        kb->K[i*N + n] = 0.f;
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the posteriori state estimate of all filters
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k))
+  * @retval none
+  */
+static void Kalman_Batch_xhat_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  const uint32_t N = kb->count;
+  const uint8_t x = kb->xhatSize, z = kb->zSize;
+  float *r = kb->calc_vector, *dst = NULL;
+  float a = 0.f;
+
+  /* calc_vector = z(k) - H·xhatminus(k) */
+  for(uint8_t i = 0; i < z; i++)
+  {
+    dst = &r[i*N];
+    for(uint32_t n = 0; n < N; n++)
+    {
+      dst[n] = kb->z[i*N + n];
+    }
+    for(uint8_t l = 0; l < x; l++)
+    {
+      a = kb->H[i*x + l];
+      if(a == 0.f) continue;
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] -= a * kb->xhatminus[l*N + n];
+      }
+    }
+  }
+
+  /* xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k)) */
+  for(uint8_t i = 0; i < x; i++)
+  {
+    dst = &kb->xhat[i*N];
+    for(uint32_t n = 0; n < N; n++)
+    {
+      dst[n] = kb->xhatminus[i*N + n];
+    }
+    for(uint8_t k = 0; k < z; k++)
+    {
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] += kb->K[(i*z + k)*N + n] * r[k*N + n];
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the posteriori covariance of all filters
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  P(k) = Pminus(k) - K(k)·H·Pminus(k), upper triangle calculated and mirrored,
+  *        calc_matrix still holds H·Pminus(k)
+  * @retval none
+  */
+static void Kalman_Batch_P_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  const uint32_t N = kb->count;
+  const uint8_t x = kb->xhatSize, z = kb->zSize;
+  float *HP = kb->calc_matrix, *dst = NULL;
+
+  for(uint8_t i = 0; i < x; i++)
+  {
+    for(uint8_t j = i; j < x; j++)
+    {
+      dst = &kb->P[(i*x + j)*N];
+      for(uint32_t n = 0; n < N; n++)
+      {
+        dst[n] = kb->Pminus[(i*x + j)*N + n];
+      }
+      for(uint8_t k = 0; k < z; k++)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          dst[n] -= kb->K[(i*z + k)*N + n] * HP[(k*x + j)*N + n];
+        }
+      }
+      if(j != i)
+      {
+        for(uint32_t n = 0; n < N; n++)
+        {
+          kb->P[(j*x + i)*N + n] = dst[n];
+        }
+      }
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update all filters of the batch.
+  * @param kb: point to a Kalman_Batch_Info_TypeDef structure that
+  *         contains the informations of the batch.
+  * @note  the measurement and control input are stored by Kalman_Batch_Input(),
+  *        filters whose S is not positive definite are reported by SingularMask
+  *        and keep the priori estimate.
+  * @retval none
+  */
+void Kalman_Batch_Update(Kalman_Batch_Info_TypeDef *kb)
+{
+  /* check the model matrices */
+  if(kb->MemorySize == 0 || kb->A == NULL || kb->H == NULL || kb->Q == NULL || kb->R == NULL)
+  {
+    kb->ErrorStatus = ARM_MATH_ARGUMENT_ERROR;
+    return;
+  }
+
+  /* Update the priori state estimate */
+  Kalman_Batch_xhatminus_Update(kb);
+
+  /* Update the priori covariance */
+  Kalman_Batch_Pminus_Update(kb);
+
+  /* Update the kalman gain */
+  Kalman_Batch_K_Update(kb);
+
+  /* Update the posteriori state estimate */
+  Kalman_Batch_xhat_Update(kb);
+
+  /* Update the posteriori covariance */
+  Kalman_Batch_P_Update(kb);
+}
+//------------------------------------------------------------------------------
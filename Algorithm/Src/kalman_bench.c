@@ -0,0 +1,730 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : kalman_bench.c
+  * Description        : Benchmark of the kalman filter variants.
+  ******************************************************************************
+  * @attention      : the attitude filter of the bench is the 6x6 QuatEKF model,
+  *                   quaternion and two gyro biases, with a 3x6 gravity measurement
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman_bench.h"
+#include "stm32f4xx.h"
+#include "string.h"
+#include "math.h"
+
+/* Private define ------------------------------------------------------------*/
+/**
+ * @brief size of the attitude filter of the bench.
+ */
+#define KALMAN_BENCH_XHAT_SIZE 6
+#define KALMAN_BENCH_U_SIZE    0
+#define KALMAN_BENCH_Z_SIZE    3
+
+/**
+ * @brief size of the motor filters of the batch scaling, angle and velocity.
+ */
+#define KALMAN_BENCH_MOTOR_XHAT_SIZE 2
+#define KALMAN_BENCH_MOTOR_U_SIZE    0
+#define KALMAN_BENCH_MOTOR_Z_SIZE    1
+
+/* Private variables ---------------------------------------------------------*/
+/**
+ * @brief state transition of the attitude filter at 1 kHz,
+ *        skew block of the gyro and bias block of the quaternion
+ */
+static const float Kalman_Bench_A[KALMAN_BENCH_XHAT_SIZE*KALMAN_BENCH_XHAT_SIZE] =
+{
+   1.f,     -0.0005f, -0.0005f, -0.0005f,  0.0005f,  0.0005f,
+   0.0005f,  1.f,      0.0005f, -0.0005f, -0.0005f,  0.0005f,
+   0.0005f, -0.0005f,  1.f,      0.0005f,  0.0005f, -0.0005f,
+   0.0005f,  0.0005f, -0.0005f,  1.f,     -0.0005f, -0.0005f,
+   0.f,      0.f,      0.f,      0.f,      1.f,      0.f,
+   0.f,      0.f,      0.f,      0.f,      0.f,      1.f,
+};
+
+/**
+ * @brief gravity measurement of the attitude filter, the biases are not observed
+ */
+static const float Kalman_Bench_H[KALMAN_BENCH_Z_SIZE*KALMAN_BENCH_XHAT_SIZE] =
+{
+  -0.2f,  0.3f, -0.9f,  0.1f, 0.f, 0.f,
+   0.1f,  0.9f,  0.3f,  0.2f, 0.f, 0.f,
+   0.9f, -0.1f, -0.2f,  0.3f, 0.f, 0.f,
+};
+
+/**
+ * @brief nonzero columns of every row of A and H.
+ */
+static const uint32_t Kalman_Bench_A_Sparsity[KALMAN_BENCH_XHAT_SIZE] = {0x3FU, 0x3FU, 0x3FU, 0x3FU, 1U << 4, 1U << 5};
+static const uint32_t Kalman_Bench_H_Sparsity[KALMAN_BENCH_Z_SIZE] = {0x0FU, 0x0FU, 0x0FU};
+
+/**
+ * @brief storage of the attitude filter.
+ */
+KALMAN_STORAGE_DEF(Kalman_Bench_Storage,KALMAN_BENCH_XHAT_SIZE,KALMAN_BENCH_U_SIZE,KALMAN_BENCH_Z_SIZE);
+
+/**
+ * @brief storage of the dense reference of the attitude filter.
+ */
+KALMAN_STORAGE_DEF(Kalman_Bench_Ref_Storage,KALMAN_BENCH_XHAT_SIZE,KALMAN_BENCH_U_SIZE,KALMAN_BENCH_Z_SIZE);
+
+/**
+ * @brief storage of the UD factors of the attitude filter.
+ */
+static float Kalman_Bench_UD_Storage[KALMAN_UD_STORAGE_FLOATS(KALMAN_BENCH_XHAT_SIZE)];
+
+/**
+ * @brief attitude filter of the bench, its dense reference and their measurement.
+ */
+static Kalman_Info_TypeDef Kalman_Bench_KF;
+static Kalman_Info_TypeDef Kalman_Bench_Ref_KF;
+static float Kalman_Bench_Measure[KALMAN_BENCH_Z_SIZE];
+
+/**
+ * @brief model of the motor filters at 1 kHz, the angle is measured.
+ */
+static const float Kalman_Bench_Motor_A[KALMAN_BENCH_MOTOR_XHAT_SIZE*KALMAN_BENCH_MOTOR_XHAT_SIZE] = {1.f, 0.001f, 0.f, 1.f};
+static const float Kalman_Bench_Motor_H[KALMAN_BENCH_MOTOR_Z_SIZE*KALMAN_BENCH_MOTOR_XHAT_SIZE] = {1.f, 0.f};
+static const float Kalman_Bench_Motor_Q[KALMAN_BENCH_MOTOR_XHAT_SIZE*KALMAN_BENCH_MOTOR_XHAT_SIZE] = {1e-6f, 0.f, 0.f, 1e-2f};
+static const float Kalman_Bench_Motor_R[KALMAN_BENCH_MOTOR_Z_SIZE*KALMAN_BENCH_MOTOR_Z_SIZE] = {1e-4f};
+static const float Kalman_Bench_Motor_P[KALMAN_BENCH_MOTOR_XHAT_SIZE*KALMAN_BENCH_MOTOR_XHAT_SIZE] = {1.f, 0.f, 0.f, 1.f};
+
+/**
+ * @brief storage of the motor filters, one filter each or one batch.
+ */
+static KALMAN_STORAGE_SECTION float Kalman_Bench_Motor_Storage[KALMAN_BENCH_BATCH_MAX]
+  [KALMAN_STORAGE_FLOATS(KALMAN_BENCH_MOTOR_XHAT_SIZE,KALMAN_BENCH_MOTOR_U_SIZE,KALMAN_BENCH_MOTOR_Z_SIZE)] __ALIGNED(8);
+KALMAN_BATCH_STORAGE_DEF(Kalman_Bench_Batch_Storage,KALMAN_BENCH_MOTOR_XHAT_SIZE,KALMAN_BENCH_MOTOR_U_SIZE,
+                         KALMAN_BENCH_MOTOR_Z_SIZE,KALMAN_BENCH_BATCH_MAX);
+
+/**
+ * @brief motor filters of the batch scaling and their measurements.
+ */
+static Kalman_Info_TypeDef Kalman_Bench_Motor_KF[KALMAN_BENCH_BATCH_MAX];
+static Kalman_Batch_Info_TypeDef Kalman_Bench_Motor_KB;
+static float Kalman_Bench_Motor_Measure[KALMAN_BENCH_BATCH_MAX];
+
+/* Private function ----------------------------------------------------------*/
+/**
+  * @brief Initializes the attitude filter of the bench.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param pool: point to the storage block of the filter
+  * @retval none
+  */
+static void Kalman_Bench_Filter_Init(Kalman_Info_TypeDef *kf,float *pool)
+{
+  /* clear the variant flags of the previous case */
+  memset(kf,0,sizeof(Kalman_Info_TypeDef));
+
+  Kalman_Filter_Static_Init(kf,KALMAN_BENCH_XHAT_SIZE,KALMAN_BENCH_U_SIZE,KALMAN_BENCH_Z_SIZE,
+                            pool,KALMAN_STORAGE_FLOATS(KALMAN_BENCH_XHAT_SIZE,KALMAN_BENCH_U_SIZE,KALMAN_BENCH_Z_SIZE));
+
+  /* model matrices */
+  memcpy(kf->pdata.A,Kalman_Bench_A,sizeof(Kalman_Bench_A));
+  memcpy(kf->pdata.H,Kalman_Bench_H,sizeof(Kalman_Bench_H));
+  for(uint8_t i = 0; i < KALMAN_BENCH_XHAT_SIZE; i++)
+  {
+    kf->pdata.Q[i*KALMAN_BENCH_XHAT_SIZE + i] = (i < 4) ? 1e-5f : 1e-8f;
+    kf->pdata.P[i*KALMAN_BENCH_XHAT_SIZE + i] = (i < 4) ? 1.f : 0.01f;
+  }
+  for(uint8_t i = 0; i < KALMAN_BENCH_Z_SIZE; i++)
+  {
+    kf->pdata.R[i*KALMAN_BENCH_Z_SIZE + i] = 0.01f;
+  }
+
+  /* unit quaternion, every measurement is fresh */
+  kf->pdata.xhat[0] = 1.f;
+  kf->MeasureInput = Kalman_Bench_Measure;
+  kf->MeasureValid = KALMAN_MEASURE_ALL;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the attitude filter and measure the mean cycles.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param update: Kalman_Filter_Update() or a generated drop-in
+  * @param iterations: updates to measure
+  * @param stepCycles: receives the mean cycles of step 1-5, NULL to ignore
+  * @retval mean cycles per update
+  */
+static uint32_t Kalman_Bench_Filter_Run(Kalman_Info_TypeDef *kf,float *(*update)(Kalman_Info_TypeDef *kf),uint32_t iterations,uint32_t *stepCycles)
+{
+  uint32_t start = 0, cycles = 0;
+#if KALMAN_PROFILE_ENABLE
+  uint32_t steps[5] = {0,};
+#endif
+
+  for(uint32_t n = 0; n < iterations; n++)
+  {
+    /* gravity with a small swing */
+    Kalman_Bench_Measure[0] = 0.01f * (float)(n & 0x0FU);
+    Kalman_Bench_Measure[1] = -0.01f * (float)(n & 0x07U);
+    Kalman_Bench_Measure[2] = 1.f;
+
+    start = KALMAN_BENCH_CYCLES();
+    update(kf);
+    cycles += KALMAN_BENCH_CYCLES() - start;
+
+#if KALMAN_PROFILE_ENABLE
+    for(uint8_t i = 0; i < 5; i++)
+    {
+      steps[i] += kf->Telemetry.StepCycles[i];
+    }
+#endif
+  }
+
+  if(stepCycles != NULL)
+  {
+#if KALMAN_PROFILE_ENABLE
+    for(uint8_t i = 0; i < 5; i++)
+    {
+      stepCycles[i] = steps[i] / iterations;
+    }
+#else
+    memset(stepCycles,0,5*sizeof(uint32_t));
+#endif
+  }
+
+  return cycles / iterations;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Compare the attitude filter with its dense reference.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param ref: point to the dense reference updated with the same measurements
+  * @retval max |xhat - ref xhat| and |P - ref P|, INFINITY if not finite
+  */
+static float Kalman_Bench_Filter_Error(const Kalman_Info_TypeDef *kf,const Kalman_Info_TypeDef *ref)
+{
+  float error = 0.f, delta = 0.f;
+
+  for(uint8_t i = 0; i < KALMAN_BENCH_XHAT_SIZE; i++)
+  {
+    delta = fabsf(kf->pdata.xhat[i] - ref->pdata.xhat[i]);
+    error = (delta > error) ? delta : error;
+
+    for(uint8_t j = 0; j < KALMAN_BENCH_XHAT_SIZE; j++)
+    {
+      delta = fabsf(kf->pdata.P[i*KALMAN_BENCH_XHAT_SIZE + j] - ref->pdata.P[i*KALMAN_BENCH_XHAT_SIZE + j]);
+      /* NaN is never equivalent */
+      error = (delta > error || delta != delta) ? delta : error;
+    }
+  }
+
+  return isfinite(error) ? error : INFINITY;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the attitude filter with time-varying and constant model matrices.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Constant(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t *varyingSteps = NULL, *constantSteps = NULL;
+
+#if KALMAN_PROFILE_ENABLE
+  varyingSteps = bench->VaryingStepCycles;
+  constantSteps = bench->ConstantStepCycles;
+#endif
+
+  /* AT is transposed every update */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  bench->VaryingCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,varyingSteps);
+
+  /* AT is transposed once */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Filter_SetConstant(&Kalman_Bench_KF,KALMAN_MATRIX_ALL);
+  bench->ConstantCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,constantSteps);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the attitude filter with the sparsity patterns of A and H,
+  *        against the dense time-varying filter of Kalman_Bench_Constant().
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Sparsity(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t *sparseSteps = NULL;
+
+#if KALMAN_PROFILE_ENABLE
+  sparseSteps = bench->SparseStepCycles;
+#endif
+
+  /* the structural zeros of A and H are skipped */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Filter_SetSparsity(&Kalman_Bench_KF,KALMAN_MATRIX_A,Kalman_Bench_A_Sparsity);
+  Kalman_Filter_SetSparsity(&Kalman_Bench_KF,KALMAN_MATRIX_H,Kalman_Bench_H_Sparsity);
+  bench->SparseCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,sparseSteps);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the dense reference of the attitude filter.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @note  the variants are compared with the reference after the same updates
+  * @retval none
+  */
+static void Kalman_Bench_Reference(Kalman_Bench_TypeDef *bench)
+{
+  /* dense K(k) by the cholesky factor of S, P(k) = (I - K(k)·H)·Pminus(k) */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_Ref_KF,Kalman_Bench_Ref_Storage);
+  Kalman_Bench_Filter_Run(&Kalman_Bench_Ref_KF,Kalman_Filter_Update,bench->Iterations,NULL);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the symmetric covariance propagation and the Joseph form update,
+  *        compared with the dense reference after the same updates.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Symmetric(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t *symmetricSteps = NULL, *josephSteps = NULL;
+
+#if KALMAN_PROFILE_ENABLE
+  symmetricSteps = bench->SymmetricStepCycles;
+  josephSteps = bench->JosephStepCycles;
+#endif
+
+  /* upper triangle of Pminus(k) and P(k) */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Bench_KF.SymmetricP = 1;
+  bench->SymmetricCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,symmetricSteps);
+  bench->SymmetricError = Kalman_Bench_Filter_Error(&Kalman_Bench_KF,&Kalman_Bench_Ref_KF);
+
+  /* P(k) = (I - K(k)·H)·Pminus(k)·(I - K(k)·H)T + K(k)·R·K(k)T */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Bench_KF.JosephForm = 1;
+  bench->JosephCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,josephSteps);
+  bench->JosephError = Kalman_Bench_Filter_Error(&Kalman_Bench_KF,&Kalman_Bench_Ref_KF);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the sequential scalar update, compared with the batch update
+  *        of the dense reference after the same updates.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Sequential(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t *sequentialSteps = NULL;
+
+#if KALMAN_PROFILE_ENABLE
+  sequentialSteps = bench->SequentialStepCycles;
+#endif
+
+  /* R is diagonal, step 3-5 are three scalar updates */
+  Kalman_Bench_Filter_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Bench_KF.SequentialUpdate = 1;
+  bench->SequentialCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_Filter_Update,bench->Iterations,sequentialSteps);
+  bench->SequentialError = Kalman_Bench_Filter_Error(&Kalman_Bench_KF,&Kalman_Bench_Ref_KF);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the kalman gain and the posteriori state estimate, the 
+  *        measurement hook of the QuatEKF layout.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @note  K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R), xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k))
+  * @retval none
+  */
+static void Kalman_Bench_Measure_Update(Kalman_Info_TypeDef *kf)
+{
+  float residual[KALMAN_BENCH_Z_SIZE];
+
+  /* calc_matrix[0] = H·Pminus(k) */
+  kf->mat.calc_matrix[0].numRows = kf->mat.H.numRows;
+  kf->mat.calc_matrix[0].numCols = kf->mat.Pminus.numCols;
+  kf->ErrorStatus = Kalman_Sparse_Multiply(&kf->mat.H, kf->Sparsity.H, &kf->mat.Pminus, &kf->mat.calc_matrix[0]);
+
+  /* calc_matrix[1] = cholesky(H·Pminus(k)·HT + R) */
+  for(uint8_t i = 0; i < KALMAN_BENCH_Z_SIZE; i++)
+  {
+    for(uint8_t j = 0; j < KALMAN_BENCH_Z_SIZE; j++)
+    {
+      kf->pdata.calc_matrix[1][i*KALMAN_BENCH_Z_SIZE + j] = kf->pdata.R[i*KALMAN_BENCH_Z_SIZE + j];
+      for(uint8_t k = 0; k < KALMAN_BENCH_XHAT_SIZE; k++)
+      {
+        kf->pdata.calc_matrix[1][i*KALMAN_BENCH_Z_SIZE + j] += kf->pdata.calc_matrix[0][i*KALMAN_BENCH_XHAT_SIZE + k] * kf->pdata.H[j*KALMAN_BENCH_XHAT_SIZE + k];
+      }
+    }
+  }
+  kf->ErrorStatus = Kalman_Cholesky_Decompose(kf->pdata.calc_matrix[1], KALMAN_BENCH_Z_SIZE);
+  if(kf->ErrorStatus != ARM_MATH_SUCCESS)
+  {
+    return;
+  }
+
+  /* K(k) = (inverse(H·Pminus(k)·HT + R)·H·Pminus(k))T */
+  Kalman_Cholesky_Solve(kf->pdata.calc_matrix[1], KALMAN_BENCH_Z_SIZE, kf->pdata.calc_matrix[0], KALMAN_BENCH_XHAT_SIZE);
+  for(uint8_t i = 0; i < KALMAN_BENCH_XHAT_SIZE; i++)
+  {
+    for(uint8_t j = 0; j < KALMAN_BENCH_Z_SIZE; j++)
+    {
+      kf->pdata.K[i*KALMAN_BENCH_Z_SIZE + j] = kf->pdata.calc_matrix[0][j*KALMAN_BENCH_XHAT_SIZE + i];
+    }
+  }
+
+  /* residual = z(k) - H·xhatminus(k) */
+  for(uint8_t i = 0; i < KALMAN_BENCH_Z_SIZE; i++)
+  {
+    residual[i] = kf->pdata.z[i];
+    for(uint8_t k = 0; k < KALMAN_BENCH_XHAT_SIZE; k++)
+    {
+      residual[i] -= kf->pdata.H[i*KALMAN_BENCH_XHAT_SIZE + k] * kf->pdata.xhatminus[k];
+    }
+  }
+
+  /* xhat(k) = xhatminus(k) + K(k)·residual */
+  for(uint8_t i = 0; i < KALMAN_BENCH_XHAT_SIZE; i++)
+  {
+    kf->pdata.xhat[i] = kf->pdata.xhatminus[i];
+    for(uint8_t j = 0; j < KALMAN_BENCH_Z_SIZE; j++)
+    {
+      kf->pdata.xhat[i] += kf->pdata.K[i*KALMAN_BENCH_Z_SIZE + j] * residual[j];
+    }
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Initializes the attitude filter in the layout of the QuatEKF: symmetric 
+  *        covariance, sparse A and H, step 3 and 4 replaced by a measurement hook.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param pool: point to the storage block of the filter
+  * @retval none
+  */
+static void Kalman_Bench_Hooked_Init(Kalman_Info_TypeDef *kf,float *pool)
+{
+  Kalman_Bench_Filter_Init(kf,pool);
+
+  kf->SymmetricP = 1;
+  kf->SkipStep3 = 1;
+  kf->SkipStep4 = 1;
+  kf->User_Function3 = Kalman_Bench_Measure_Update;
+  Kalman_Filter_SetSparsity(kf,KALMAN_MATRIX_A,Kalman_Bench_A_Sparsity);
+  Kalman_Filter_SetSparsity(kf,KALMAN_MATRIX_H,Kalman_Bench_H_Sparsity);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the generated update of the QuatEKF, compared with the core 
+  *        update of the same filter after the same updates.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Generated(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t *hookedSteps = NULL, *generatedSteps = NULL;
+
+#if KALMAN_PROFILE_ENABLE
+  hookedSteps = bench->HookedStepCycles;
+  generatedSteps = bench->GeneratedStepCycles;
+#endif
+
+  /* Kalman_Filter_Update() */
+  Kalman_Bench_Hooked_Init(&Kalman_Bench_Ref_KF,Kalman_Bench_Ref_Storage);
+  bench->HookedCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_Ref_KF,Kalman_Filter_Update,bench->Iterations,hookedSteps);
+
+  /* Kalman_QuatEKF_Update(), unrolled by script/kalman_codegen.py */
+  Kalman_Bench_Hooked_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  bench->GeneratedCycles = Kalman_Bench_Filter_Run(&Kalman_Bench_KF,Kalman_QuatEKF_Update,bench->Iterations,generatedSteps);
+  bench->GeneratedError = Kalman_Bench_Filter_Error(&Kalman_Bench_KF,&Kalman_Bench_Ref_KF);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Initializes the attitude filter for the ill-conditioned replay, a precise
+  *        measurement of the quaternion and unobservable gyro biases.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param pool: point to the storage block of the filter
+  * @retval none
+  */
+static void Kalman_Bench_Replay_Init(Kalman_Info_TypeDef *kf,float *pool)
+{
+  Kalman_Bench_Filter_Init(kf,pool);
+
+  /* R << P, the conventional update cancels most of Pminus */
+  for(uint8_t i = 0; i < KALMAN_BENCH_XHAT_SIZE; i++)
+  {
+    kf->pdata.Q[i*KALMAN_BENCH_XHAT_SIZE + i] = (i < 4) ? 1e-9f : 1e-12f;
+    kf->pdata.P[i*KALMAN_BENCH_XHAT_SIZE + i] = (i < 4) ? 1.f : 100.f;
+  }
+  for(uint8_t i = 0; i < KALMAN_BENCH_Z_SIZE; i++)
+  {
+    kf->pdata.R[i*KALMAN_BENCH_Z_SIZE + i] = 1e-8f;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Replay the attitude filter and count the updates leaving P indefinite.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param iterations: updates to replay
+  * @param cycles: receives the mean cycles per update
+  * @note  P is not clamped, the cholesky factor of P is checked after every update
+  * @retval updates after which P is not positive definite
+  */
+static uint32_t Kalman_Bench_Replay(Kalman_Info_TypeDef *kf,uint32_t iterations,uint32_t *cycles)
+{
+  float P[KALMAN_BENCH_XHAT_SIZE*KALMAN_BENCH_XHAT_SIZE];
+  uint32_t start = 0, sum = 0, count = 0;
+
+  for(uint32_t n = 0; n < iterations; n++)
+  {
+    Kalman_Bench_Measure[0] = 0.01f * (float)(n & 0x0FU);
+    Kalman_Bench_Measure[1] = -0.01f * (float)(n & 0x07U);
+    Kalman_Bench_Measure[2] = 1.f;
+
+    start = KALMAN_BENCH_CYCLES();
+    Kalman_Filter_Update(kf);
+    sum += KALMAN_BENCH_CYCLES() - start;
+
+    memcpy(P,kf->pdata.P,sizeof(P));
+    if(Kalman_Cholesky_Decompose(P,KALMAN_BENCH_XHAT_SIZE) != ARM_MATH_SUCCESS)
+    {
+      count++;
+    }
+  }
+
+  *cycles = sum / iterations;
+
+  return count;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Replay the dense and the UD factored covariance with an ill-conditioned
+  *        model, neither is clamped.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Factor(Kalman_Bench_TypeDef *bench)
+{
+  uint32_t cycles = 0;
+
+  /* P(k) = (I - K(k)·H)·Pminus(k) */
+  Kalman_Bench_Replay_Init(&Kalman_Bench_Ref_KF,Kalman_Bench_Ref_Storage);
+  bench->DenseIndefiniteCnt = Kalman_Bench_Replay(&Kalman_Bench_Ref_KF,KALMAN_BENCH_REPLAY_ITERATIONS,&cycles);
+
+  /* P(k) = U·D·UT by the Thornton and Bierman updates */
+  Kalman_Bench_Replay_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  if(Kalman_Filter_UD_Init(&Kalman_Bench_KF,Kalman_Bench_UD_Storage,KALMAN_UD_STORAGE_FLOATS(KALMAN_BENCH_XHAT_SIZE)) != ARM_MATH_SUCCESS)
+  {
+    bench->FactorIndefiniteCnt = KALMAN_BENCH_REPLAY_ITERATIONS;
+    return;
+  }
+  bench->FactorIndefiniteCnt = Kalman_Bench_Replay(&Kalman_Bench_KF,KALMAN_BENCH_REPLAY_ITERATIONS,&bench->FactorCycles);
+
+  /* the factors of Q and the structure of R are calculated once */
+  Kalman_Bench_Replay_Init(&Kalman_Bench_KF,Kalman_Bench_Storage);
+  Kalman_Filter_SetConstant(&Kalman_Bench_KF,KALMAN_MATRIX_ALL);
+  if(Kalman_Filter_UD_Init(&Kalman_Bench_KF,Kalman_Bench_UD_Storage,KALMAN_UD_STORAGE_FLOATS(KALMAN_BENCH_XHAT_SIZE)) == ARM_MATH_SUCCESS)
+  {
+    Kalman_Bench_Replay(&Kalman_Bench_KF,KALMAN_BENCH_REPLAY_ITERATIONS,&bench->FactorConstantCycles);
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure N motor filters updated one by one and as a batch, N = 1 ~ KALMAN_BENCH_BATCH_MAX.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Batch(Kalman_Bench_TypeDef *bench)
+{
+  Kalman_Info_TypeDef *kf = NULL;
+  uint32_t start = 0, cycles = 0;
+
+  /* single filters with their own storage */
+  for(uint8_t n = 0; n < KALMAN_BENCH_BATCH_MAX; n++)
+  {
+    kf = &Kalman_Bench_Motor_KF[n];
+    Kalman_Filter_Static_Init(kf,KALMAN_BENCH_MOTOR_XHAT_SIZE,KALMAN_BENCH_MOTOR_U_SIZE,KALMAN_BENCH_MOTOR_Z_SIZE,
+                              Kalman_Bench_Motor_Storage[n],sizeof(Kalman_Bench_Motor_Storage[n])/sizeof(float));
+    memcpy(kf->pdata.A,Kalman_Bench_Motor_A,sizeof(Kalman_Bench_Motor_A));
+    memcpy(kf->pdata.H,Kalman_Bench_Motor_H,sizeof(Kalman_Bench_Motor_H));
+    memcpy(kf->pdata.Q,Kalman_Bench_Motor_Q,sizeof(Kalman_Bench_Motor_Q));
+    memcpy(kf->pdata.R,Kalman_Bench_Motor_R,sizeof(Kalman_Bench_Motor_R));
+    memcpy(kf->pdata.P,Kalman_Bench_Motor_P,sizeof(Kalman_Bench_Motor_P));
+    Kalman_Filter_SetConstant(kf,KALMAN_MATRIX_ALL);
+    kf->MeasureInput = &Kalman_Bench_Motor_Measure[n];
+    kf->MeasureValid = KALMAN_MEASURE_ALL;
+  }
+
+  for(uint8_t N = 1; N <= KALMAN_BENCH_BATCH_MAX; N++)
+  {
+    /* N single filters, one update each */
+    cycles = 0;
+    for(uint32_t i = 0; i < bench->Iterations; i++)
+    {
+      for(uint8_t n = 0; n < N; n++)
+      {
+        Kalman_Bench_Motor_Measure[n] = 0.001f * (float)(i & 0xFFU) + 0.1f * n;
+      }
+
+      start = KALMAN_BENCH_CYCLES();
+      for(uint8_t n = 0; n < N; n++)
+      {
+        Kalman_Filter_Update(&Kalman_Bench_Motor_KF[n]);
+      }
+      cycles += KALMAN_BENCH_CYCLES() - start;
+    }
+    bench->SingleCycles[N-1] = cycles / bench->Iterations;
+
+    /* a batch of N filters, one update */
+    Kalman_Batch_Init(&Kalman_Bench_Motor_KB,KALMAN_BENCH_MOTOR_XHAT_SIZE,KALMAN_BENCH_MOTOR_U_SIZE,KALMAN_BENCH_MOTOR_Z_SIZE,N,
+                      Kalman_Bench_Batch_Storage,sizeof(Kalman_Bench_Batch_Storage)/sizeof(float));
+    Kalman_Batch_SetModel(&Kalman_Bench_Motor_KB,Kalman_Bench_Motor_A,NULL,Kalman_Bench_Motor_H,Kalman_Bench_Motor_Q,Kalman_Bench_Motor_R);
+    for(uint8_t n = 0; n < N; n++)
+    {
+      Kalman_Batch_Reset(&Kalman_Bench_Motor_KB,n,NULL,Kalman_Bench_Motor_P);
+    }
+
+    cycles = 0;
+    for(uint32_t i = 0; i < bench->Iterations; i++)
+    {
+      for(uint8_t n = 0; n < N; n++)
+      {
+        Kalman_Bench_Motor_Measure[n] = 0.001f * (float)(i & 0xFFU) + 0.1f * n;
+        Kalman_Batch_Input(&Kalman_Bench_Motor_KB,n,&Kalman_Bench_Motor_Measure[n],NULL);
+      }
+
+      start = KALMAN_BENCH_CYCLES();
+      Kalman_Batch_Update(&Kalman_Bench_Motor_KB);
+      cycles += KALMAN_BENCH_CYCLES() - start;
+    }
+    bench->BatchCycles[N-1] = cycles / bench->Iterations;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  max error of the fast math functions against the double libm.
+  * @param  bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @retval none
+  */
+static void Kalman_Bench_Fast_Math(Kalman_Bench_TypeDef *bench)
+{
+  const uint32_t points = KALMAN_BENCH_FAST_MATH_POINTS;
+  const float radius[3] = {1e-3f, 1.f, 1e3f};
+  double error[5] = {0};
+  double t = 0, angle = 0;
+  float x = 0, y = 0;
+
+  for(uint32_t i = 0; i <= points; i++)
+  {
+    t = (double)i / (double)points;
+
+    /* squared norms of the quaternion, the gyro and the accel */
+    x = (float)pow(10.0,-8.0 + 12.0 * t);
+    error[0] = fmax(error[0],fabs((double)Fast_InverseSqrt(x) * sqrt((double)x) - 1.0));
+
+    /* components of the normalized gravity and the asin of the pitch */
+    x = (float)(-1.0 + 2.0 * t);
+    error[1] = fmax(error[1],fabs((double)Fast_Acos(x) - acos((double)x)));
+    error[2] = fmax(error[2],fabs((double)Fast_Asin(x) - asin((double)x)));
+
+    /* tan of -89.99 ~ 89.99 deg */
+    x = (float)tan(1.5706217 * (2.0 * t - 1.0));
+    error[3] = fmax(error[3],fabs((double)Fast_Atan(x) - atan((double)x)));
+
+    /* every quadrant of the euler angles */
+    angle = 3.14159265358979 * (2.0 * t - 1.0);
+    for(uint8_t r = 0; r < 3; r++)
+    {
+      y = radius[r] * (float)sin(angle);
+      x = radius[r] * (float)cos(angle);
+      error[4] = fmax(error[4],fabs((double)Fast_Atan2(y,x) - atan2((double)y,(double)x)));
+    }
+  }
+
+  bench->InverseSqrtError = (float)error[0];
+  bench->AcosError = (float)error[1];
+  bench->AsinError = (float)error[2];
+  bench->AtanError = (float)error[3];
+  bench->Atan2Error = (float)error[4];
+
+  /* the bounds in fast_math.h */
+  bench->FastMathValid = (error[0] < FAST_MATH_INVERSE_SQRT_ERROR) && (error[1] < FAST_MATH_ACOS_ERROR)
+                      && (error[2] < FAST_MATH_ASIN_ERROR) && (error[3] < FAST_MATH_ATAN_ERROR)
+                      && (error[4] < FAST_MATH_ATAN2_ERROR)
+                      && (Fast_InverseSqrt(0.f) == 0.f) && (Fast_InverseSqrt(-1.f) == 0.f)
+                      && (Fast_InverseSqrt(INFINITY) == 0.f) && (Fast_InverseSqrt(NAN) == 0.f);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Measure the cycles per update of the kalman filter variants.
+  * @param bench: point to a Kalman_Bench_TypeDef structure that
+  *         receives the results.
+  * @param iterations: updates per measurement
+  * @retval none
+  */
+void Kalman_Bench_Run(Kalman_Bench_TypeDef *bench,uint32_t iterations)
+{
+  /* enable the DWT cycle counter */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  bench->Iterations = (iterations > 0U) ? iterations : 1U;
+
+  /* constant model matrices */
+  Kalman_Bench_Constant(bench);
+
+  /* sparsity patterns of the model matrices */
+  Kalman_Bench_Sparsity(bench);
+
+  /* dense reference of the variants */
+  Kalman_Bench_Reference(bench);
+
+  /* symmetric covariance and Joseph form against the dense filter */
+  Kalman_Bench_Symmetric(bench);
+
+  /* sequential scalar update against the batch update */
+  Kalman_Bench_Sequential(bench);
+
+  /* dense and UD factored covariance in an ill-conditioned replay */
+  Kalman_Bench_Factor(bench);
+
+  /* generated update of the QuatEKF against the core update */
+  Kalman_Bench_Generated(bench);
+
+  /* batch of N motor filters against N single filters */
+  Kalman_Bench_Batch(bench);
+
+  /* fast math against the double libm */
+  Kalman_Bench_Fast_Math(bench);
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,279 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : kalman_quatekf.c
+  * Description        : specialized update of the quaternion extended kalman filter.
+  ******************************************************************************
+  * @attention      : generated by script/kalman_codegen.py from quatekf.json,
+  *                   do not edit, regenerate after the description is changed.
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kalman_quatekf.h"
+
+#if KALMAN_PROFILE_ENABLE
+#include "stm32f4xx.h"
+#endif
+
+/* Private function ----------------------------------------------------------*/
+/**
+  * @brief store a failure status in the telemetry of the kalman filter.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param status: failure status
+  * @retval none
+  */
+static void QuatEKF_Status_Record(Kalman_Info_TypeDef *kf,arm_status status)
+{
+  kf->ErrorStatus = status;
+  kf->Telemetry.ErrorFlags |= kf->Telemetry.ActiveFlag;
+  kf->Telemetry.LastError = status;
+  if(status == ARM_MATH_SINGULAR)
+  {
+    kf->Telemetry.SingularCnt++;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Call a user function and record its status in the telemetry.
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @param User_Function: user function, skipped if NULL
+  * @param index: index of the user function, 0-6
+  * @retval none
+  */
+static void QuatEKF_User_Function(Kalman_Info_TypeDef *kf,void (*User_Function)(Kalman_Info_TypeDef *kf),uint8_t index)
+{
+  uint32_t start = 0;
+
+  if(User_Function == NULL)
+  {
+    return;
+  }
+
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_HOOK(index);
+  start = KALMAN_PROFILE_START();
+
+  kf->ErrorStatus = ARM_MATH_SUCCESS;
+  User_Function(kf);
+  if(kf->ErrorStatus != ARM_MATH_SUCCESS)
+  {
+    QuatEKF_Status_Record(kf, kf->ErrorStatus);
+  }
+
+  KALMAN_PROFILE_STORE(kf->Telemetry.HookCycles[index], start);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the QuatEKF kalman filter, drop-in for Kalman_Filter_Update().
+  * @param kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter, xhatSize 6, uSize 0, zSize 3.
+  * @retval point of kalman filter output
+  */
+float *Kalman_QuatEKF_Update(Kalman_Info_TypeDef *kf)
+{
+  float *xhat = kf->pdata.xhat, *xhatminus = kf->pdata.xhatminus, *zk = kf->pdata.z;
+  float *P = kf->pdata.P, *Pminus = kf->pdata.Pminus, *K = kf->pdata.K;
+  const float *A = kf->pdata.A, *H = kf->pdata.H, *Q = kf->pdata.Q;
+  uint32_t valid = kf->MeasureValid & 0x7U;
+  bool measured = (valid != 0U);
+  uint32_t start = KALMAN_PROFILE_START(), step = 0;
+
+  /* modes and partial measurements of the core */
+  if(kf->xhatSize != 6 || kf->uSize != 0 || kf->zSize != 3
+  || kf->SymmetricP == 0 || kf->JosephForm == 1
+  || kf->SteadyState == 1 || kf->UDFactor == 1 || kf->SequentialUpdate == 1
+  || (valid != 0U && valid != 0x7U))
+  {
+    return Kalman_Filter_Update(kf);
+  }
+
+  kf->Telemetry.UpdateCnt++;
+
+  /* Update the input */
+  memcpy(zk, kf->MeasureInput, sizeof(float) * 3);
+  memset(kf->MeasureInput, 0, sizeof(float) * 3);
+
+  /* Update the priori state estimate: xhatminus(k) = A·xhat(k-1) + B·u(k) */
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(1);
+  step = KALMAN_PROFILE_START();
+  if(kf->SkipStep1 == 0)
+  {
+    xhatminus[0] = A[0]*xhat[0] + A[1]*xhat[1] + A[2]*xhat[2] + A[3]*xhat[3] + A[4]*xhat[4] + A[5]*xhat[5];
+    xhatminus[1] = A[6]*xhat[0] + A[7]*xhat[1] + A[8]*xhat[2] + A[9]*xhat[3] + A[10]*xhat[4] + A[11]*xhat[5];
+    xhatminus[2] = A[12]*xhat[0] + A[13]*xhat[1] + A[14]*xhat[2] + A[15]*xhat[3] + A[16]*xhat[4] + A[17]*xhat[5];
+    xhatminus[3] = A[18]*xhat[0] + A[19]*xhat[1] + A[20]*xhat[2] + A[21]*xhat[3] + A[22]*xhat[4] + A[23]*xhat[5];
+    xhatminus[4] = A[28]*xhat[4];
+    xhatminus[5] = A[35]*xhat[5];
+  }
+  KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[0], step);
+  /* User Function 1 */
+  QuatEKF_User_Function(kf, kf->User_Function1, 1);
+
+  /* Update the priori covariance: Pminus(k) = A·P(k-1)·AT + Q, upper triangle mirrored */
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(2);
+  step = KALMAN_PROFILE_START();
+  if(kf->SkipStep2 == 0)
+  {
+    /* AP = A·P(k-1) */
+    const float AP_0_0 = A[0]*P[0] + A[1]*P[6] + A[2]*P[12] + A[3]*P[18] + A[4]*P[24] + A[5]*P[30];
+    const float AP_0_1 = A[0]*P[1] + A[1]*P[7] + A[2]*P[13] + A[3]*P[19] + A[4]*P[25] + A[5]*P[31];
+    const float AP_0_2 = A[0]*P[2] + A[1]*P[8] + A[2]*P[14] + A[3]*P[20] + A[4]*P[26] + A[5]*P[32];
+    const float AP_0_3 = A[0]*P[3] + A[1]*P[9] + A[2]*P[15] + A[3]*P[21] + A[4]*P[27] + A[5]*P[33];
+    const float AP_0_4 = A[0]*P[4] + A[1]*P[10] + A[2]*P[16] + A[3]*P[22] + A[4]*P[28] + A[5]*P[34];
+    const float AP_0_5 = A[0]*P[5] + A[1]*P[11] + A[2]*P[17] + A[3]*P[23] + A[4]*P[29] + A[5]*P[35];
+    const float AP_1_0 = A[6]*P[0] + A[7]*P[6] + A[8]*P[12] + A[9]*P[18] + A[10]*P[24] + A[11]*P[30];
+    const float AP_1_1 = A[6]*P[1] + A[7]*P[7] + A[8]*P[13] + A[9]*P[19] + A[10]*P[25] + A[11]*P[31];
+    const float AP_1_2 = A[6]*P[2] + A[7]*P[8] + A[8]*P[14] + A[9]*P[20] + A[10]*P[26] + A[11]*P[32];
+    const float AP_1_3 = A[6]*P[3] + A[7]*P[9] + A[8]*P[15] + A[9]*P[21] + A[10]*P[27] + A[11]*P[33];
+    const float AP_1_4 = A[6]*P[4] + A[7]*P[10] + A[8]*P[16] + A[9]*P[22] + A[10]*P[28] + A[11]*P[34];
+    const float AP_1_5 = A[6]*P[5] + A[7]*P[11] + A[8]*P[17] + A[9]*P[23] + A[10]*P[29] + A[11]*P[35];
+    const float AP_2_0 = A[12]*P[0] + A[13]*P[6] + A[14]*P[12] + A[15]*P[18] + A[16]*P[24] + A[17]*P[30];
+    const float AP_2_1 = A[12]*P[1] + A[13]*P[7] + A[14]*P[13] + A[15]*P[19] + A[16]*P[25] + A[17]*P[31];
+    const float AP_2_2 = A[12]*P[2] + A[13]*P[8] + A[14]*P[14] + A[15]*P[20] + A[16]*P[26] + A[17]*P[32];
+    const float AP_2_3 = A[12]*P[3] + A[13]*P[9] + A[14]*P[15] + A[15]*P[21] + A[16]*P[27] + A[17]*P[33];
+    const float AP_2_4 = A[12]*P[4] + A[13]*P[10] + A[14]*P[16] + A[15]*P[22] + A[16]*P[28] + A[17]*P[34];
+    const float AP_2_5 = A[12]*P[5] + A[13]*P[11] + A[14]*P[17] + A[15]*P[23] + A[16]*P[29] + A[17]*P[35];
+    const float AP_3_0 = A[18]*P[0] + A[19]*P[6] + A[20]*P[12] + A[21]*P[18] + A[22]*P[24] + A[23]*P[30];
+    const float AP_3_1 = A[18]*P[1] + A[19]*P[7] + A[20]*P[13] + A[21]*P[19] + A[22]*P[25] + A[23]*P[31];
+    const float AP_3_2 = A[18]*P[2] + A[19]*P[8] + A[20]*P[14] + A[21]*P[20] + A[22]*P[26] + A[23]*P[32];
+    const float AP_3_3 = A[18]*P[3] + A[19]*P[9] + A[20]*P[15] + A[21]*P[21] + A[22]*P[27] + A[23]*P[33];
+    const float AP_3_4 = A[18]*P[4] + A[19]*P[10] + A[20]*P[16] + A[21]*P[22] + A[22]*P[28] + A[23]*P[34];
+    const float AP_3_5 = A[18]*P[5] + A[19]*P[11] + A[20]*P[17] + A[21]*P[23] + A[22]*P[29] + A[23]*P[35];
+    const float AP_4_4 = A[28]*P[28];
+    const float AP_4_5 = A[28]*P[29];
+    const float AP_5_5 = A[35]*P[35];
+    /* Pminus = AP·AT + Q */
+    Pminus[0] = (AP_0_0*A[0] + AP_0_1*A[1] + AP_0_2*A[2] + AP_0_3*A[3] + AP_0_4*A[4] + AP_0_5*A[5]) + 0.5f*(Q[0] + Q[0]);
+    Pminus[1] = Pminus[6] = (AP_0_0*A[6] + AP_0_1*A[7] + AP_0_2*A[8] + AP_0_3*A[9] + AP_0_4*A[10] + AP_0_5*A[11]) + 0.5f*(Q[1] + Q[6]);
+    Pminus[2] = Pminus[12] = (AP_0_0*A[12] + AP_0_1*A[13] + AP_0_2*A[14] + AP_0_3*A[15] + AP_0_4*A[16] + AP_0_5*A[17]) + 0.5f*(Q[2] + Q[12]);
+    Pminus[3] = Pminus[18] = (AP_0_0*A[18] + AP_0_1*A[19] + AP_0_2*A[20] + AP_0_3*A[21] + AP_0_4*A[22] + AP_0_5*A[23]) + 0.5f*(Q[3] + Q[18]);
+    Pminus[4] = Pminus[24] = (AP_0_4*A[28]) + 0.5f*(Q[4] + Q[24]);
+    Pminus[5] = Pminus[30] = (AP_0_5*A[35]) + 0.5f*(Q[5] + Q[30]);
+    Pminus[7] = (AP_1_0*A[6] + AP_1_1*A[7] + AP_1_2*A[8] + AP_1_3*A[9] + AP_1_4*A[10] + AP_1_5*A[11]) + 0.5f*(Q[7] + Q[7]);
+    Pminus[8] = Pminus[13] = (AP_1_0*A[12] + AP_1_1*A[13] + AP_1_2*A[14] + AP_1_3*A[15] + AP_1_4*A[16] + AP_1_5*A[17]) + 0.5f*(Q[8] + Q[13]);
+    Pminus[9] = Pminus[19] = (AP_1_0*A[18] + AP_1_1*A[19] + AP_1_2*A[20] + AP_1_3*A[21] + AP_1_4*A[22] + AP_1_5*A[23]) + 0.5f*(Q[9] + Q[19]);
+    Pminus[10] = Pminus[25] = (AP_1_4*A[28]) + 0.5f*(Q[10] + Q[25]);
+    Pminus[11] = Pminus[31] = (AP_1_5*A[35]) + 0.5f*(Q[11] + Q[31]);
+    Pminus[14] = (AP_2_0*A[12] + AP_2_1*A[13] + AP_2_2*A[14] + AP_2_3*A[15] + AP_2_4*A[16] + AP_2_5*A[17]) + 0.5f*(Q[14] + Q[14]);
+    Pminus[15] = Pminus[20] = (AP_2_0*A[18] + AP_2_1*A[19] + AP_2_2*A[20] + AP_2_3*A[21] + AP_2_4*A[22] + AP_2_5*A[23]) + 0.5f*(Q[15] + Q[20]);
+    Pminus[16] = Pminus[26] = (AP_2_4*A[28]) + 0.5f*(Q[16] + Q[26]);
+    Pminus[17] = Pminus[32] = (AP_2_5*A[35]) + 0.5f*(Q[17] + Q[32]);
+    Pminus[21] = (AP_3_0*A[18] + AP_3_1*A[19] + AP_3_2*A[20] + AP_3_3*A[21] + AP_3_4*A[22] + AP_3_5*A[23]) + 0.5f*(Q[21] + Q[21]);
+    Pminus[22] = Pminus[27] = (AP_3_4*A[28]) + 0.5f*(Q[22] + Q[27]);
+    Pminus[23] = Pminus[33] = (AP_3_5*A[35]) + 0.5f*(Q[23] + Q[33]);
+    Pminus[28] = (AP_4_4*A[28]) + 0.5f*(Q[28] + Q[28]);
+    Pminus[29] = Pminus[34] = (AP_4_5*A[35]) + 0.5f*(Q[29] + Q[34]);
+    Pminus[35] = (AP_5_5*A[35]) + 0.5f*(Q[35] + Q[35]);
+  }
+  KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[1], step);
+  /* User Function 2 */
+  QuatEKF_User_Function(kf, kf->User_Function2, 2);
+
+  /* Update the kalman gain: K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R) */
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(3);
+  step = KALMAN_PROFILE_START();
+  if(measured == false)
+  {
+    /* xhat(k) = xhatminus(k), P(k) = Pminus(k) */
+    memcpy(xhat, xhatminus, sizeof(float) * 6);
+    memcpy(P, Pminus, sizeof(float) * 36);
+  }
+  KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[2], step);
+  /* User Function 3 */
+  QuatEKF_User_Function(kf, kf->User_Function3, 3);
+
+  /* Update the posteriori state estimate: xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k)) */
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(4);
+  step = KALMAN_PROFILE_START();
+  /* skipped */
+  KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[3], step);
+
+  /* Update the posteriori covariance: P(k) = Pminus(k) - K(k)·H·Pminus(k), upper triangle mirrored */
+  kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(5);
+  step = KALMAN_PROFILE_START();
+  if(measured == true && kf->SkipStep5 == 0)
+  {
+    /* HP = H·Pminus(k) */
+    const float HP_0_0 = H[0]*Pminus[0] + H[1]*Pminus[6] + H[2]*Pminus[12] + H[3]*Pminus[18];
+    const float HP_0_1 = H[0]*Pminus[1] + H[1]*Pminus[7] + H[2]*Pminus[13] + H[3]*Pminus[19];
+    const float HP_0_2 = H[0]*Pminus[2] + H[1]*Pminus[8] + H[2]*Pminus[14] + H[3]*Pminus[20];
+    const float HP_0_3 = H[0]*Pminus[3] + H[1]*Pminus[9] + H[2]*Pminus[15] + H[3]*Pminus[21];
+    const float HP_0_4 = H[0]*Pminus[4] + H[1]*Pminus[10] + H[2]*Pminus[16] + H[3]*Pminus[22];
+    const float HP_0_5 = H[0]*Pminus[5] + H[1]*Pminus[11] + H[2]*Pminus[17] + H[3]*Pminus[23];
+    const float HP_1_0 = H[6]*Pminus[0] + H[7]*Pminus[6] + H[8]*Pminus[12] + H[9]*Pminus[18];
+    const float HP_1_1 = H[6]*Pminus[1] + H[7]*Pminus[7] + H[8]*Pminus[13] + H[9]*Pminus[19];
+    const float HP_1_2 = H[6]*Pminus[2] + H[7]*Pminus[8] + H[8]*Pminus[14] + H[9]*Pminus[20];
+    const float HP_1_3 = H[6]*Pminus[3] + H[7]*Pminus[9] + H[8]*Pminus[15] + H[9]*Pminus[21];
+    const float HP_1_4 = H[6]*Pminus[4] + H[7]*Pminus[10] + H[8]*Pminus[16] + H[9]*Pminus[22];
+    const float HP_1_5 = H[6]*Pminus[5] + H[7]*Pminus[11] + H[8]*Pminus[17] + H[9]*Pminus[23];
+    const float HP_2_0 = H[12]*Pminus[0] + H[13]*Pminus[6] + H[14]*Pminus[12] + H[15]*Pminus[18];
+    const float HP_2_1 = H[12]*Pminus[1] + H[13]*Pminus[7] + H[14]*Pminus[13] + H[15]*Pminus[19];
+    const float HP_2_2 = H[12]*Pminus[2] + H[13]*Pminus[8] + H[14]*Pminus[14] + H[15]*Pminus[20];
+    const float HP_2_3 = H[12]*Pminus[3] + H[13]*Pminus[9] + H[14]*Pminus[15] + H[15]*Pminus[21];
+    const float HP_2_4 = H[12]*Pminus[4] + H[13]*Pminus[10] + H[14]*Pminus[16] + H[15]*Pminus[22];
+    const float HP_2_5 = H[12]*Pminus[5] + H[13]*Pminus[11] + H[14]*Pminus[17] + H[15]*Pminus[23];
+    /* P = Pminus - K·HP */
+    P[0] = 0.5f*(Pminus[0] + Pminus[0]) - (K[0]*HP_0_0 + K[1]*HP_1_0 + K[2]*HP_2_0);
+    P[1] = P[6] = 0.5f*(Pminus[1] + Pminus[6]) - (K[0]*HP_0_1 + K[1]*HP_1_1 + K[2]*HP_2_1);
+    P[2] = P[12] = 0.5f*(Pminus[2] + Pminus[12]) - (K[0]*HP_0_2 + K[1]*HP_1_2 + K[2]*HP_2_2);
+    P[3] = P[18] = 0.5f*(Pminus[3] + Pminus[18]) - (K[0]*HP_0_3 + K[1]*HP_1_3 + K[2]*HP_2_3);
+    P[4] = P[24] = 0.5f*(Pminus[4] + Pminus[24]) - (K[0]*HP_0_4 + K[1]*HP_1_4 + K[2]*HP_2_4);
+    P[5] = P[30] = 0.5f*(Pminus[5] + Pminus[30]) - (K[0]*HP_0_5 + K[1]*HP_1_5 + K[2]*HP_2_5);
+    P[7] = 0.5f*(Pminus[7] + Pminus[7]) - (K[3]*HP_0_1 + K[4]*HP_1_1 + K[5]*HP_2_1);
+    P[8] = P[13] = 0.5f*(Pminus[8] + Pminus[13]) - (K[3]*HP_0_2 + K[4]*HP_1_2 + K[5]*HP_2_2);
+    P[9] = P[19] = 0.5f*(Pminus[9] + Pminus[19]) - (K[3]*HP_0_3 + K[4]*HP_1_3 + K[5]*HP_2_3);
+    P[10] = P[25] = 0.5f*(Pminus[10] + Pminus[25]) - (K[3]*HP_0_4 + K[4]*HP_1_4 + K[5]*HP_2_4);
+    P[11] = P[31] = 0.5f*(Pminus[11] + Pminus[31]) - (K[3]*HP_0_5 + K[4]*HP_1_5 + K[5]*HP_2_5);
+    P[14] = 0.5f*(Pminus[14] + Pminus[14]) - (K[6]*HP_0_2 + K[7]*HP_1_2 + K[8]*HP_2_2);
+    P[15] = P[20] = 0.5f*(Pminus[15] + Pminus[20]) - (K[6]*HP_0_3 + K[7]*HP_1_3 + K[8]*HP_2_3);
+    P[16] = P[26] = 0.5f*(Pminus[16] + Pminus[26]) - (K[6]*HP_0_4 + K[7]*HP_1_4 + K[8]*HP_2_4);
+    P[17] = P[32] = 0.5f*(Pminus[17] + Pminus[32]) - (K[6]*HP_0_5 + K[7]*HP_1_5 + K[8]*HP_2_5);
+    P[21] = 0.5f*(Pminus[21] + Pminus[21]) - (K[9]*HP_0_3 + K[10]*HP_1_3 + K[11]*HP_2_3);
+    P[22] = P[27] = 0.5f*(Pminus[22] + Pminus[27]) - (K[9]*HP_0_4 + K[10]*HP_1_4 + K[11]*HP_2_4);
+    P[23] = P[33] = 0.5f*(Pminus[23] + Pminus[33]) - (K[9]*HP_0_5 + K[10]*HP_1_5 + K[11]*HP_2_5);
+    P[28] = 0.5f*(Pminus[28] + Pminus[28]) - (K[12]*HP_0_4 + K[13]*HP_1_4 + K[14]*HP_2_4);
+    P[29] = P[34] = 0.5f*(Pminus[29] + Pminus[34]) - (K[12]*HP_0_5 + K[13]*HP_1_5 + K[14]*HP_2_5);
+    P[35] = 0.5f*(Pminus[35] + Pminus[35]) - (K[15]*HP_0_5 + K[16]*HP_1_5 + K[17]*HP_2_5);
+  }
+  KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[4], step);
+
+  kf->Telemetry.ActiveFlag = 0;
+
+  /* count the updates with a non-finite state */
+  for(uint8_t i = 0; i < 6; i++)
+  {
+    if(!isfinite(xhat[i]))
+    {
+      kf->Telemetry.ErrorFlags |= KALMAN_ERROR_NANINF;
+      kf->Telemetry.LastError = ARM_MATH_NANINF;
+      kf->Telemetry.NaNCnt++;
+      break;
+    }
+  }
+
+  /* store the output */
+  memcpy(kf->Output, xhat, sizeof(float) * 6);
+
+#if KALMAN_PROFILE_ENABLE
+  KALMAN_PROFILE_STORE(kf->Telemetry.TotalCycles, start);
+  if(kf->Telemetry.TotalCycles > kf->Telemetry.MaxCycles)
+  {
+    kf->Telemetry.MaxCycles = kf->Telemetry.TotalCycles;
+  }
+#else
+  (void)start;
+  (void)step;
+#endif
+
+  return kf->Output;
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,134 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : mahony.c
+  * Description        : Implementation of Mahony complementary filter.
+  ******************************************************************************
+  * @attention      : 1. the error between the measured and estimated gravity
+  *                      feeds back to the gyro by a PI controller,
+  *                      the integral is stored as the gyro bias.
+  *                   2. see R. Mahony, T. Hamel and J. Pflimlin,
+  *                      "Nonlinear Complementary Filters on the Special Orthogonal Group"
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "mahony.h"
+#include "fast_math.h"
+#include "string.h"
+
+/**
+  * @brief Initializes the Mahony filter.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @param Kp: proportional gain of the accel error
+  * @param Ki: integral gain of the accel error, the integral is the gyro bias
+  * @retval none
+  */
+void Mahony_Init(Quat_Info_Typedef *quat,float Kp,float Ki)
+{
+  /* store the gains */
+  quat->Kp = Kp;
+  quat->Ki = Ki;
+
+  /* Initializes the quaternion and gyro bias */
+  quat->quat[0] = 1.f;
+  quat->quat[1] = 0.f;
+  quat->quat[2] = 0.f;
+  quat->quat[3] = 0.f;
+  memset(quat->biasgyro, 0, sizeof(quat->biasgyro));
+
+  /* Initializes the derived outputs */
+  Quat_Output_Init(quat);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the Mahony filter
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to integrate the gyro only
+  * @param dt: system latency
+  * @retval none
+  */
+void Mahony_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
+{
+  float *q = quat->quat;
+  float v[3] = {0.f}, e[3] = {0.f}, w[3] = {0.f}, qdot[4] = {0.f};
+  float accelNorm = 0.f, invNorm = 0.f;
+
+  /* biasgyro to gyro */
+  quat->gyro[0] = gyro[0] - quat->biasgyro[0];
+  quat->gyro[1] = gyro[1] - quat->biasgyro[1];
+  quat->gyro[2] = gyro[2] - quat->biasgyro[2];
+
+  w[0] = quat->gyro[0];
+  w[1] = quat->gyro[1];
+  w[2] = quat->gyro[2];
+
+  if(accel != NULL)
+  {
+    memcpy(quat->accel,accel,sizeof(quat->accel));
+
+    /* accelInvNorm = 1.f/(accel[0]^2.f + accel[1]^2.f + accel[2]^2.f) */
+    quat->accelInvNorm = Fast_InverseSqrt(quat->accel[0]*quat->accel[0]+quat->accel[1]*quat->accel[1]+quat->accel[2]*quat->accel[2]);
+    accelNorm = 1.f/quat->accelInvNorm;
+
+    /* skip the correction under the linear acceleration */
+    if(accelNorm > (GravityAccel - MAHONY_ACCEL_TOLERANCE) && accelNorm < (GravityAccel + MAHONY_ACCEL_TOLERANCE))
+    {
+      /* estimated gravity in the body frame */
+      v[0] = 2.f*(q[1]*q[3] - q[0]*q[2]);
+      v[1] = 2.f*(q[0]*q[1] + q[2]*q[3]);
+      v[2] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+
+      /* e = accel × v */
+      e[0] = (quat->accel[1]*v[2] - quat->accel[2]*v[1]) * quat->accelInvNorm;
+      e[1] = (quat->accel[2]*v[0] - quat->accel[0]*v[2]) * quat->accelInvNorm;
+      e[2] = (quat->accel[0]*v[1] - quat->accel[1]*v[0]) * quat->accelInvNorm;
+
+      /* integral feedback, biasgyro = -Ki·∫e */
+      quat->biasgyro[0] -= quat->Ki * e[0] * dt;
+      quat->biasgyro[1] -= quat->Ki * e[1] * dt;
+      quat->biasgyro[2] -= quat->Ki * e[2] * dt;
+
+      /* proportional feedback */
+      w[0] += quat->Kp * e[0];
+      w[1] += quat->Kp * e[1];
+      w[2] += quat->Kp * e[2];
+    }
+  }
+
+  /* convert gyros to radians per second scaled by 0.5 */
+  quat->halfgyrodt[0] = 0.5f * w[0] * dt;
+  quat->halfgyrodt[1] = 0.5f * w[1] * dt;
+  quat->halfgyrodt[2] = 0.5f * w[2] * dt;
+
+  /* q = q + q ⊗ [0, 0.5f*w*dt] */
+  qdot[0] = -q[1]*quat->halfgyrodt[0] - q[2]*quat->halfgyrodt[1] - q[3]*quat->halfgyrodt[2];
+  qdot[1] =  q[0]*quat->halfgyrodt[0] + q[2]*quat->halfgyrodt[2] - q[3]*quat->halfgyrodt[1];
+  qdot[2] =  q[0]*quat->halfgyrodt[1] - q[1]*quat->halfgyrodt[2] + q[3]*quat->halfgyrodt[0];
+  qdot[3] =  q[0]*quat->halfgyrodt[2] + q[1]*quat->halfgyrodt[1] - q[2]*quat->halfgyrodt[0];
+
+  q[0] += qdot[0];
+  q[1] += qdot[1];
+  q[2] += qdot[2];
+  q[3] += qdot[3];
+
+  /* normalise the quaternion */
+  invNorm = Fast_InverseSqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  q[0] *= invNorm;
+  q[1] *= invNorm;
+  q[2] *= invNorm;
+  q[3] *= invNorm;
+
+  /* stamp the update, the relation matrix and angle are derived on demand */
+  Quat_Output_Update(quat);
+}
+//------------------------------------------------------------------------------
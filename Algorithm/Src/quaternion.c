@@ -25,23 +25,55 @@
 #include "quaternion.h"
 #include "math.h"
 #include "pid.h"
+#include "fast_math.h"
+#if KALMAN_PROFILE_ENABLE
+#include "stm32f4xx.h"
+#endif
+#if QUATEKF_GENERATED_UPDATE
+#include "kalman_quatekf.h"
+#include "kalman_quateskf.h"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+/**
+ * @brief nonzero columns of every row of the state transition matrix,
+ *        the gyro biases are propagated as constants
+ */
+static const uint32_t QuatEKF_A_Sparsity[QUATEKF_XHAT_SIZE] = {0x3FU, 0x3FU, 0x3FU, 0x3FU, 1U << 4, 1U << 5};
+
+/**
+ * @brief nonzero columns of every row of the measurement matrix,
+ *        the gravity depends on the quaternion only
+ */
+static const uint32_t QuatEKF_H_Sparsity[QUATEKF_Z_SIZE] = {0x0FU, 0x0FU, 0x0FU};
+
+/**
+ * @brief nonzero columns of every row of the error-state transition matrix,
+ *        the rotation error is driven by its own axis of gyro bias only
+ */
+static const uint32_t QuatESKF_A_Sparsity[QUATESKF_XHAT_SIZE] = {0x0FU, 0x17U, 0x27U, 1U << 3, 1U << 4, 1U << 5};
+
+/**
+ * @brief nonzero columns of every row of the error-state measurement matrix,
+ *        the skew matrix of gravity has a zero diagonal
+ */
+static const uint32_t QuatESKF_H_Sparsity[QUATESKF_Z_SIZE] = {0x06U, 0x05U, 0x03U};
 
 /* Private function ----------------------------------------------------------*/
 /**
-  * @brief  fast calculate the inverse square root
-  * @note   see http://en.wikipedia.org/wiki/Fast_inverse_square_root
-  * @retval the inverse square root of x
+  * @brief  normalise the quaternion
+  * @param  dst: point to the normalised quaternion
+  * @param  src: point to the quaternion
+  * @retval none
   */
-static float Fast_InverseSqrt(float x)
+static void Quat_Normalize(float dst[4],const float src[4])
 {
-  float halfx = 0.5f * x;
-  float y = x;
-  long i = *(long *)&y;
-
-  i = 0x5f375a86 - (i >> 1);
-  y = *(float *)&i;
-  y = y * (1.5f - (halfx * y * y));
-  return y;
+  float invNorm = Fast_InverseSqrt(src[0]*src[0] + src[1]*src[1] + src[2]*src[2] + src[3]*src[3]);
+
+  dst[0] = src[0] * invNorm;
+  dst[1] = src[1] * invNorm;
+  dst[2] = src[2] * invNorm;
+  dst[3] = src[3] * invNorm;
 }
 //------------------------------------------------------------------------------
 
@@ -131,77 +163,54 @@ static void QuatEKF_H_Update(Kalman_Info_TypeDef *kf)
 //------------------------------------------------------------------------------
 
 /**
-  * @brief Chi Square root Test
-  * @param kf: point to a Kalman_Info_TypeDef structure that
+  * @brief  Update the innovation covariance and its cholesky factor
+  * @param  kf: point to a Kalman_Info_TypeDef structure that
   *         contains the informations of kalman filter.
-  * @retval none
+  * @note   calc_matrix[0] = H·Pminus(k), calc_matrix[1] = cholesky(H·Pminus(k)·HT + R),
+  *         xhat(k) = xhat'(k) and P(k) = P'(k) are kept if S is not positive definite.
+  * @retval arm_status
   */
-static bool QuatEKF_ChiSqrtTest(Kalman_Info_TypeDef *kf)
+static arm_status QuatEKF_S_Update(Kalman_Info_TypeDef *kf)
 {
-  /* calc_matrix[0] = inverse(H·Pminus(k)·HT + R)·(z(k) - h(xhatminus)) */
-  kf->mat.calc_matrix[0].numRows = kf->mat.calc_matrix[1].numRows;
-  kf->mat.calc_matrix[0].numCols = 1;
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.calc_matrix[1], &kf->mat.calc_vector[1], &kf->mat.calc_matrix[0]);
-
-  /* calc_vector[0] = (z(k) - h(xhatminus)T */
-  kf->mat.calc_vector[0].numRows = 1;
-  kf->mat.calc_vector[0].numCols = kf->mat.calc_matrix[1].numRows;
-  kf->ErrorStatus = Matrix_Transpose(&kf->mat.calc_matrix[1], &kf->mat.calc_vector[0]);
-
-  /* ChiSquare_Matrix = (z(k) - h(xhatminus)T·inverse(H·Pminus·HT + R)·(z(k) - h(xhatminus)) */
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.calc_vector[0], &kf->mat.calc_matrix[0], &kf->ChiSquareTest.ChiSquare_Matrix);
+  /* calc_matrix[0] = H·Pminus(k) */
+  kf->mat.calc_matrix[0].numRows = kf->mat.H.numRows;
+  kf->mat.calc_matrix[0].numCols = kf->mat.Pminus.numCols;
+  kf->ErrorStatus = Kalman_Sparse_Multiply(&kf->mat.H, kf->Sparsity.H, &kf->mat.Pminus, &kf->mat.calc_matrix[0]);
 
-  /* rk is smaller,filter converg */ 
-  if (kf->ChiSquareTest.ChiSquare_Data[0] < 0.5f * kf->ChiSquareTest.ChiSquareTestThresholds)
-  {
-    kf->ChiSquareTest.result = true;
-  }
-  /* rk is bigger */ 
-  if (kf->ChiSquareTest.ChiSquare_Data[0] > kf->ChiSquareTest.ChiSquareTestThresholds && kf->ChiSquareTest.result)
+  /* S = H·Pminus(k)·HT + R */
+  kf->mat.S.numRows = kf->mat.R.numRows;
+  kf->mat.S.numCols = kf->mat.R.numCols;
+  for(uint8_t i = 0; i < kf->zSize; i++)
   {
-    if (kf->ChiSquareTest.TestFlag)
-    {
-      kf->ChiSquareTest.ChiSquareCnt++;
-    }
-    else
+    for(uint8_t j = 0; j < kf->zSize; j++)
     {
-      kf->ChiSquareTest.ChiSquareCnt = 0;
-    }
+      /* nonzero columns of H row j, every column if H is dense */
+      uint32_t mask = (kf->Sparsity.H != NULL) ? kf->Sparsity.H[j] : ((1UL << kf->xhatSize) - 1U);
 
-    if (kf->ChiSquareTest.ChiSquareCnt > 50)
-    {
-      kf->ChiSquareTest.result = 0;
-      kf->SkipStep5 = false;
-    }
-    else
-    {
-      /* xhat(k) = xhat'(k) */
-      /* P(k) = P'(k) */
-      memcpy(kf->pdata.xhat, kf->pdata.xhatminus, kf->sizeof_float * kf->xhatSize);
-      memcpy(kf->pdata.P, kf->pdata.Pminus, kf->sizeof_float * kf->xhatSize * kf->xhatSize);
-
-      /* skip the P update */
-      kf->SkipStep5 = true;
-      return true;
+      kf->pdata.S[i*kf->zSize + j] = kf->pdata.R[i*kf->zSize + j];
+      for(uint32_t bits = mask; bits != 0; bits &= bits - 1U)
+      {
+        uint8_t k = (uint8_t)__builtin_ctz(bits);
+        kf->pdata.S[i*kf->zSize + j] += kf->pdata.calc_matrix[0][i*kf->xhatSize + k] * kf->pdata.H[j*kf->xhatSize + k];
+      }
     }
   }
-  else
+
+  /* calc_matrix[1] = cholesky(H·Pminus(k)·HT + R) */
+  memcpy(kf->pdata.calc_matrix[1], kf->pdata.S, kf->sizeof_float * kf->zSize * kf->zSize);
+  kf->ErrorStatus = Kalman_Cholesky_Decompose(kf->pdata.calc_matrix[1], kf->zSize);
+  if(kf->ErrorStatus != ARM_MATH_SUCCESS)
   {
-    if(kf->ChiSquareTest.ChiSquare_Data[0] > 0.1f * kf->ChiSquareTest.ChiSquareTestThresholds && kf->ChiSquareTest.result)
-    {
-      kf->pdata.calc_vector[0][0] = (kf->ChiSquareTest.ChiSquareTestThresholds - kf->ChiSquareTest.ChiSquare_Data[0]) / (0.9f * kf->ChiSquareTest.ChiSquareTestThresholds);
-    }
-    else
-    {
-      kf->pdata.calc_vector[0][0] = 1.f;
-    }
-    
-    kf->ChiSquareTest.ChiSquareCnt = 0;
-    kf->SkipStep5 = false;
+    /* xhat(k) = xhat'(k), P(k) = P'(k) */
+    memcpy(kf->pdata.xhat, kf->pdata.xhatminus, kf->sizeof_float * kf->xhatSize);
+    memcpy(kf->pdata.P, kf->pdata.Pminus, kf->sizeof_float * kf->xhatSize * kf->xhatSize);
+    kf->SkipStep5 = true;
   }
-  return false;
+
+  return kf->ErrorStatus;
 }
 //------------------------------------------------------------------------------
+
 /**
   * @brief  Update the posteriori state estimate
   * @param  kf: point to a Kalman_Info_TypeDef structure that
@@ -210,26 +219,17 @@ static bool QuatEKF_ChiSqrtTest(Kalman_Info_TypeDef *kf)
   */
 static void QuatEKF_xhat_Update(Kalman_Info_TypeDef *kf)
 {
-  /* HT */
-  kf->ErrorStatus = Matrix_Transpose(&kf->mat.H,&kf->mat.HT);
-
-  /* calc_matrix[0] = H·Pminus(k) */
-  kf->mat.calc_matrix[0].numRows = kf->mat.H.numRows;
-  kf->mat.calc_matrix[0].numCols = kf->mat.Pminus.numCols;
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.H, &kf->mat.Pminus, &kf->mat.calc_matrix[0]);
-
-  /* calc_matrix[1] = H·Pminus(k)·HT */
-  kf->mat.calc_matrix[1].numRows = kf->mat.calc_matrix[0].numRows;
-  kf->mat.calc_matrix[1].numCols = kf->mat.HT.numCols;
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.calc_matrix[0], &kf->mat.HT, &kf->mat.calc_matrix[1]); 
-  
-  /* K_d = H·Pminus(k)·HT + R */
-  kf->mat.S.numRows = kf->mat.R.numRows;
-  kf->mat.S.numCols = kf->mat.R.numCols;
-  kf->ErrorStatus = Matrix_Add(&kf->mat.calc_matrix[1], &kf->mat.R, &kf->mat.S);
+  /* no fresh accel, xhat(k) = xhat'(k) and P(k) = P'(k) are kept by the kalman filter */
+  if(kf->MeasureValid == 0)
+  {
+    return;
+  }
 
-  /* calc_matrix[1] = inverse(H·Pminus(k)·HT + R) */
-  kf->ErrorStatus = Matrix_Inverse(&kf->mat.S, &kf->mat.calc_matrix[1]);
+  /* calc_matrix[1] = cholesky(H·Pminus(k)·HT + R) */
+  if(QuatEKF_S_Update(kf) != ARM_MATH_SUCCESS)
+  {
+    return;
+  }
 
   /* direction of gravity indicated by algorithm */
   kf->mat.calc_vector[0].numRows = kf->mat.H.numRows;
@@ -248,7 +248,7 @@ static void QuatEKF_xhat_Update(Kalman_Info_TypeDef *kf)
 	float OrientationCosine[3];
 	for (uint8_t i = 0; i < 3; i++)
 	{
-		OrientationCosine[i] = acosf(fabsf(kf->pdata.calc_vector[0][i]));
+		OrientationCosine[i] = Fast_Acos(fabsf(kf->pdata.calc_vector[0][i]));
 	}
 	
   /* calc_vector[1] = z(k) - h(xhat'(k)) */
@@ -257,22 +257,20 @@ static void QuatEKF_xhat_Update(Kalman_Info_TypeDef *kf)
   kf->ErrorStatus = Matrix_Subtract(&kf->mat.z, &kf->mat.calc_vector[0], &kf->mat.calc_vector[1]);
 
   /* Chi Square root Test */
-  if(QuatEKF_ChiSqrtTest(kf)==true)
+  if(Kalman_ChiSquare_Test(kf)==true)
   {
     return;
   }
 
-  /* calc_matrix[0] = Pminus(k)·HT */
-  kf->mat.calc_matrix[0].numRows = kf->mat.Pminus.numRows;
-  kf->mat.calc_matrix[0].numCols = kf->mat.HT.numCols;
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.Pminus, &kf->mat.HT, &kf->mat.calc_matrix[0]);
+  /* calc_matrix[0] = inverse(H·Pminus·HT + R)·H·Pminus */
+  Kalman_Cholesky_Solve(kf->pdata.calc_matrix[1], kf->zSize, kf->pdata.calc_matrix[0], kf->xhatSize);
 
   /* k = Pminus·HT·inverse(H·Pminus·HT + R) */
-  kf->ErrorStatus = Matrix_Multiply(&kf->mat.calc_matrix[0], &kf->mat.calc_matrix[1], &kf->mat.K);
+  kf->ErrorStatus = Matrix_Transpose(&kf->mat.calc_matrix[0], &kf->mat.K);
 	
 	for(uint8_t i = 0; i < kf->mat.K.numCols*kf->mat.K.numRows; i++)
 	{
-		kf->pdata.K[i] *= kf->pdata.calc_vector[0][0];
+		kf->pdata.K[i] *= kf->ChiSquareTest.Weight;
 	}
 
   /**
@@ -309,6 +307,90 @@ static void QuatEKF_xhat_Update(Kalman_Info_TypeDef *kf)
 }
 //------------------------------------------------------------------------------
 
+/**
+  * @brief  Update the posteriori error state
+  * @param  kf: point to a Kalman_Info_TypeDef structure that
+  *         contains the informations of kalman filter.
+  * @note   the measurement is the innovation of the gravity direction,
+  *         H = [g]x is the skew matrix of the gravity in body frame.
+  * @retval none
+  */
+static void QuatESKF_xhat_Update(Kalman_Info_TypeDef *kf)
+{
+  /* no fresh accel, xhat(k) = xhat'(k) and P(k) = P'(k) are kept by the kalman filter */
+  if(kf->MeasureValid == 0)
+  {
+    return;
+  }
+
+  /* calc_matrix[1] = cholesky(H·Pminus(k)·HT + R) */
+  if(QuatEKF_S_Update(kf) != ARM_MATH_SUCCESS)
+  {
+    return;
+  }
+
+  /* direction of gravity read back from H = [g]x */
+  float gravity[3] = {kf->pdata.H[13], kf->pdata.H[2], kf->pdata.H[6]};
+
+  /* calc_vector[1] = z(k) - H·xhat'(k) */
+  kf->mat.calc_vector[0].numRows = kf->mat.H.numRows;
+  kf->mat.calc_vector[0].numCols = 1;
+  kf->ErrorStatus = Kalman_Sparse_Multiply(&kf->mat.H, kf->Sparsity.H, &kf->mat.xhatminus, &kf->mat.calc_vector[0]);
+  kf->mat.calc_vector[1].numRows = kf->mat.z.numRows;
+  kf->mat.calc_vector[1].numCols = 1;
+  kf->ErrorStatus = Matrix_Subtract(&kf->mat.z, &kf->mat.calc_vector[0], &kf->mat.calc_vector[1]);
+
+  /* Chi Square root Test */
+  if(Kalman_ChiSquare_Test(kf) == true)
+  {
+    return;
+  }
+
+  /* calc_matrix[0] = inverse(H·Pminus·HT + R)·H·Pminus */
+  Kalman_Cholesky_Solve(kf->pdata.calc_matrix[1], kf->zSize, kf->pdata.calc_matrix[0], kf->xhatSize);
+
+  /* k = Pminus·HT·inverse(H·Pminus·HT + R) */
+  kf->ErrorStatus = Matrix_Transpose(&kf->mat.calc_matrix[0], &kf->mat.K);
+
+  for(uint8_t i = 0; i < kf->mat.K.numCols*kf->mat.K.numRows; i++)
+  {
+    kf->pdata.K[i] *= kf->ChiSquareTest.Weight;
+  }
+
+  /**
+   * @brief K[9..17] *= cos(axis)/(PI/2.f), 
+   *        the bias of the axis along the gravity is not observable
+   */
+  for (uint8_t i = 3; i < 6; i++)
+  {
+    for (uint8_t j = 0; j < 3; j++)
+    {
+      kf->pdata.K[i * 3 + j] *= Fast_Acos(fabsf(gravity[i - 3])) / 1.5707963f;
+    }
+  }
+
+  /* calc_vector[0] = K(k)·(z(k) - H·xhat'(k)) */
+  kf->mat.calc_vector[0].numRows = kf->mat.K.numRows;
+  kf->mat.calc_vector[0].numCols = 1;
+  kf->ErrorStatus = Matrix_Multiply(&kf->mat.K, &kf->mat.calc_vector[1], &kf->mat.calc_vector[0]);
+
+  if(kf->ChiSquareTest.result)
+  {
+    VAL_LIMIT(kf->pdata.calc_vector[0][3],-1e-2f*kf->dt,1e-2f*kf->dt);
+    VAL_LIMIT(kf->pdata.calc_vector[0][4],-1e-2f*kf->dt,1e-2f*kf->dt);
+    VAL_LIMIT(kf->pdata.calc_vector[0][5],-1e-2f*kf->dt,1e-2f*kf->dt);
+  }
+
+  /* the heading is not observable, remove the rotation about the gravity */
+  float heading = kf->pdata.calc_vector[0][0]*gravity[0] + kf->pdata.calc_vector[0][1]*gravity[1] + kf->pdata.calc_vector[0][2]*gravity[2];
+  kf->pdata.calc_vector[0][0] -= heading * gravity[0];
+  kf->pdata.calc_vector[0][1] -= heading * gravity[1];
+  kf->pdata.calc_vector[0][2] -= heading * gravity[2];
+
+  kf->ErrorStatus = Matrix_Add(&kf->mat.xhatminus, &kf->mat.calc_vector[0], &kf->mat.xhat);
+}
+//------------------------------------------------------------------------------
+
 /**
   * @brief Initializes the Quaternion EKF.
   * @param quat: point to a Quat_Info_Typedef structure that
@@ -330,19 +412,17 @@ void QuatEKF_Init(Quat_Info_Typedef *quat,float Q1,float Q2,float R,float *pdata
   quat->pdata_P = pdata_P;
 
   /* Initialize the Extended kalman filter */
-  Kalman_Filter_Init(&quat->QuatEKF,6,0,3);
+  Kalman_Filter_Static_Init(&quat->QuatEKF,QUATEKF_XHAT_SIZE,QUATEKF_U_SIZE,QUATEKF_Z_SIZE,quat->QuatEKF_Storage,sizeof(quat->QuatEKF_Storage)/sizeof(float));
 
-  /* Initializes the relation matrix */
-  quat->relation.numRows = 3;
-  quat->relation.numCols = 3;
-  quat->relation.pData = (float *)user_malloc(quat->QuatEKF.sizeof_float * quat->relation.numRows * quat->relation.numCols);
-  memset(quat->relation.pData, 0, quat->QuatEKF.sizeof_float * quat->relation.numRows * quat->relation.numCols);
+  /* Initializes the derived outputs */
+  Quat_Output_Init(quat);
 
   /* Initializes the chi square test */
   quat->QuatEKF.ChiSquareTest.TestFlag = false;
   quat->QuatEKF.ChiSquareTest.result = false;
   quat->QuatEKF.ChiSquareTest.ChiSquareTestThresholds = 1e-8f;
   quat->QuatEKF.ChiSquareTest.ChiSquareCnt = 0;
+  quat->QuatEKF.ChiSquareTest.Weight = 1.f;
 
   /* Initializes the position */
   quat->QuatEKF.pdata.xhat[0] = 1.f;
@@ -357,21 +437,33 @@ void QuatEKF_Init(Quat_Info_Typedef *quat,float Q1,float Q2,float R,float *pdata
   quat->QuatEKF.SkipStep3 = true;
   quat->QuatEKF.SkipStep4 = true;
 
+  /* propagate the covariance as a symmetric matrix */
+  quat->QuatEKF.SymmetricP = true;
+
+  /* skip the structural zeros of the state transition and measurement */
+  Kalman_Filter_SetSparsity(&quat->QuatEKF,KALMAN_MATRIX_A,QuatEKF_A_Sparsity);
+  Kalman_Filter_SetSparsity(&quat->QuatEKF,KALMAN_MATRIX_H,QuatEKF_H_Sparsity);
+
   memcpy(quat->QuatEKF.pdata.A,quat->pdata_A,quat->QuatEKF.sizeof_float * quat->QuatEKF.xhatSize * quat->QuatEKF.xhatSize);
   memcpy(quat->QuatEKF.pdata.P,quat->pdata_P,quat->QuatEKF.sizeof_float * quat->QuatEKF.xhatSize * quat->QuatEKF.xhatSize);
 }
 //------------------------------------------------------------------------------
 
 /**
-  * @brief  Update the Extended Kalman Filter
+  * @brief  Update the gyro and accel input of the Quaternion EKF
   * @param quat: point to a Quat_Info_Typedef structure that
   *         contains the informations of Quaternion EKF
-  * @param gyro: point to the accel measurement
-  * @param accel: point to the gyro measurement
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
   * @param dt: system latency
+  * @retval none
   */
-void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
+static void QuatEKF_Input_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
 {
+#if QUATEKF_EXACT_PROPAGATION
+  float theta2 = 0.f, scale = 1.f;
+#endif
+
   /* store the system latency */
   quat->QuatEKF.dt = dt;
 
@@ -388,6 +480,91 @@ void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float d
   quat->halfgyrodt[1] = 0.5f * quat->gyro[1] * quat->QuatEKF.dt;
   quat->halfgyrodt[2] = 0.5f * quat->gyro[2] * quat->QuatEKF.dt;
 
+#if QUATEKF_EXACT_PROPAGATION
+  /**
+   * @brief the quaternion is normalised after the propagation, so
+   *        q ⊗ [cos(θ), sin(θ)·halfgyrodt/θ] ∝ q ⊗ [1, tan(θ)·halfgyrodt/θ], θ = |halfgyrodt|,
+   *        tan(θ)/θ = 1 + θ^2/3 + 2θ^4/15 + O(θ^6)
+   */
+  theta2 = quat->halfgyrodt[0]*quat->halfgyrodt[0] + quat->halfgyrodt[1]*quat->halfgyrodt[1] + quat->halfgyrodt[2]*quat->halfgyrodt[2];
+  scale = 1.f + theta2 * (0.33333333f + theta2 * 0.13333333f);
+
+  quat->halfgyrodt[0] *= scale;
+  quat->halfgyrodt[1] *= scale;
+  quat->halfgyrodt[2] *= scale;
+#endif
+
+  /* no fresh accel, run the prediction only */
+  quat->QuatEKF.MeasureValid = (accel != NULL) ? KALMAN_MEASURE_ALL : 0;
+
+  if(accel != NULL)
+  {
+    memcpy(quat->accel,accel,sizeof(quat->accel));
+
+    /* accelInvNorm = 1.f/(accel[0]^2.f + accel[1]^2.f + accel[3]^2.f) */
+    quat->accelInvNorm = Fast_InverseSqrt(quat->accel[0]*quat->accel[0]+quat->accel[1]*quat->accel[1]+quat->accel[2]*quat->accel[2]);
+
+    /* a zero or non-finite accel has no direction, run the prediction only */
+    if(!(quat->accelInvNorm > 0.f))
+    {
+      quat->QuatEKF.MeasureValid = 0;
+    }
+    else
+    {
+      quat->QuatEKF.MeasureInput[0] = quat->accel[0] * quat->accelInvNorm;
+      quat->QuatEKF.MeasureInput[1] = quat->accel[1] * quat->accelInvNorm;
+      quat->QuatEKF.MeasureInput[2] = quat->accel[2] * quat->accelInvNorm;
+    }
+  }
+	 
+  /* chi square test */
+  if(1.f/quat->gyroInvNorm < 0.3f && 1.f/quat->accelInvNorm  > (GravityAccel-0.5f) && 1.f/quat->accelInvNorm < (GravityAccel+0.5f))
+	{
+		quat->QuatEKF.ChiSquareTest.TestFlag = true;
+  }
+  else
+  {
+    quat->QuatEKF.ChiSquareTest.TestFlag = false;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the quaternion and gyro bias
+  *         from the output of the Quaternion EKF
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @retval none
+  */
+static void QuatEKF_Output_Update(Quat_Info_Typedef *quat)
+{
+  /* Update the quaternion */
+  quat->quat[0]    = quat->QuatEKF.Output[0];
+  quat->quat[1]    = quat->QuatEKF.Output[1];
+  quat->quat[2]    = quat->QuatEKF.Output[2];
+  quat->quat[3]    = quat->QuatEKF.Output[3];
+  quat->biasgyro[0] = quat->QuatEKF.Output[4];
+  quat->biasgyro[1] = quat->QuatEKF.Output[5];
+  quat->biasgyro[2] = 0.f;
+
+  /* stamp the update, the relation matrix and angle are derived on demand */
+  Quat_Output_Update(quat);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the Extended Kalman Filter
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
+  * @param dt: system latency
+  */
+void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
+{
+  /* Update the gyro and accel input */
+  QuatEKF_Input_Update(quat,gyro,accel,dt);
+
   /**
    * @brief A = \frac{\partial f}{\partial x}
    *        (1,        -halfgxdt,  -halfgydt,  -halfgzdt,)   0.5f*q1*dt,  0.5f*q2*dt
@@ -414,24 +591,6 @@ void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float d
   quat->QuatEKF.pdata.A[18] =  quat->halfgyrodt[2];
   quat->QuatEKF.pdata.A[19] =  quat->halfgyrodt[1];
   quat->QuatEKF.pdata.A[20] = -quat->halfgyrodt[0];
-	
-	memcpy(quat->accel,accel,sizeof(quat->accel));
-
-  /* accelInvNorm = 1.f/(accel[0]^2.f + accel[1]^2.f + accel[3]^2.f) */
-  quat->accelInvNorm = Fast_InverseSqrt(quat->accel[0]*quat->accel[0]+quat->accel[1]*quat->accel[1]+quat->accel[2]*quat->accel[2]);
-  quat->QuatEKF.MeasureInput[0] = quat->accel[0] * quat->accelInvNorm;
-  quat->QuatEKF.MeasureInput[1] = quat->accel[1] * quat->accelInvNorm;
-  quat->QuatEKF.MeasureInput[2] = quat->accel[2] * quat->accelInvNorm;
-	 
-  /* chi square test */
-  if(1.f/quat->gyroInvNorm < 0.3f && 1.f/quat->accelInvNorm  > (GravityAccel-0.5f) && 1.f/quat->accelInvNorm < (GravityAccel+0.5f))
-	{
-		quat->QuatEKF.ChiSquareTest.TestFlag = true;
-  }
-  else
-  {
-    quat->QuatEKF.ChiSquareTest.TestFlag = false;
-  }
 
   /* update the process/measurement noise covariance */
   quat->QuatEKF.pdata.Q[0]  = quat->Q1 * quat->QuatEKF.dt;
@@ -447,33 +606,625 @@ void QuatEKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float d
   quat->QuatEKF.pdata.R[8]  = quat->R;
 
   /* update the kalman filter */
+#if QUATEKF_GENERATED_UPDATE
+  Kalman_QuatEKF_Update(&quat->QuatEKF);
+#else
   Kalman_Filter_Update(&quat->QuatEKF);
+#endif
 
-  /* Update the quaternion */
-  quat->quat[0]    = quat->QuatEKF.Output[0];
-  quat->quat[1]    = quat->QuatEKF.Output[1];
-  quat->quat[2]    = quat->QuatEKF.Output[2];
-  quat->quat[3]    = quat->QuatEKF.Output[3];
-  quat->biasgyro[0] = quat->QuatEKF.Output[4];
-  quat->biasgyro[1] = quat->QuatEKF.Output[5];
-  quat->biasgyro[2] = 0.f;
+  /* Update the quaternion and gyro bias */
+  QuatEKF_Output_Update(quat);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Multiply a column of the quaternion rows by the state transition
+  * @param  h: halfgyrodt
+  * @param  g: 0.5f*dt*q of the gyro bias columns, see QuatEKF_ClosedForm_Update
+  * @param  v: column of the 6 x n matrix, stride of the elements
+  * @param  stride: distance between the elements of the column
+  * @param  out: the quaternion rows of A·v
+  * @retval none
+  */
+static void QuatEKF_A_Multiply(const float h[3],const float g[8],const float *v,uint8_t stride,float out[4])
+{
+  float v0 = v[0], v1 = v[stride], v2 = v[2*stride], v3 = v[3*stride], v4 = v[4*stride], v5 = v[5*stride];
+
+  /* Ω(halfgyrodt)·v[0..3] + G(q)·v[4..5] */
+  out[0] = v0 - h[0]*v1 - h[1]*v2 - h[2]*v3 + g[0]*v4 + g[1]*v5;
+  out[1] = v1 + h[0]*v0 + h[2]*v2 - h[1]*v3 + g[2]*v4 + g[3]*v5;
+  out[2] = v2 + h[1]*v0 - h[2]*v1 + h[0]*v3 + g[4]*v4 + g[5]*v5;
+  out[3] = v3 + h[2]*v0 + h[1]*v1 - h[0]*v2 + g[6]*v4 + g[7]*v5;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the posteriori state estimate and covariance of the
+  *         Quaternion EKF in closed form
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @note   xhatminus and Pminus are updated, H = [Hq 0] and the 3x3 S are expanded by hand.
+  * @retval none
+  */
+static void QuatEKF_ClosedForm_Measure(Quat_Info_Typedef *quat)
+{
+  Kalman_Info_TypeDef *kf = &quat->QuatEKF;
+  float *xhat = kf->pdata.xhat, *xhatminus = kf->pdata.xhatminus;
+  float *P = kf->pdata.P, *Pminus = kf->pdata.Pminus, *K = kf->pdata.K;
+  float HP[18], S[6], Sinv[6], h[3], r[3], dx[6];
+  float det = 0.f;
+
+  /* no fresh accel, xhat(k) = xhat'(k), P(k) = P'(k) */
+  if(kf->MeasureValid == 0)
+  {
+    memcpy(xhat, xhatminus, kf->sizeof_float * kf->xhatSize);
+    memcpy(P, Pminus, kf->sizeof_float * kf->xhatSize * kf->xhatSize);
+    return;
+  }
+
+  /**
+   * @brief HP = Hq·Pminus(k), quaternion columns of H
+   *  -2.f*q2,  2.f*q3, -2.f*q0, 2.f*q1
+   *   2.f*q1,  2.f*q0,  2.f*q3, 2.f*q2
+   *   2.f*q0, -2.f*q1, -2.f*q2, 2.f*q3
+   */
+  for(uint8_t j = 0; j < 6; j++)
+  {
+    float p0 = Pminus[j], p1 = Pminus[6 + j], p2 = Pminus[12 + j], p3 = Pminus[18 + j];
+    HP[j]      = 2.f*(-xhatminus[2]*p0 + xhatminus[3]*p1 - xhatminus[0]*p2 + xhatminus[1]*p3);
+    HP[6 + j]  = 2.f*( xhatminus[1]*p0 + xhatminus[0]*p1 + xhatminus[3]*p2 + xhatminus[2]*p3);
+    HP[12 + j] = 2.f*( xhatminus[0]*p0 - xhatminus[1]*p1 - xhatminus[2]*p2 + xhatminus[3]*p3);
+  }
+
+  /* S = HP·HqT + R, upper triangle: S00 S01 S02 S11 S12 S22 */
+  for(uint8_t i = 0, n = 0; i < 3; i++)
+  {
+    for(uint8_t j = i; j < 3; j++, n++)
+    {
+      const float *hp = &HP[6*i];
+      switch(j)
+      {
+        case 0: S[n] = 2.f*(-xhatminus[2]*hp[0] + xhatminus[3]*hp[1] - xhatminus[0]*hp[2] + xhatminus[1]*hp[3]); break;
+        case 1: S[n] = 2.f*( xhatminus[1]*hp[0] + xhatminus[0]*hp[1] + xhatminus[3]*hp[2] + xhatminus[2]*hp[3]); break;
+        default: S[n] = 2.f*( xhatminus[0]*hp[0] - xhatminus[1]*hp[1] - xhatminus[2]*hp[2] + xhatminus[3]*hp[3]); break;
+      }
+      S[n] += (i == j) ? quat->R : 0.f;
+    }
+  }
+
+  /* Sinv = adj(S)/det(S), S must be positive definite */
+  Sinv[0] = S[3]*S[5] - S[4]*S[4];
+  Sinv[1] = S[2]*S[4] - S[1]*S[5];
+  Sinv[2] = S[1]*S[4] - S[2]*S[3];
+  det = S[0]*Sinv[0] + S[1]*Sinv[1] + S[2]*Sinv[2];
+  if(!(S[0] > 0.f) || !(S[0]*S[3] - S[1]*S[1] > 0.f) || !(det > 0.f))
+  {
+    /* xhat(k) = xhat'(k), P(k) = P'(k) */
+    memcpy(xhat, xhatminus, kf->sizeof_float * kf->xhatSize);
+    memcpy(P, Pminus, kf->sizeof_float * kf->xhatSize * kf->xhatSize);
+    kf->SkipStep5 = true;
+    return;
+  }
+  det = 1.f / det;
+  Sinv[0] *= det;
+  Sinv[1] *= det;
+  Sinv[2] *= det;
+  Sinv[3] = (S[0]*S[5] - S[2]*S[2]) * det;
+  Sinv[4] = (S[1]*S[2] - S[0]*S[4]) * det;
+  Sinv[5] = (S[0]*S[3] - S[1]*S[1]) * det;
+
+  /* direction of gravity indicated by algorithm */
+  h[0] = 2.f * (xhatminus[1] * xhatminus[3] - xhatminus[0] * xhatminus[2]);
+  h[1] = 2.f * (xhatminus[0] * xhatminus[1] + xhatminus[2] * xhatminus[3]);
+  h[2] = xhatminus[0] * xhatminus[0] - xhatminus[1] * xhatminus[1] \
+       - xhatminus[2] * xhatminus[2] + xhatminus[3] * xhatminus[3];
+
+  /* r = z(k) - h(xhat'(k)) */
+  r[0] = kf->pdata.z[0] - h[0];
+  r[1] = kf->pdata.z[1] - h[1];
+  r[2] = kf->pdata.z[2] - h[2];
+
+  /* ChiSquare = rT·inverse(S)·r */
+  dx[0] = Sinv[0]*r[0] + Sinv[1]*r[1] + Sinv[2]*r[2];
+  dx[1] = Sinv[1]*r[0] + Sinv[3]*r[1] + Sinv[4]*r[2];
+  dx[2] = Sinv[2]*r[0] + Sinv[4]*r[1] + Sinv[5]*r[2];
+  kf->ChiSquareTest.ChiSquare_Data[0] = r[0]*dx[0] + r[1]*dx[1] + r[2]*dx[2];
+  if(Kalman_ChiSquare_Gate(kf) == true)
+  {
+    return;
+  }
+
+  /* K = HPT·inverse(S)·weight, K[12..17] *= cos(axis)/(PI/2.f) */
+  for(uint8_t i = 0; i < 6; i++)
+  {
+    float weight = kf->ChiSquareTest.Weight;
+    if(i >= 4)
+    {
+      weight *= Fast_Acos(fabsf(h[i - 4])) / 1.5707963f;
+    }
+    K[i*3]     = (HP[i]*Sinv[0] + HP[6 + i]*Sinv[1] + HP[12 + i]*Sinv[2]) * weight;
+    K[i*3 + 1] = (HP[i]*Sinv[1] + HP[6 + i]*Sinv[3] + HP[12 + i]*Sinv[4]) * weight;
+    K[i*3 + 2] = (HP[i]*Sinv[2] + HP[6 + i]*Sinv[4] + HP[12 + i]*Sinv[5]) * weight;
+    dx[i] = K[i*3]*r[0] + K[i*3 + 1]*r[1] + K[i*3 + 2]*r[2];
+  }
+
+  if(kf->ChiSquareTest.result)
+  {
+    VAL_LIMIT(dx[4],-1e-2f*kf->dt,1e-2f*kf->dt);
+    VAL_LIMIT(dx[5],-1e-2f*kf->dt,1e-2f*kf->dt);
+  }
+  dx[3] = 0;
+
+  /* xhat(k) = xhat'(k) + K(k)·(z(k) - h(xhat'(k))) */
+  for(uint8_t i = 0; i < 6; i++)
+  {
+    xhat[i] = xhatminus[i] + dx[i];
+  }
+
+  /* P(k) = Pminus(k) - K(k)·HP, upper triangle mirrored */
+  if(kf->SkipStep5 == 0)
+  {
+    for(uint8_t i = 0; i < 6; i++)
+    {
+      for(uint8_t j = i; j < 6; j++)
+      {
+        P[i*6 + j] = P[j*6 + i] = Pminus[i*6 + j] - (K[i*3]*HP[j] + K[i*3 + 1]*HP[6 + j] + K[i*3 + 2]*HP[12 + j]);
+      }
+    }
+  }
+
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the Extended Kalman Filter in closed form
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
+  * @param dt: system latency
+  * @note   same filter as QuatEKF_Update with an identity pdata_A, the structure of
+  *         A = [Ω G; 0 I], H = [Hq 0] and the 3x3 S is expanded by hand,
+  *         the state and covariance stay in QuatEKF so both updates can be mixed.
+  */
+void QuatEKF_ClosedForm_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
+{
+  Kalman_Info_TypeDef *kf = &quat->QuatEKF;
+  float *xhat = kf->pdata.xhat, *xhatminus = kf->pdata.xhatminus;
+  float *P = kf->pdata.P, *Pminus = kf->pdata.Pminus;
+  float g[8], AP[24], APAT[4];
+  float invNorm = 0.f, q1dt = 0.f, q2dt = 0.f;
+#if KALMAN_PROFILE_ENABLE
+  uint32_t start = DWT->CYCCNT;
+#endif
+
+  /* Update the gyro and accel input */
+  QuatEKF_Input_Update(quat,gyro,accel,dt);
+  memcpy(kf->pdata.z, kf->MeasureInput, kf->sizeof_float * kf->zSize);
+  memset(kf->MeasureInput, 0, kf->sizeof_float * kf->zSize);
+  kf->Telemetry.UpdateCnt++;
+
+  /* xhatminus(k) = Ω(halfgyrodt)·q(k-1), the gyro bias is constant */
+  memset(g, 0, sizeof(g));
+  QuatEKF_A_Multiply(quat->halfgyrodt, g, xhat, 1, xhatminus);
+  xhatminus[4] = xhat[4];
+  xhatminus[5] = xhat[5];
+
+  /* normalise quaternion */
+  invNorm = Fast_InverseSqrt(xhatminus[0]*xhatminus[0] + xhatminus[1]*xhatminus[1] \
+                           + xhatminus[2]*xhatminus[2] + xhatminus[3]*xhatminus[3]);
+  xhatminus[0] *= invNorm;
+  xhatminus[1] *= invNorm;
+  xhatminus[2] *= invNorm;
+  xhatminus[3] *= invNorm;
+
+  /**
+   * @brief G = \frac{\partial f}{\partial biasgyro}
+   *         0.5f*q1*dt,  0.5f*q2*dt
+   *        -0.5f*q0*dt,  0.5f*q3*dt
+   *        -0.5f*q3*dt, -0.5f*q0*dt
+   *         0.5f*q2*dt, -0.5f*q1*dt
+   */
+  g[0] =  0.5f*xhatminus[1]*kf->dt; g[1] =  0.5f*xhatminus[2]*kf->dt;
+  g[2] = -0.5f*xhatminus[0]*kf->dt; g[3] =  0.5f*xhatminus[3]*kf->dt;
+  g[4] = -0.5f*xhatminus[3]*kf->dt; g[5] = -0.5f*xhatminus[0]*kf->dt;
+  g[6] =  0.5f*xhatminus[2]*kf->dt; g[7] = -0.5f*xhatminus[1]*kf->dt;
+
+  /* Limit the P data */
+  VAL_LIMIT(P[28],-10000,10000);
+  VAL_LIMIT(P[35],-10000,10000);
+
+  /* AP = A·P(k-1), quaternion rows, AP[4*j + i] is row i of column j */
+  for(uint8_t j = 0; j < 6; j++)
+  {
+    QuatEKF_A_Multiply(quat->halfgyrodt, g, &P[j], 6, &AP[4*j]);
+  }
+
+  /* Pminus(k) = AP·AT + Q, upper triangle mirrored */
+  q1dt = quat->Q1 * kf->dt;
+  q2dt = quat->Q2 * kf->dt;
+  for(uint8_t i = 0; i < 4; i++)
+  {
+    /* row i of AP·AT in the quaternion columns */
+    QuatEKF_A_Multiply(quat->halfgyrodt, g, &AP[i], 4, APAT);
+    for(uint8_t j = i; j < 4; j++)
+    {
+      Pminus[i*6 + j] = Pminus[j*6 + i] = APAT[j] + ((i == j) ? q1dt : 0.f);
+    }
+    Pminus[i*6 + 4] = Pminus[24 + i] = AP[16 + i];
+    Pminus[i*6 + 5] = Pminus[30 + i] = AP[20 + i];
+  }
+  Pminus[28] = P[28] + q2dt;
+  Pminus[29] = Pminus[34] = P[29];
+  Pminus[35] = P[35] + q2dt;
+
+  /* Update the posteriori state estimate and covariance */
+  QuatEKF_ClosedForm_Measure(quat);
+
+  /* store the output */
+  memcpy(kf->Output, xhat, kf->sizeof_float * kf->xhatSize);
+
+#if KALMAN_PROFILE_ENABLE
+  /* DWT cycles of the update, comparable with Kalman_Filter_Update */
+  kf->Telemetry.TotalCycles = DWT->CYCCNT - start;
+  if(kf->Telemetry.TotalCycles > kf->Telemetry.MaxCycles)
+  {
+    kf->Telemetry.MaxCycles = kf->Telemetry.TotalCycles;
+  }
+#endif
+
+  /* Update the quaternion and gyro bias */
+  QuatEKF_Output_Update(quat);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Initializes the Quaternion error-state EKF.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param Q1: process noise of the quaternion, the rotation error uses 4.f*Q1
+  * @param Q2: process noise of the gyro bias
+  * @param R: measurement noise
+  * @param pdata_P: point to the data of posteriori covariance,
+  *         rotation error in rad and gyro bias in rad/s
+  */
+void QuatESKF_Init(Quat_Info_Typedef *quat,float Q1,float Q2,float R,float *pdata_P)
+{
+  /* store the data of process and measurement noise */
+  quat->Q1 = Q1;
+  quat->Q2 = Q2;
+  quat->R  = R;
+
+  /* store the data of posteriori covariance, the state transition is built every update */
+  quat->pdata_A = NULL;
+  quat->pdata_P = pdata_P;
+
+  /* Initialize the Extended kalman filter, the storage is shared with the EKF of the same size */
+  Kalman_Filter_Static_Init(&quat->QuatEKF,QUATESKF_XHAT_SIZE,QUATESKF_U_SIZE,QUATESKF_Z_SIZE,quat->QuatEKF_Storage,sizeof(quat->QuatEKF_Storage)/sizeof(float));
+
+  /* Initializes the derived outputs */
+  Quat_Output_Init(quat);
+
+  /* Initializes the chi square test */
+  quat->QuatEKF.ChiSquareTest.TestFlag = false;
+  quat->QuatEKF.ChiSquareTest.result = false;
+  quat->QuatEKF.ChiSquareTest.ChiSquareTestThresholds = 1e-8f;
+  quat->QuatEKF.ChiSquareTest.ChiSquareCnt = 0;
+  quat->QuatEKF.ChiSquareTest.Weight = 1.f;
+
+  /* Initializes the nominal state, the error state is zero */
+  quat->quat[0] = 1.f;
+  quat->quat[1] = 0.f;
+  quat->quat[2] = 0.f;
+  quat->quat[3] = 0.f;
+  memset(quat->biasgyro, 0, sizeof(quat->biasgyro));
+
+  /* A = I, H = 0, the nonzero elements are updated every cycle */
+  for(uint8_t i = 0; i < QUATESKF_XHAT_SIZE; i++)
+  {
+    quat->QuatEKF.pdata.A[i*QUATESKF_XHAT_SIZE + i] = 1.f;
+  }
+
+  quat->QuatEKF.User_Function3 = QuatESKF_xhat_Update;
+
+  quat->QuatEKF.SkipStep3 = true;
+  quat->QuatEKF.SkipStep4 = true;
+
+  /* propagate the covariance as a symmetric matrix */
+  quat->QuatEKF.SymmetricP = true;
+
+  /* skip the structural zeros of the state transition and measurement */
+  Kalman_Filter_SetSparsity(&quat->QuatEKF,KALMAN_MATRIX_A,QuatESKF_A_Sparsity);
+  Kalman_Filter_SetSparsity(&quat->QuatEKF,KALMAN_MATRIX_H,QuatESKF_H_Sparsity);
+
+  memcpy(quat->QuatEKF.pdata.P,quat->pdata_P,quat->QuatEKF.sizeof_float * quat->QuatEKF.xhatSize * quat->QuatEKF.xhatSize);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Update the error-state Extended Kalman Filter
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of Quaternion EKF
+  * @param gyro: point to the gyro measurement
+  * @param accel: point to the accel measurement, NULL to run the prediction only
+  * @param dt: system latency
+  */
+void QuatESKF_Update(Quat_Info_Typedef *quat,float gyro[3],float accel[3],float dt)
+{
+  float q[4];
+
+  /* Update the gyro and accel input */
+  QuatEKF_Input_Update(quat,gyro,accel,dt);
+
+  /* propagate the nominal quaternion: q = q ⊗ [1, halfgyrodt] */
+  q[0] = quat->quat[0] - quat->quat[1]*quat->halfgyrodt[0] - quat->quat[2]*quat->halfgyrodt[1] - quat->quat[3]*quat->halfgyrodt[2];
+  q[1] = quat->quat[1] + quat->quat[0]*quat->halfgyrodt[0] + quat->quat[2]*quat->halfgyrodt[2] - quat->quat[3]*quat->halfgyrodt[1];
+  q[2] = quat->quat[2] + quat->quat[0]*quat->halfgyrodt[1] - quat->quat[1]*quat->halfgyrodt[2] + quat->quat[3]*quat->halfgyrodt[0];
+  q[3] = quat->quat[3] + quat->quat[0]*quat->halfgyrodt[2] + quat->quat[1]*quat->halfgyrodt[1] - quat->quat[2]*quat->halfgyrodt[0];
+  Quat_Normalize(quat->quat, q);
+
+  /**
+   * @brief A = \frac{\partial f}{\partial δx}, θ = gyro*dt
+   *        1,    θz,  -θy,  -dt,   0,   0
+   *       -θz,   1,    θx,   0,  -dt,   0
+   *        θy,  -θx,   1,    0,    0, -dt
+   *        0,    0,    0,    1,    0,   0
+   *        0,    0,    0,    0,    1,   0
+   *        0,    0,    0,    0,    0,   1
+   */
+  quat->QuatEKF.pdata.A[1]  =  2.f*quat->halfgyrodt[2];
+  quat->QuatEKF.pdata.A[2]  = -2.f*quat->halfgyrodt[1];
+  quat->QuatEKF.pdata.A[3]  = -quat->QuatEKF.dt;
+
+  quat->QuatEKF.pdata.A[6]  = -2.f*quat->halfgyrodt[2];
+  quat->QuatEKF.pdata.A[8]  =  2.f*quat->halfgyrodt[0];
+  quat->QuatEKF.pdata.A[10] = -quat->QuatEKF.dt;
+
+  quat->QuatEKF.pdata.A[12] =  2.f*quat->halfgyrodt[1];
+  quat->QuatEKF.pdata.A[13] = -2.f*quat->halfgyrodt[0];
+  quat->QuatEKF.pdata.A[17] = -quat->QuatEKF.dt;
+
+  /* direction of gravity in body frame */
+  /* calc_vector[0][0] = 2.f*(q1*q3 - q0*q2) */
+  /* calc_vector[0][1] = 2.f*(q0*q1 + q2*q3) */
+  /* calc_vector[0][2] = q0^2.f - q1^2.f - q2^2.f + q3^2.f */
+  float gravity[3];
+  gravity[0] = 2.f * (quat->quat[1] * quat->quat[3] - quat->quat[0] * quat->quat[2]);
+  gravity[1] = 2.f * (quat->quat[0] * quat->quat[1] + quat->quat[2] * quat->quat[3]);
+  gravity[2] = quat->quat[0] * quat->quat[0] - quat->quat[1] * quat->quat[1] \
+             - quat->quat[2] * quat->quat[2] + quat->quat[3] * quat->quat[3];
+
+  /**
+   * @brief H = \frac{\partial h}{\partial δx} = [g]x
+   *        0,   -gz,   gy,  0, 0, 0
+   *        gz,   0,   -gx,  0, 0, 0
+   *       -gy,   gx,   0,   0, 0, 0
+   */
+  quat->QuatEKF.pdata.H[1]  = -gravity[2];
+  quat->QuatEKF.pdata.H[2]  =  gravity[1];
+  quat->QuatEKF.pdata.H[6]  =  gravity[2];
+  quat->QuatEKF.pdata.H[8]  = -gravity[0];
+  quat->QuatEKF.pdata.H[12] = -gravity[1];
+  quat->QuatEKF.pdata.H[13] =  gravity[0];
+
+  /* the measurement of the error state is the innovation of the gravity direction */
+  if(quat->QuatEKF.MeasureValid != 0)
+  {
+    quat->QuatEKF.MeasureInput[0] -= gravity[0];
+    quat->QuatEKF.MeasureInput[1] -= gravity[1];
+    quat->QuatEKF.MeasureInput[2] -= gravity[2];
+  }
+
+  /* update the process/measurement noise covariance, δθ = 2.f*δq */
+  quat->QuatEKF.pdata.Q[0]  = 4.f * quat->Q1 * quat->QuatEKF.dt;
+  quat->QuatEKF.pdata.Q[7]  = 4.f * quat->Q1 * quat->QuatEKF.dt;
+  quat->QuatEKF.pdata.Q[14] = 4.f * quat->Q1 * quat->QuatEKF.dt;
+
+  quat->QuatEKF.pdata.Q[21] = quat->Q2 * quat->QuatEKF.dt;
+  quat->QuatEKF.pdata.Q[28] = quat->Q2 * quat->QuatEKF.dt;
+  quat->QuatEKF.pdata.Q[35] = quat->Q2 * quat->QuatEKF.dt;
+
+  quat->QuatEKF.pdata.R[0]  = quat->R;
+  quat->QuatEKF.pdata.R[4]  = quat->R;
+  quat->QuatEKF.pdata.R[8]  = quat->R;
+
+  /* update the kalman filter */
+#if QUATEKF_GENERATED_UPDATE
+  Kalman_QuatESKF_Update(&quat->QuatEKF);
+#else
+  Kalman_Filter_Update(&quat->QuatEKF);
+#endif
+
+  /* inject the error state: q = q ⊗ [1, 0.5f*δθ], biasgyro += δb */
+  q[0] = quat->quat[0] - 0.5f*(quat->quat[1]*quat->QuatEKF.Output[0] + quat->quat[2]*quat->QuatEKF.Output[1] + quat->quat[3]*quat->QuatEKF.Output[2]);
+  q[1] = quat->quat[1] + 0.5f*(quat->quat[0]*quat->QuatEKF.Output[0] + quat->quat[2]*quat->QuatEKF.Output[2] - quat->quat[3]*quat->QuatEKF.Output[1]);
+  q[2] = quat->quat[2] + 0.5f*(quat->quat[0]*quat->QuatEKF.Output[1] - quat->quat[1]*quat->QuatEKF.Output[2] + quat->quat[3]*quat->QuatEKF.Output[0]);
+  q[3] = quat->quat[3] + 0.5f*(quat->quat[0]*quat->QuatEKF.Output[2] + quat->quat[1]*quat->QuatEKF.Output[1] - quat->quat[2]*quat->QuatEKF.Output[0]);
+  Quat_Normalize(quat->quat, q);
+
+  quat->biasgyro[0] += quat->QuatEKF.Output[3];
+  quat->biasgyro[1] += quat->QuatEKF.Output[4];
+  quat->biasgyro[2] += quat->QuatEKF.Output[5];
+
+  /* reset the error state */
+  memset(quat->QuatEKF.pdata.xhat, 0, quat->QuatEKF.sizeof_float * quat->QuatEKF.xhatSize);
+
+  /* stamp the update, the relation matrix and angle are derived on demand */
+  Quat_Output_Update(quat);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Initializes the outputs derived from the quaternion,
+  *         called by the initialization of every attitude filter.
+  * @param  quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval none
+  */
+void Quat_Output_Init(Quat_Info_Typedef *quat)
+{
+  /* Initializes the relation matrix */
+  memset(quat->relation_data, 0, sizeof(quat->relation_data));
+  Matrix_Init(&quat->relation, 3, 3, quat->relation_data);
+
+  /* every output is out of date */
+  quat->version = 1U;
+  memset(quat->output_version, 0, sizeof(quat->output_version));
+
+  /* Initializes the yaw total */
+  quat->last_yaw = 0.f;
+  quat->YawRoundCount = 0;
+  quat->yaw_total = 0.f;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Stamp an update of the quaternion and count the rounds of the yaw,
+  *         called at the end of every update of the attitude filters.
+  * @note   the yaw moves far less than half a turn per update, so no wrap is missed
+  *         however rarely the yaw total is read.
+  * @param  quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval none
+  */
+void Quat_Output_Update(Quat_Info_Typedef *quat)
+{
+  float yaw = 0.f;
+
+  /* every derived output is out of date */
+  quat->version++;
+
+  yaw = Quat_Get_Yaw(quat);
+
+  /* count the rounds when the yaw wraps around */
+  if(yaw - quat->last_yaw < -PI)
+  {
+    quat->YawRoundCount++;
+  }
+  else if(yaw - quat->last_yaw > PI)
+  {
+    quat->YawRoundCount--;
+  }
+  quat->last_yaw = yaw;
+
+  quat->yaw_total = yaw + quat->YawRoundCount * 2.f * PI;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the relation matrix, body frame to earth frame,
+  *         calculated only once per update of the quaternion.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the relation matrix
+  */
+const matrix *Quat_Get_Relation(Quat_Info_Typedef *quat)
+{
+  float *q = quat->quat;
+
+  if(quat->output_version[QUAT_OUTPUT_RELATION] == quat->version)
+  {
+    return &quat->relation;
+  }
 
   /* Update the relation matrix */
-  quat->relation.pData[0] = 1 - 2.f*quat->quat[2]*quat->quat[2] - 2.f*quat->quat[3]*quat->quat[3];
-  quat->relation.pData[1] = 2.f*quat->quat[1]*quat->quat[2] - 2.f*quat->quat[0]*quat->quat[3];
-  quat->relation.pData[2] = 2.f*quat->quat[1]*quat->quat[3] + 2.f*quat->quat[0]*quat->quat[2];
-
-  quat->relation.pData[3] = 2.f*quat->quat[1]*quat->quat[2] + 2.f*quat->quat[0]*quat->quat[3];
-  quat->relation.pData[4] = 1 - 2.f*quat->quat[1]*quat->quat[1] - 2.f*quat->quat[3]*quat->quat[3];
-  quat->relation.pData[5] = 2.f*quat->quat[2]*quat->quat[3] - 2.f*quat->quat[0]*quat->quat[1];
-
-  quat->relation.pData[6] = 2.f*quat->quat[1]*quat->quat[3] - 2.f*quat->quat[0]*quat->quat[2];
-  quat->relation.pData[7] = 2.f*quat->quat[2]*quat->quat[3] + 2.f*quat->quat[0]*quat->quat[1];
-  quat->relation.pData[8] = 1 - 2.f*quat->quat[1]*quat->quat[1] + 2.f*quat->quat[2]*quat->quat[2];
-  
+  quat->relation.pData[0] = 1.f - 2.f*q[2]*q[2] - 2.f*q[3]*q[3];
+  quat->relation.pData[1] = 2.f*q[1]*q[2] - 2.f*q[0]*q[3];
+  quat->relation.pData[2] = 2.f*q[1]*q[3] + 2.f*q[0]*q[2];
+
+  quat->relation.pData[3] = 2.f*q[1]*q[2] + 2.f*q[0]*q[3];
+  quat->relation.pData[4] = 1.f - 2.f*q[1]*q[1] - 2.f*q[3]*q[3];
+  quat->relation.pData[5] = 2.f*q[2]*q[3] - 2.f*q[0]*q[1];
+
+  quat->relation.pData[6] = 2.f*q[1]*q[3] - 2.f*q[0]*q[2];
+  quat->relation.pData[7] = 2.f*q[2]*q[3] + 2.f*q[0]*q[1];
+  quat->relation.pData[8] = 1.f - 2.f*q[1]*q[1] - 2.f*q[2]*q[2];
+
+  quat->output_version[QUAT_OUTPUT_RELATION] = quat->version;
+
+  return &quat->relation;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the yaw in radians without the pitch and roll.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval yaw in [-pi,pi]
+  */
+float Quat_Get_Yaw(Quat_Info_Typedef *quat)
+{
+  float *q = quat->quat;
+
+  if(quat->output_version[QUAT_OUTPUT_YAW] != quat->version)
+  {
+    quat->angle[0] = Fast_Atan2(2.f*(q[0]*q[3] + q[1]*q[2]), 2.f*(q[0]*q[0] + q[1]*q[1])-1.f);
+    quat->output_version[QUAT_OUTPUT_YAW] = quat->version;
+  }
+
+  return quat->angle[0];
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the angle in radians, calculated only once per update of the quaternion.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the yaw, pitch and roll
+  */
+const float *Quat_Get_Angle(Quat_Info_Typedef *quat)
+{
+  float *q = quat->quat;
+
+  if(quat->output_version[QUAT_OUTPUT_ANGLE] == quat->version)
+  {
+    return quat->angle;
+  }
+
 	/* get angle in radians */
-  quat->angle[0] = atan2f(2.f*(quat->quat[0]*quat->quat[3] + quat->quat[1]*quat->quat[2]), 2.f*(quat->quat[0]*quat->quat[0] + quat->quat[1]*quat->quat[1])-1.f);
-  quat->angle[1] = asinf(-2.f*(quat->quat[1]*quat->quat[3] - quat->quat[0]*quat->quat[2]));
-  quat->angle[2] = atan2f(2.f*(quat->quat[0]*quat->quat[1] + quat->quat[2]*quat->quat[3]), 2.f*(quat->quat[0]*quat->quat[0] + quat->quat[3]*quat->quat[3])-1.f);
+  Quat_Get_Yaw(quat);
+  quat->angle[1] = Fast_Asin(-2.f*(q[1]*q[3] - q[0]*q[2]));
+  quat->angle[2] = Fast_Atan2(2.f*(q[0]*q[1] + q[2]*q[3]), 2.f*(q[0]*q[0] + q[3]*q[3])-1.f);
+
+  quat->output_version[QUAT_OUTPUT_ANGLE] = quat->version;
+
+  return quat->angle;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the unit gravity in the body frame, the last row of the relation matrix.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval point to the gravity
+  */
+const float *Quat_Get_Gravity(Quat_Info_Typedef *quat)
+{
+  float *q = quat->quat;
+
+  if(quat->output_version[QUAT_OUTPUT_GRAVITY] == quat->version)
+  {
+    return quat->gravity;
+  }
+
+  quat->gravity[0] = 2.f*q[1]*q[3] - 2.f*q[0]*q[2];
+  quat->gravity[1] = 2.f*q[2]*q[3] + 2.f*q[0]*q[1];
+  quat->gravity[2] = 1.f - 2.f*q[1]*q[1] - 2.f*q[2]*q[2];
+
+  quat->output_version[QUAT_OUTPUT_GRAVITY] = quat->version;
+
+  return quat->gravity;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Get the continuous yaw in radians, the rounds are counted by every update.
+  * @param quat: point to a Quat_Info_Typedef structure that
+  *         contains the informations of quaternion
+  * @retval yaw plus the rounds
+  */
+float Quat_Get_YawTotal(Quat_Info_Typedef *quat)
+{
+  return quat->yaw_total;
 }
 //------------------------------------------------------------------------------
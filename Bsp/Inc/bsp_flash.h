@@ -0,0 +1,62 @@
+#ifndef __BSP_FLASH_H
+#define __BSP_FLASH_H
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * @file           : bsp_flash.h
+  * @brief          : Prototypes of the records stored in the internal flash.
+  * 
+  ******************************************************************************
+  * @attention      : none
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stdint.h"
+#include "stdbool.h"
+
+/* Exported defines -----------------------------------------------------------*/
+/**
+ * @brief sector reserved for the records, excluded from IROM1 of the project,
+ *        sector 11: 0x080E0000 ~ 0x080FFFFF
+ */
+#define FLASH_USER_SECTOR   FLASH_SECTOR_11
+#define FLASH_USER_ADDRESS  0x080E0000U
+#define FLASH_USER_SIZE     0x00020000U
+
+/* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  calculate the CRC-32 of the words, same as the CRC-32 of the little-endian bytes
+  * @param  data: point to the words
+  * @param  num: number of the words
+  * @retval CRC-32
+  */
+extern uint32_t Flash_CRC32(const uint32_t *data,uint32_t num);
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  read the latest record with a valid CRC in the user sector
+  * @param  record: point to the words of the record
+  * @param  num: number of the words, same as the written record
+  * @retval true if a valid record is found
+  */
+extern bool Flash_Record_Read(uint32_t *record,uint32_t num);
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  append a record and its CRC after the last record of the user sector
+  * @note   the first word of the record must not be 0xFFFFFFFF,
+  *         the sector is erased only when it is full, stalls the core for about 1s
+  * @param  record: point to the words of the record
+  * @param  num: number of the words
+  * @retval true if the record is written and verified
+  */
+extern bool Flash_Record_Write(const uint32_t *record,uint32_t num);
+//------------------------------------------------------------------------------
+
+#endif
@@ -37,4 +37,35 @@ extern void Delay_us(uint32_t us);
 extern void Delay_ms(uint32_t ms);
 //------------------------------------------------------------------------------
 
+/**
+  * @brief  enable the DWT cycle counter as the monotonic timestamp
+  * @retval none
+  */
+extern void Timestamp_Init(void);
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the timestamp in core clock cycles, wraps every 2^32 cycles
+  * @retval DWT cycle counter
+  */
+extern uint32_t Timestamp_Get(void);
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the time since the last timestamp and update it
+  * @param  last: point to the last timestamp
+  * @retval elapsed time in seconds, valid below 2^32 cycles
+  */
+extern float Timestamp_Get_DeltaT(uint32_t *last);
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the time from the last timestamp to a later timestamp and update it
+  * @param  last: point to the last timestamp
+  * @param  now: the later timestamp
+  * @retval elapsed time in seconds, valid below 2^32 cycles
+  */
+extern float Timestamp_Get_Interval(uint32_t *last,uint32_t now);
+//------------------------------------------------------------------------------
+
 #endif
\ No newline at end of file
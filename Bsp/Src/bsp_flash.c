@@ -0,0 +1,171 @@
+/* USER CODE BEGIN Header */
+/**
+  ******************************************************************************
+  * File Name          : bsp_flash.c
+  * Description        : Implementation of the records stored in the internal flash.
+  ******************************************************************************
+  * @attention      : the records are appended to the user sector,
+  *                   every slot is the record and its CRC-32.
+  *
+  * Copyright 2024 COD USTL.
+  * All rights reserved.
+  *
+  ******************************************************************************
+  */
+/* USER CODE END Header */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bsp_flash.h"
+#include "stm32f4xx_hal.h"
+#include "string.h"
+
+/* Private function prototypes -----------------------------------------------*/
+/**
+  * @brief  check the slot is never programmed
+  * @param  slot: point to the slot
+  * @param  num: number of the words of the slot
+  * @retval true if all the words are erased
+  */
+static bool Flash_Slot_Blank(const uint32_t *slot,uint32_t num)
+{
+  for(uint32_t i = 0; i < num; i++)
+  {
+    if(slot[i] != 0xFFFFFFFFU)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  calculate the CRC-32 of the words, same as the CRC-32 of the little-endian bytes
+  * @param  data: point to the words
+  * @param  num: number of the words
+  * @retval CRC-32
+  */
+uint32_t Flash_CRC32(const uint32_t *data,uint32_t num)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+
+  for(uint32_t i = 0; i < num; i++)
+  {
+    crc ^= data[i];
+
+    /* reflected polynomial 0x04C11DB7, least significant bit first */
+    for(uint8_t bit = 0; bit < 32; bit++)
+    {
+      crc = (crc & 1U) ? ((crc >> 1) ^ 0xEDB88320U) : (crc >> 1);
+    }
+  }
+
+  return ~crc;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  read the latest record with a valid CRC in the user sector
+  * @param  record: point to the words of the record
+  * @param  num: number of the words, same as the written record
+  * @retval true if a valid record is found
+  */
+bool Flash_Record_Read(uint32_t *record,uint32_t num)
+{
+  const uint32_t *slot = (const uint32_t *)FLASH_USER_ADDRESS;
+  const uint32_t *latest = NULL;
+  uint32_t slot_num = FLASH_USER_SIZE / ((num + 1U) * 4U);
+
+  /* the records end at the first blank slot */
+  for(uint32_t i = 0; i < slot_num; i++, slot += num + 1U)
+  {
+    if(slot[0] == 0xFFFFFFFFU)
+    {
+      break;
+    }
+    if(Flash_CRC32(slot,num) == slot[num])
+    {
+      latest = slot;
+    }
+  }
+
+  if(latest == NULL)
+  {
+    return false;
+  }
+
+  memcpy(record,latest,num * 4U);
+
+  return true;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  append a record and its CRC after the last record of the user sector
+  * @note   the first word of the record must not be 0xFFFFFFFF,
+  *         the sector is erased only when it is full, stalls the core for about 1s
+  * @param  record: point to the words of the record
+  * @param  num: number of the words
+  * @retval true if the record is written and verified
+  */
+bool Flash_Record_Write(const uint32_t *record,uint32_t num)
+{
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t sector_error = 0;
+  uint32_t slot_num = FLASH_USER_SIZE / ((num + 1U) * 4U);
+  uint32_t *slot = (uint32_t *)FLASH_USER_ADDRESS;
+  uint32_t i = 0;
+  bool status = true;
+
+  if(record[0] == 0xFFFFFFFFU || slot_num == 0U)
+  {
+    return false;
+  }
+
+  /* find the first blank slot */
+  for(i = 0; i < slot_num; i++, slot += num + 1U)
+  {
+    if(Flash_Slot_Blank(slot,num + 1U) == true)
+    {
+      break;
+    }
+  }
+
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                         FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+
+  /* the sector is full, erase it and start again */
+  if(i == slot_num)
+  {
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = FLASH_USER_SECTOR;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    if(HAL_FLASHEx_Erase(&erase,&sector_error) != HAL_OK)
+    {
+      status = false;
+    }
+    slot = (uint32_t *)FLASH_USER_ADDRESS;
+  }
+
+  /* program the record, then its CRC */
+  for(i = 0; i < num && status == true; i++)
+  {
+    if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD,(uint32_t)&slot[i],record[i]) != HAL_OK)
+    {
+      status = false;
+    }
+  }
+  if(status == true && HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD,(uint32_t)&slot[num],Flash_CRC32(record,num)) != HAL_OK)
+  {
+    status = false;
+  }
+
+  HAL_FLASH_Lock();
+
+  /* verify the slot */
+  return (status == true && memcmp(slot,record,num * 4U) == 0 && Flash_CRC32(slot,num) == slot[num]);
+}
+//------------------------------------------------------------------------------
@@ -76,3 +76,53 @@ void Delay_ms(uint32_t ms)
   while((HAL_GetTick()-now) < ms);
 }
 //------------------------------------------------------------------------------
+
+/**
+  * @brief  enable the DWT cycle counter as the monotonic timestamp
+  * @retval none
+  */
+void Timestamp_Init(void)
+{
+  /* enable the DWT cycle counter */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the timestamp in core clock cycles, wraps every 2^32 cycles
+  * @retval DWT cycle counter
+  */
+uint32_t Timestamp_Get(void)
+{
+  return DWT->CYCCNT;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the time since the last timestamp and update it
+  * @param  last: point to the last timestamp
+  * @retval elapsed time in seconds, valid below 2^32 cycles
+  */
+float Timestamp_Get_DeltaT(uint32_t *last)
+{
+  return Timestamp_Get_Interval(last,DWT->CYCCNT);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  get the time from the last timestamp to a later timestamp and update it
+  * @param  last: point to the last timestamp
+  * @param  now: the later timestamp
+  * @retval elapsed time in seconds, valid below 2^32 cycles
+  */
+float Timestamp_Get_Interval(uint32_t *last,uint32_t now)
+{
+  /* the unsigned difference is right across the wrap of the counter */
+  uint32_t cycles = now - *last;
+
+  *last = now;
+
+  return (float)cycles / (float)SystemCoreClock;
+}
+//------------------------------------------------------------------------------
@@ -29,7 +29,6 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "bsp_tim.h"
-#include "bmi088.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -102,7 +101,6 @@ int main(void)
   MX_CAN2_Init();
   /* USER CODE BEGIN 2 */
 	BSP_PWM_Init();
-	BMI088_Init();
   /* USER CODE END 2 */
 
   /* Call init function for freertos objects (in freertos.c) */
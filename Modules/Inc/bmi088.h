@@ -17,16 +17,116 @@
 #include "stdint.h"
 #include "stdbool.h"
 #include "bmi088_reg.h"
+#include "cmsis_os.h"
 
 /* Exported defines -----------------------------------------------------------*/
 #define BMI088_USE_SPI 
 #define IMU_Calibration_ENABLE 1
 
+/**
+ * @brief acquire the samples by the data ready interrupts and the SPI1 DMA,
+ *        0: poll the sensor in BMI088_Info_Update()
+ */
+#ifndef BMI088_USE_DMA
+#define BMI088_USE_DMA 1
+#endif
+
+/**
+ * @brief drain the on-chip FIFOs once per gyro watermark instead of every sample,
+ *        requires BMI088_USE_DMA
+ */
+#ifndef BMI088_USE_FIFO
+#define BMI088_USE_FIFO 0
+#endif
+
+#if BMI088_USE_FIFO && !BMI088_USE_DMA
+#error "BMI088_USE_FIFO requires BMI088_USE_DMA"
+#endif
+
+/**
+ * @brief output data rate of the gyro, BMI088_GYRO_2000_230_HZ
+ */
+#define BMI088_GYRO_ODR 2000.f
+
+/**
+ * @brief frames per batch of the FIFO,
+ *        gyro: watermark level, 4 ms at 2 kHz, a late batch holds up to
+ *              BMI088_FIFO_GYRO_FRAME_MAX frames, the rest is drained by the next batch
+ *        accel: 3.2 frames at 800 Hz per watermark, the rest stays in the FIFO
+ */
+#define BMI088_FIFO_GYRO_WATERMARK 8U
+#define BMI088_FIFO_GYRO_FRAME_MAX (2U*BMI088_FIFO_GYRO_WATERMARK)
+#define BMI088_FIFO_ACCEL_FRAME_MAX 6U
+
+/**
+ * @brief read rates of the channels,
+ *        gyro, accel: data ready samples per read, not used by the FIFO batching
+ *        temperature: ms per read, the sensor updates it every 1.28 s
+ *        health: ms per check of the chip ids
+ */
+#define BMI088_READ_GYRO_DIV      1U
+#define BMI088_READ_ACCEL_DIV     1U
+#define BMI088_READ_TEMP_PERIOD   320U
+#define BMI088_READ_HEALTH_PERIOD 100U
+
+/**
+ * @brief ms per update of the SPI bytes per second
+ */
+#define BMI088_READ_RATE_PERIOD   1000U
+
+/**
+ * @brief SPI bytes of a read of n registers, address byte included,
+ *        the accelerator returns a dummy byte first
+ */
+#define BMI088_ACCEL_READ_LEN(n) (2U + (n))
+#define BMI088_GYRO_READ_LEN(n)  (1U + (n))
+
+/**
+ * @brief length of the DMA bursts,
+ *        accel: 0x12 ~ 0x17 (data) or accel frames and a sensor time frame of the FIFO
+ *        gyro: 0x02 ~ 0x07 (data) or the frames of the FIFO, up to BMI088_FIFO_GYRO_FRAME_MAX
+ *        temperature: 0x22 ~ 0x23
+ */
+#if BMI088_USE_FIFO
+#define BMI088_ACCEL_DMA_LEN BMI088_ACCEL_READ_LEN(7U*BMI088_FIFO_ACCEL_FRAME_MAX + 4U)
+#define BMI088_GYRO_DMA_LEN  BMI088_GYRO_READ_LEN(6U*BMI088_FIFO_GYRO_FRAME_MAX)
+#else
+#define BMI088_ACCEL_DMA_LEN BMI088_ACCEL_READ_LEN(6U)
+#define BMI088_GYRO_DMA_LEN  BMI088_GYRO_READ_LEN(6U)
+#endif
+#define BMI088_TEMP_DMA_LEN  BMI088_ACCEL_READ_LEN(2U)
+
+/**
+ * @brief background calibration of the gyro offsets over windows of still samples,
+ *        the offsets are stored in the flash with the temperature
+ */
+#define BMI088_CALI_SAMPLES     1000U   /*!< still samples per window */
+#define BMI088_CALI_GRAVITY     9.8035f /*!< m/s^2 */
+#define BMI088_CALI_ACCEL_STILL 0.5f    /*!< m/s^2, deviation of the accel norm from gravity */
+#define BMI088_CALI_GYRO_STILL  0.05f   /*!< rad/s, per sample, change from the first sample of the window */
+#define BMI088_CALI_GYRO_NOISE  0.01f   /*!< rad/s, standard deviation of the window */
+#define BMI088_CALI_OFFSET_MAX  0.05f   /*!< rad/s, zero-rate offset, about 3 times the 1 dps of the datasheet */
+#define BMI088_CALI_DRIFT_MAX   0.01f   /*!< rad/s, change of the offsets from the last accepted window */
+#define BMI088_CALI_DRIFT_WINDOWS 4U    /*!< consecutive still windows agreeing on a larger change to accept it */
+#define BMI088_CALI_SAVE_OFFSET 0.002f  /*!< rad/s, store the offsets away from the flash record */
+#define BMI088_CALI_SAVE_TEMP   5.f     /*!< degrees, store the offsets away from the flash record */
+
+/**
+ * @brief flash record of the offsets: magic, offsets, temperature
+ */
+#define BMI088_CALI_MAGIC       0xB0880001U
+#define BMI088_CALI_RECORD_NUM  5U
+
 #define BMI088_TEMP_FACTOR 0.125f
 #define BMI088_TEMP_OFFSET 23.0f
 
+#if BMI088_USE_FIFO
+#define BMI088_WRITE_ACCEL_REG_NUM 8
+#define BMI088_WRITE_GYRO_REG_NUM 9
+#else
 #define BMI088_WRITE_ACCEL_REG_NUM 6
 #define BMI088_WRITE_GYRO_REG_NUM 6
+#endif
 
 #define BMI088_GYRO_DATA_READY_BIT 0
 #define BMI088_ACCEL_DATA_READY_BIT 1
@@ -35,6 +135,11 @@
 #define BMI088_LONG_DELAY_TIME 80
 #define BMI088_COM_WAIT_SENSOR_TIME 150
 
+/**
+ * @brief attempts of the initialization before BMI088_INIT_FAILED
+ */
+#define BMI088_INIT_ATTEMPT_MAX 5U
+
 #define BMI088_ACCEL_IIC_ADDRESSE (0x18 << 1)
 #define BMI088_GYRO_IIC_ADDRESSE (0x68 << 1)
 
@@ -80,12 +185,40 @@ typedef enum
   BMI088_GYRO_CTRL_ERROR              = 0x0B,
   BMI088_GYRO_INT3_INT4_IO_CONF_ERROR = 0x0C,
   BMI088_GYRO_INT3_INT4_IO_MAP_ERROR  = 0x0D,
+  BMI088_ACC_FIFO_CONFIG_ERROR        = 0x0E,
+  BMI088_GYRO_FIFO_CONFIG_ERROR       = 0x0F,
 
   BMI088_SELF_TEST_ACCEL_ERROR        = 0x80,
   BMI088_SELF_TEST_GYRO_ERROR         = 0x40,
   BMI088_NO_SENSOR                    = 0xFF,
 }BMI088_Status_e;
 
+/**
+ * @brief enum state of the BMI088 initialization.
+ */
+typedef enum
+{
+  BMI088_INIT_RESET = 0U,  /*!< start an attempt, software reset both sensors */
+  BMI088_INIT_WAIT_RESET,  /*!< wait both resets at once */
+  BMI088_INIT_CHECK_ID,    /*!< check the chip ids */
+  BMI088_INIT_CONFIG,      /*!< write and verify the registers */
+  BMI088_INIT_DONE,        /*!< configured */
+  BMI088_INIT_FAILED,      /*!< BMI088_INIT_ATTEMPT_MAX attempts failed */
+}BMI088_Init_State_e;
+
+/**
+ * @brief structure that contains the informations of the initialization.
+ */
+typedef struct
+{
+  BMI088_Init_State_e state; /*!< state of the initialization */
+  BMI088_Status_e status;    /*!< error of the last attempt */
+  uint8_t attempt;           /*!< attempts started */
+  uint8_t accel_index;       /*!< accelerator register to write */
+  uint8_t gyro_index;        /*!< gyro register to write */
+  uint32_t tick;             /*!< start of the reset wait */
+}BMI088_Init_Typedef;
+
 /**
  * @brief structure that contains the informations of received values.
  */
@@ -102,12 +235,58 @@ typedef struct
 	volatile int16_t temperature; /*!< temperature value */
 }MPU_Info_Typedef;
 
+/**
+ * @brief structure that contains the informations of the background calibration.
+ */
+typedef struct
+{
+  uint32_t count;       /*!< still samples of the window */
+  float ref[3];         /*!< first gyro sample of the window, reference of the stillness */
+  float sum[3];         /*!< sum of the gyro, offsets removed */
+  float sum_sq[3];      /*!< sum of the gyro squares, offsets removed */
+  uint32_t windows;     /*!< windows accepted */
+  uint32_t rejected;    /*!< windows rejected by the noise or the drift */
+  uint32_t drift_count; /*!< consecutive windows away from the offsets by the same change */
+  float drift_mean[3];  /*!< change of the first of them */
+
+  bool flash_valid;     /*!< record loaded from the flash */
+  bool flash_saved;     /*!< offsets stored since the boot */
+  volatile bool save_pending; /*!< offsets waiting for BMI088_Offset_Store() */
+  float flash_offset[3];   /*!< offsets of the flash record */
+  float flash_temperature; /*!< temperature of the flash record */
+}BMI088_Cali_Typedef;
+
+/**
+ * @brief structure that contains the informations of the read schedule.
+ */
+typedef struct
+{
+  uint16_t gyro_skip;      /*!< gyro samples since the last read */
+  uint16_t accel_skip;     /*!< accelerator samples since the last read */
+  uint32_t temp_tick;      /*!< tick of the last temperature read */
+  uint32_t health_tick;    /*!< tick of the last health check */
+
+  volatile bool health_ok;        /*!< chip ids matched at the last check */
+  volatile uint32_t health_error; /*!< checks with a wrong chip id */
+
+  volatile uint32_t spi_bytes;      /*!< SPI bytes of the scheduled reads */
+  volatile uint32_t spi_bytes_full; /*!< SPI bytes of the same samples with every channel read every cycle */
+  uint32_t rate_tick;               /*!< tick of the last bytes per second */
+  uint32_t rate_bytes;              /*!< spi_bytes at rate_tick */
+  uint32_t rate_bytes_full;         /*!< spi_bytes_full at rate_tick */
+  uint32_t bytes_per_second;        /*!< SPI bytes per second of the scheduled reads */
+  uint32_t bytes_per_second_full;   /*!< SPI bytes per second with every channel read every cycle */
+}BMI088_Read_Typedef;
+
 /**
  * @brief structure that contains the informations of the BMI088.
  */
 typedef struct
 {
-  bool offsets_init;    /*!< Initialize the offset value */
+  BMI088_Init_Typedef init; /*!< initialization */
+  bool offsets_init;    /*!< offsets loaded from the flash or calibrated */
+  bool accel_ready;     /*!< fresh accelerator data in the last update */
+  volatile bool accel_update; /*!< accelerator data received by the DMA */
 
   float accel[3];       /*!< accelerator data */
   float gyro[3];        /*!< velocity data */
@@ -118,15 +297,38 @@ typedef struct
   float offset_gyrox;   /*!< offset of x-axis velocity */
   float offset_gyroy;   /*!< offset of y-axis velocity */
   float offset_gyroz;   /*!< offset of z-axis velocity */
+  float offset_temperature; /*!< temperature of the offsets */
+  BMI088_Cali_Typedef cali; /*!< background calibration */
+  BMI088_Read_Typedef read; /*!< read schedule of the channels */
+
+  volatile uint32_t accel_count; /*!< accelerator samples received by the DMA */
+  volatile uint32_t gyro_count;  /*!< gyro samples received by the DMA */
+  volatile uint32_t dma_error;   /*!< DMA bursts failed to start or complete */
+  volatile uint32_t fifo_overrun; /*!< batches overwritten before BMI088_FIFO_Batch_Get(), or overruns of the gyro FIFO */
 }BMI088_Info_Typedef;
 
+/**
+ * @brief structure that contains a batch of samples drained from the FIFOs.
+ */
+typedef struct
+{
+  uint32_t timestamp;  /*!< DWT timestamp of the last gyro frame */
+  float gyro_dt;       /*!< period of the gyro frames */
+  uint8_t gyro_num;    /*!< gyro frames, oldest first */
+  uint8_t accel_num;   /*!< accelerator frames, oldest first */
+  float gyro[BMI088_FIFO_GYRO_FRAME_MAX][3];   /*!< velocity data, offsets removed */
+  float accel[BMI088_FIFO_ACCEL_FRAME_MAX][3]; /*!< accelerator data */
+}BMI088_FIFO_Batch_Typedef;
+
 /* Exported functions prototypes ---------------------------------------------*/
 /**
- * 
-  * @brief Initializes the BMI088.
-  * @param None
+  * @brief Step the initialization of the BMI088, call it every tick under the scheduler
+  *        until BMI088_INIT_DONE or BMI088_INIT_FAILED.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval state of the initialization
   */
-extern void BMI088_Init(void);
+extern BMI088_Init_State_e BMI088_Init_Update(BMI088_Info_Typedef *BMI088_Info);
 
 /**
   * @brief Update the BMI088 Informations.
@@ -136,4 +338,57 @@ extern void BMI088_Init(void);
   */
 extern void BMI088_Info_Update(BMI088_Info_Typedef *BMI088_Info);
 
+/**
+  * @brief Load the offsets from the flash, then calibrated in the background
+  *        by BMI088_Info_Update() while the sensor is still.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval None
+  */
+extern void BMI088_Offset_Init(BMI088_Info_Typedef *BMI088_Info);
+
+/**
+  * @brief Store the offsets in the flash once the background calibration requests it.
+  * @note  the sector may be erased, which stalls the core and the interrupts for about 1s,
+  *        call it outside the sensor path while the actuators are disarmed,
+  *        the request stays pending after a failed write.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval true if the offsets are written
+  */
+extern bool BMI088_Offset_Store(BMI088_Info_Typedef *BMI088_Info);
+
+#if BMI088_USE_DMA
+/**
+  * @brief Start the acquisition by the data ready interrupts.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the samples of the DMA.
+  * @param thread_id: thread notified once a gyro sample is in memory.
+  * @retval None
+  */
+extern void BMI088_Acquire_Start(BMI088_Info_Typedef *BMI088_Info,osThreadId thread_id);
+
+/**
+  * @brief Queue the temperature and the health check once due without the data ready interrupts,
+  *        call it when no sample arrives in time, a dead sensor is found by the health check.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the samples of the DMA.
+  * @retval None
+  */
+extern void BMI088_Read_Schedule(BMI088_Info_Typedef *BMI088_Info);
+#endif
+
+#if BMI088_USE_FIFO
+/**
+  * @brief Get the latest batch drained from the FIFOs,
+  *        the last frames are stored in the BMI088 Informations as well.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @param batch: pointer to BMI088_FIFO_Batch_Typedef structure that
+  *         receives the samples.
+  * @retval true if a new batch is received since the last call
+  */
+extern bool BMI088_FIFO_Batch_Get(BMI088_Info_Typedef *BMI088_Info,BMI088_FIFO_Batch_Typedef *batch);
+#endif
+
 #endif
\ No newline at end of file
@@ -112,6 +112,33 @@
 #define BMI088_ACC_INT1_DRDY_INTERRUPT_SHFITS 0x2
 #define BMI088_ACC_INT1_DRDY_INTERRUPT (0x1 << BMI088_ACC_INT1_DRDY_INTERRUPT_SHFITS)  /*!< mapped to INT1 */
 
+#define BMI088_ACC_INT1_FWM_INTERRUPT_SHFITS 0x1
+#define BMI088_ACC_INT1_FWM_INTERRUPT (0x1 << BMI088_ACC_INT1_FWM_INTERRUPT_SHFITS)  /*!< FIFO watermark mapped to INT1 */
+
+/**
+ * @brief accelerator FIFO, header and 6 bytes per accelerator frame.
+ */
+#define BMI088_ACC_FIFO_LENGTH_0 0x24  /*!< fill level in bytes, 14 bits */
+#define BMI088_ACC_FIFO_LENGTH_1 0x25
+#define BMI088_ACC_FIFO_DATA 0x26      /*!< burst read the frames */
+
+#define BMI088_ACC_FIFO_CONFIG_0 0x48
+#define BMI088_ACC_FIFO_MODE_MUST_Set 0x02
+#define BMI088_ACC_FIFO_STREAM_MODE (0x0 | BMI088_ACC_FIFO_MODE_MUST_Set)  /*!< overwrite the oldest frames */
+#define BMI088_ACC_FIFO_FIFO_MODE (0x1 | BMI088_ACC_FIFO_MODE_MUST_Set)    /*!< stop when full */
+
+#define BMI088_ACC_FIFO_CONFIG_1 0x49
+#define BMI088_ACC_FIFO_CONFIG_1_MUST_Set 0x10
+#define BMI088_ACC_FIFO_ACC_EN (0x40 | BMI088_ACC_FIFO_CONFIG_1_MUST_Set)  /*!< store the accelerator data */
+
+#define BMI088_ACC_FIFO_HEADER_MASK 0xFC
+#define BMI088_ACC_FIFO_HEADER_ACCEL 0x84   /*!< 6 bytes of data */
+#define BMI088_ACC_FIFO_HEADER_SKIP 0x40    /*!< 1 byte, frames skipped */
+#define BMI088_ACC_FIFO_HEADER_TIME 0x44    /*!< 3 bytes of sensor time */
+#define BMI088_ACC_FIFO_HEADER_CONFIG 0x48  /*!< 1 byte, configuration changed */
+#define BMI088_ACC_FIFO_HEADER_DROP 0x50    /*!< 1 byte, frame dropped */
+#define BMI088_ACC_FIFO_HEADER_EMPTY 0x80   /*!< read beyond the fill level */
+
 #define BMI088_ACC_SELF_TEST 0x6D
 #define BMI088_ACC_SELF_TEST_OFF 0x00
 #define BMI088_ACC_SELF_TEST_POSITIVE_SIGNAL 0x0D
@@ -201,6 +228,28 @@
 #define BMI088_GYRO_DRDY_IO_INT4 0x80  /*!< mapping to INT4 */
 #define BMI088_GYRO_DRDY_IO_BOTH (BMI088_GYRO_DRDY_IO_INT3 | BMI088_GYRO_DRDY_IO_INT4)   /*!< mapping to INT3 and INT4 */
 
+#define BMI088_GYRO_FIFO_IO_INT3 0x04  /*!< FIFO interrupt mapping to INT3 */
+
+#define BMI088_GYRO_INT_FIFO_ON 0x40   /*!< Allow the FIFO to trigger the interrupt, BMI088_GYRO_CTRL */
+
+/**
+ * @brief gyro FIFO, 6 bytes per frame without header.
+ */
+#define BMI088_GYRO_FIFO_STATUS 0x0E   /*!< frame count and overrun */
+#define BMI088_GYRO_FIFO_FRAME_COUNT_MASK 0x7F
+#define BMI088_GYRO_FIFO_OVERRUN 0x80
+
+#define BMI088_GYRO_FIFO_WM_ENABLE 0x1E  /*!< watermark interrupt */
+#define BMI088_GYRO_FIFO_WM_ON 0x88
+#define BMI088_GYRO_FIFO_WM_OFF 0x08
+
+#define BMI088_GYRO_FIFO_CONFIG_0 0x3D   /*!< watermark level in frames */
+#define BMI088_GYRO_FIFO_CONFIG_1 0x3E
+#define BMI088_GYRO_FIFO_FIFO_MODE 0x40    /*!< stop when full */
+#define BMI088_GYRO_FIFO_STREAM_MODE 0x80  /*!< overwrite the oldest frames */
+
+#define BMI088_GYRO_FIFO_DATA 0x3F   /*!< burst read the frames */
+
 #define BMI088_GYRO_SELF_TEST 0x3C
 #define BMI088_GYRO_RATE_OK_SHFITS 0x4
 #define BMI088_GYRO_RATE_OK (0x1 << BMI088_GYRO_RATE_OK_SHFITS)
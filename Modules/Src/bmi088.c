@@ -20,8 +20,11 @@
 #include "bmi088.h"
 #include "bsp_timebase.h"
 #include "bsp_tim.h"
+#include "bsp_flash.h"
 #include "spi.h"
 #include "main.h"
+#include "string.h"
+#include "math.h"
 
 /* Private function ----------------------------------------------------------*/
 /**
@@ -262,8 +265,17 @@ static uint8_t Accel_Register_ConfigInfo[BMI088_WRITE_ACCEL_REG_NUM][3] =
   /* INT1 Configuration input and output pin */ 
   {BMI088_INT1_IO_CTRL, (BMI088_ACC_INT1_IO_ENABLE | BMI088_ACC_INT1_GPIO_PP | BMI088_ACC_INT1_GPIO_LOW), BMI088_INT1_IO_CTRL_ERROR}, 
 
+#if BMI088_USE_FIFO
+  /* no interrupt, the FIFO is drained by the gyro watermark */
+  {BMI088_INT_MAP_DATA, 0x00, BMI088_INT_MAP_DATA_ERROR},
+
+  /* FIFO in stream mode, store the accelerator data */
+  {BMI088_ACC_FIFO_CONFIG_0, BMI088_ACC_FIFO_STREAM_MODE, BMI088_ACC_FIFO_CONFIG_ERROR},
+  {BMI088_ACC_FIFO_CONFIG_1, BMI088_ACC_FIFO_ACC_EN, BMI088_ACC_FIFO_CONFIG_ERROR}
+#else
   /* interrupt map pin */
   {BMI088_INT_MAP_DATA, BMI088_ACC_INT1_DRDY_INTERRUPT, BMI088_INT_MAP_DATA_ERROR}  
+#endif
 };
 
 /**
@@ -280,54 +292,53 @@ static uint8_t Gyro_Register_ConfigInfo[BMI088_WRITE_GYRO_REG_NUM][3] =
   /* Power Mode */
   {BMI088_GYRO_LPM1, BMI088_GYRO_NORMAL_MODE, BMI088_GYRO_LPM1_ERROR},   
 
+#if BMI088_USE_FIFO
+  /* FIFO Interrupt Trigger */
+  {BMI088_GYRO_CTRL, BMI088_GYRO_INT_FIFO_ON, BMI088_GYRO_CTRL_ERROR},
+#else
   /* Data Interrupt Trigger */
   {BMI088_GYRO_CTRL, BMI088_DRDY_ON, BMI088_GYRO_CTRL_ERROR},   
+#endif
 
   /* Interrupt Pin Trigger */
   {BMI088_GYRO_INT3_INT4_IO_CONF, (BMI088_GYRO_INT3_GPIO_PP | BMI088_GYRO_INT3_GPIO_LOW), BMI088_GYRO_INT3_INT4_IO_CONF_ERROR},  
 
+#if BMI088_USE_FIFO
+  /* FIFO interrupt map */
+  {BMI088_GYRO_INT3_INT4_IO_MAP, BMI088_GYRO_FIFO_IO_INT3, BMI088_GYRO_INT3_INT4_IO_MAP_ERROR},
+
+  /* FIFO in stream mode, interrupt at the watermark */
+  {BMI088_GYRO_FIFO_WM_ENABLE, BMI088_GYRO_FIFO_WM_ON, BMI088_GYRO_FIFO_CONFIG_ERROR},
+  {BMI088_GYRO_FIFO_CONFIG_0, BMI088_FIFO_GYRO_WATERMARK, BMI088_GYRO_FIFO_CONFIG_ERROR},
+  {BMI088_GYRO_FIFO_CONFIG_1, BMI088_GYRO_FIFO_STREAM_MODE, BMI088_GYRO_FIFO_CONFIG_ERROR}
+#else
   /* interrupt map */
   {BMI088_GYRO_INT3_INT4_IO_MAP, BMI088_GYRO_DRDY_IO_INT3, BMI088_GYRO_INT3_INT4_IO_MAP_ERROR}   
+#endif
 };
 
 /**
-  * @brief Initializes the accelerator of bmi088.
-  * @param None
-  * @retval None
+  * @brief Verify the accelerator register written in the last step, then write the next one.
+  * @param index: index of Accel_Register_ConfigInfo to write
+  * @retval BMI088_NO_ERROR, or the error of the register written in the last step
   */
-
-static BMI088_Status_e BMI088_Accel_Init(void)
+static BMI088_Status_e BMI088_Accel_Config_Step(uint8_t index)
 {
   uint8_t res = 0;
 
-  /* read the accelerator ID */
-  BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
-  /* delay 150us */
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-  /* read again */
-  BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
-  /* delay 150us */
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-  /* software reset */
-  BMI088_Accel_Write_Single_Reg(BMI088_ACC_SOFTRESET, BMI088_ACC_SOFTRESET_VALUE); 
-  /* delay 80ms */
-  Delay_ms(BMI088_LONG_DELAY_TIME);
-
-  /* read the accelerator ID again ------------------------------------------------*/
-  BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-  BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-  /* check software reset */
-  if (res != BMI088_ACC_CHIP_ID_VALUE)
+  if(index > 0)
   {
-      return BMI088_NO_SENSOR;
+    /* read the configuration */
+    BMI088_Accel_Read_Single_Reg(Accel_Register_ConfigInfo[index-1][0], res);
+
+    /* check the configuration */
+    if (res != Accel_Register_ConfigInfo[index-1][1])
+    {
+        return (BMI088_Status_e)Accel_Register_ConfigInfo[index-1][2];
+    }
   }
 
-  /* config the accelerator */
-  for (uint8_t write_reg_num = 0; write_reg_num < BMI088_WRITE_ACCEL_REG_NUM; write_reg_num++)
+  if(index < BMI088_WRITE_ACCEL_REG_NUM)
   {
     /* Write the configuration values in the internal configuration register: */
     /*!< [0][0]  BMI088_ACC_PWR_CTRL 0x7D                accelerator address */
@@ -336,113 +347,86 @@ static BMI088_Status_e BMI088_Accel_Init(void)
     /*!< [1][1]  BMI088_ACC_PWR_ACTIVE_MODE 0x00         power start  */
     /*!< [2][0]  BMI088_ACC_CONF 0x40                    config address */
     /*!< [2][1]  BMI088_ACC_CONF_DATA 0xAB               BMI088_ACC_NORMAL (0x2 << BMI088_ACC_BWP_SHFITS): normal sampling frequency  */
-    /*!<                                                 | BMI088_ACC_800_HZ (0xB << BMI088_ACC_ODR_SHFITS): 800hz output frequency */  
+    /*!<                                                 | BMI088_ACC_800_HZ (0xB << BMI088_ACC_ODR_SHFITS): 800hz output frequency */
     /*!<                                                 | BMI088_ACC_CONF_MUST_Set 0x80 */
     /*!< [3][0]  BMI088_ACC_RANGE 0x41                   scoping register address */
     /*!< [3][1]  BMI088_ACC_RANGE_3G (0x0 << BMI088_ACC_RANGE_SHFITS)   +-3g */
     /*!< [4][0]  BMI088_INT1_IO_CTRL 0x53                INT1 configure address */
-    /*!< [4][1]  BMI088_INT1_IO_CTRL_DATA 0x8            BMI088_ACC_INT1_IO_ENABLE (0x1 << BMI088_ACC_INT1_IO_ENABLE_SHFITS): configure INT1 as output pins */ 
-    /*!<                                                 | BMI088_ACC_INT1_GPIO_PP (0x0 << BMI088_ACC_INT1_GPIO_MODE_SHFITS): push-pull output */  
+    /*!< [4][1]  BMI088_INT1_IO_CTRL_DATA 0x8            BMI088_ACC_INT1_IO_ENABLE (0x1 << BMI088_ACC_INT1_IO_ENABLE_SHFITS): configure INT1 as output pins */
+    /*!<                                                 | BMI088_ACC_INT1_GPIO_PP (0x0 << BMI088_ACC_INT1_GPIO_MODE_SHFITS): push-pull output */
     /*!<                                                 | BMI088_ACC_INT1_GPIO_LOW (0x0 << BMI088_ACC_INT1_GPIO_LVL_SHFITS): pull down */
     /*!< [5][0]  BMI088_INT_MAP_DATA 0x58                interrupts mapping address */
     /*!< [5][1]  BMI088_ACC_INT1_DRDY_INTERRUPT (0x1 << BMI088_ACC_INT1_DRDY_INTERRUPT_SHFITS)  interrupts are mapped to INT1 */
-    BMI088_Accel_Write_Single_Reg(Accel_Register_ConfigInfo[write_reg_num][0], Accel_Register_ConfigInfo[write_reg_num][1]); 
-    /* delay 150us */
-    Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
+    BMI088_Accel_Write_Single_Reg(Accel_Register_ConfigInfo[index][0], Accel_Register_ConfigInfo[index][1]);
+  }
+
+  /* no error */
+  return BMI088_NO_ERROR;
+}
+//------------------------------------------------------------------------------
 
+/**
+  * @brief Verify the gyro register written in the last step, then write the next one.
+  * @param index: index of Gyro_Register_ConfigInfo to write
+  * @retval BMI088_NO_ERROR, or the error of the register written in the last step
+  */
+static BMI088_Status_e BMI088_Gyro_Config_Step(uint8_t index)
+{
+  uint8_t res = 0;
+
+  if(index > 0)
+  {
     /* read the configuration */
-    BMI088_Accel_Read_Single_Reg(Accel_Register_ConfigInfo[write_reg_num][0], res);
-    /* delay 150us */
-    Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
+    BMI088_Gyro_Read_Single_Reg(Gyro_Register_ConfigInfo[index-1][0], res);
 
     /* check the configuration */
-    if (res != Accel_Register_ConfigInfo[write_reg_num][1])
+    if (res != Gyro_Register_ConfigInfo[index-1][1])
     {
-        return (BMI088_Status_e)Accel_Register_ConfigInfo[write_reg_num][2];
+        return (BMI088_Status_e)Gyro_Register_ConfigInfo[index-1][2];
     }
   }
 
+  if(index < BMI088_WRITE_GYRO_REG_NUM)
+  {
+    /* Write the configuration values in the internal configuration registers: */
+    /*!< [0][0]  BMI088_GYRO_RANGE 0x0F                   angular rate range and resolution address */
+    /*!< [0][1]  BMI088_GYRO_2000 (0x0 << BMI088_GYRO_RANGE_SHFITS)  //+-2000°/s */
+    /*!< [1][0]  BMI088_GYRO_BANDWIDTH 0x10               bandwidth and output rate address */
+    /*!< [1][1]  BMI088_GYRO_2000_532_HZ                  set data transmission rate to 2kHZ, bandwidth to 532hz */
+    /*!< [2][0]  BMI088_GYRO_LPM1 0x11                    power mode selection address */
+    /*!< [2][1]  BMI088_GYRO_NORMAL_MODE 0x00             normal mode */
+    /*!< [3][0]  BMI088_GYRO_CTRL 0x15                    data interrupt trigger address */
+    /*!< [3][1]  BMI088_DRDY_ON 0x80                      allow new data to trigger the interrupt */
+    /*!< [4][0]  BMI088_GYRO_INT3_INT4_IO_CONF 0x16       interrupt pin configuration address */
+    /*!< [4][1]  BMI088_GYRO_INT3_INT4_IO_CONF_DATA 0x0   BMI088_GYRO_INT3_GPIO_PP (0x0 << BMI088_GYRO_INT3_GPIO_MODE_SHFITS): INT3 push-pull output  */
+    /*!<                                                  | BMI088_GYRO_INT3_GPIO_LOW (0x0 << BMI088_GYRO_INT3_GPIO_LVL_SHFITS): INT3 pull down  */
+    /*!< [5][0]  BMI088_GYRO_INT3_INT4_IO_MAP 0x18        interrupt map address */
+    /*!< [5][1]  BMI088_GYRO_DRDY_IO_INT3 0x01            mapping to INT3 */
+    BMI088_Gyro_Write_Single_Reg(Gyro_Register_ConfigInfo[index][0], Gyro_Register_ConfigInfo[index][1]);
+  }
+
   /* no error */
-  return BMI088_NO_ERROR;  
+  return BMI088_NO_ERROR;
 }
 //------------------------------------------------------------------------------
 
 /**
-  * @brief Initializes the gyro.
-  * @param None
+  * @brief End the attempt of the initialization, retry until BMI088_INIT_ATTEMPT_MAX.
+  * @param init: pointer to BMI088_Init_Typedef structure that
+  *         contains the informations of the initialization.
+  * @param status: error of the attempt
   * @retval None
   */
-
-static BMI088_Status_e BMI088_Gyro_Init(void)
+static void BMI088_Init_Fail(BMI088_Init_Typedef *init,BMI088_Status_e status)
 {
-  uint8_t res = 0;
-
-  /* read the gyro ID */
-  BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, res);
-  /* delay 150us */
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-  /* read again */
-  BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, res);
-  /* delay 150us */
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-  /* software reset */
-  BMI088_Gyro_Write_Single_Reg(BMI088_GYRO_SOFTRESET, BMI088_GYRO_SOFTRESET_VALUE);
-  /* delay 80ms */
-  Delay_ms(BMI088_LONG_DELAY_TIME);
-
-  /* read the gyro ID again ------------------------------------------------*/
-  BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, res);
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-  BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, res);
-  Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-  /* check the software reset */
-  if (res != BMI088_GYRO_CHIP_ID_VALUE)
-  {
-      return BMI088_NO_SENSOR;
-  }
-
-  /* config the gyro */
-  for (uint8_t write_reg_num = 0; write_reg_num < BMI088_WRITE_GYRO_REG_NUM; write_reg_num++)
-  {
-      /* Write the configuration values in the internal configuration registers: */
-      /*!< [0][0]  BMI088_GYRO_RANGE 0x0F                   angular rate range and resolution address */
-      /*!< [0][1]  BMI088_GYRO_2000 (0x0 << BMI088_GYRO_RANGE_SHFITS)  //+-2000°/s */
-      /*!< [1][0]  BMI088_GYRO_BANDWIDTH 0x10               bandwidth and output rate address */
-      /*!< [1][1]  BMI088_GYRO_2000_532_HZ                  set data transmission rate to 2kHZ, bandwidth to 532hz */
-      /*!< [2][0]  BMI088_GYRO_LPM1 0x11                    power mode selection address */
-      /*!< [2][1]  BMI088_GYRO_NORMAL_MODE 0x00             normal mode */
-      /*!< [3][0]  BMI088_GYRO_CTRL 0x15                    data interrupt trigger address */
-      /*!< [3][1]  BMI088_DRDY_ON 0x80                      allow new data to trigger the interrupt */
-      /*!< [4][0]  BMI088_GYRO_INT3_INT4_IO_CONF 0x16       interrupt pin configuration address */
-      /*!< [4][1]  BMI088_GYRO_INT3_INT4_IO_CONF_DATA 0x0   BMI088_GYRO_INT3_GPIO_PP (0x0 << BMI088_GYRO_INT3_GPIO_MODE_SHFITS): INT3 push-pull output  */
-      /*!<                                                  | BMI088_GYRO_INT3_GPIO_LOW (0x0 << BMI088_GYRO_INT3_GPIO_LVL_SHFITS): INT3 pull down  */
-      /*!< [5][0]  BMI088_GYRO_INT3_INT4_IO_MAP 0x18        interrupt map address */
-      /*!< [5][1]  BMI088_GYRO_DRDY_IO_INT3 0x01            mapping to INT3 */
-      BMI088_Gyro_Write_Single_Reg(Gyro_Register_ConfigInfo[write_reg_num][0], Gyro_Register_ConfigInfo[write_reg_num][1]);
-      /* delay 150us */
-      Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-      /* read the configuration */
-      BMI088_Gyro_Read_Single_Reg(Gyro_Register_ConfigInfo[write_reg_num][0], res);
-      /* delay 150us */
-      Delay_us(BMI088_COM_WAIT_SENSOR_TIME);
-
-      /* check the configuration */
-      if (res != Gyro_Register_ConfigInfo[write_reg_num][1])
-      {
-          return (BMI088_Status_e)Gyro_Register_ConfigInfo[write_reg_num][2];
-      }
-  }
-
-  /* no error */
-  return BMI088_NO_ERROR;
+  init->status = status;
+  init->state = (init->attempt >= BMI088_INIT_ATTEMPT_MAX) ? BMI088_INIT_FAILED : BMI088_INIT_RESET;
 }
 //------------------------------------------------------------------------------
 
 /**
-  * @brief Update the BMI088 offsets.
+  * @brief Update the BMI088 offsets over a window of still samples,
+  *        called by every BMI088_Info_Update().
   * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
   *         contains the information of the BMI088.
   * @retval None
@@ -451,73 +435,1110 @@ static void BMI088_Offset_Update(BMI088_Info_Typedef *BMI088_Info)
 {
 #if IMU_Calibration_ENABLE /* ENABLE the BMI088 Calibration */
 
-  uint8_t buf[8] = {0,};
+  BMI088_Cali_Typedef *cali = &BMI088_Info->cali;
+  float offset[3] = {BMI088_Info->offset_gyrox,BMI088_Info->offset_gyroy,BMI088_Info->offset_gyroz};
+  float accel_sq = 0.f;
+  float mean[3] = {0.f};
+  float variance = 0.f;
+  bool still = true;
+  bool drift = false;
+  bool agree = true;
+
+  /* still: the accel norm is the gravity, the gyro is constant */
+  accel_sq = BMI088_Info->accel[0]*BMI088_Info->accel[0]
+           + BMI088_Info->accel[1]*BMI088_Info->accel[1]
+           + BMI088_Info->accel[2]*BMI088_Info->accel[2];
+  if(accel_sq < (BMI088_CALI_GRAVITY-BMI088_CALI_ACCEL_STILL)*(BMI088_CALI_GRAVITY-BMI088_CALI_ACCEL_STILL)
+  || accel_sq > (BMI088_CALI_GRAVITY+BMI088_CALI_ACCEL_STILL)*(BMI088_CALI_GRAVITY+BMI088_CALI_ACCEL_STILL))
+  {
+    still = false;
+  }
 
-  for(uint16_t i = 0; i < 5000; i++)
+  /* the first sample of the window is the reference, the offsets may be wrong */
+  if(0U == cali->count)
   {
-    /* receive the accelerator values */
-    BMI088_Accel_Read_Multi_Reg(BMI088_ACCEL_XOUT_L, buf, 6);
-    BMI088_Info->mpu_info.accelx = (int16_t)((buf[1]) << 8) | buf[0];
-    BMI088_Info->mpu_info.accely = (int16_t)((buf[3]) << 8) | buf[2];
-    BMI088_Info->mpu_info.accelz = (int16_t)((buf[5]) << 8) | buf[4];
-
-    /* receive the gyro values */
-    BMI088_Gyro_Read_Multi_Reg(BMI088_GYRO_CHIP_ID, buf, 8);
-    /* check the ID */
-    if(buf[0] == BMI088_GYRO_CHIP_ID_VALUE)   
+    memcpy(cali->ref,BMI088_Info->gyro,sizeof(cali->ref));
+  }
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    if(fabsf(BMI088_Info->gyro[i] - cali->ref[i]) > BMI088_CALI_GYRO_STILL)
     {
-      BMI088_Info->mpu_info.gyrox = (int16_t)((buf[3]) << 8) | buf[2];
-      BMI088_Info->mpu_info.gyroy = (int16_t)((buf[5]) << 8) | buf[4];
-      BMI088_Info->mpu_info.gyroz = (int16_t)((buf[7]) << 8) | buf[6];
-
-      /* update the gyro offsets */
-      BMI088_Info->offset_gyrox += BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyrox;
-      BMI088_Info->offset_gyroy += BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyroy;
-      BMI088_Info->offset_gyroz += BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyroz;
+      still = false;
     }
-    /* delay 1ms */
-    Delay_ms(1);
   }
 
-  BMI088_Info->offset_gyrox = BMI088_Info->offset_gyrox / 5000.f;
-  BMI088_Info->offset_gyroy = BMI088_Info->offset_gyroy / 5000.f; 
-  BMI088_Info->offset_gyroz = BMI088_Info->offset_gyroz / 5000.f;
+  /* restart the window on motion, a change of the offsets must persist without it */
+  if(false == still)
+  {
+    cali->count = 0;
+    cali->drift_count = 0;
+    memset(cali->sum,0,sizeof(cali->sum));
+    memset(cali->sum_sq,0,sizeof(cali->sum_sq));
+    return;
+  }
+
+  /* accumulate the gyro, offsets removed */
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    cali->sum[i] += BMI088_Info->gyro[i];
+    cali->sum_sq[i] += BMI088_Info->gyro[i]*BMI088_Info->gyro[i];
+  }
+  cali->count++;
+
+  if(cali->count < BMI088_CALI_SAMPLES)
+  {
+    return;
+  }
+
+  /* the window is complete, reject the noise and the offsets beyond the sensor */
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    mean[i] = cali->sum[i] / cali->count;
+    variance = cali->sum_sq[i] / cali->count - mean[i]*mean[i];
+
+    if(variance > BMI088_CALI_GYRO_NOISE*BMI088_CALI_GYRO_NOISE
+    || fabsf(offset[i] + mean[i]) > BMI088_CALI_OFFSET_MAX)
+    {
+      still = false;
+    }
+    if(fabsf(mean[i]) > BMI088_CALI_DRIFT_MAX)
+    {
+      drift = true;
+    }
+  }
+
+  cali->count = 0;
+  memset(cali->sum,0,sizeof(cali->sum));
+  memset(cali->sum_sq,0,sizeof(cali->sum_sq));
+
+  if(false == still)
+  {
+    cali->drift_count = 0;
+    cali->rejected++;
+    return;
+  }
+
+  /* a large change of the initialized offsets is a slow rotation, unless it persists */
+  if(true == BMI088_Info->offsets_init && true == drift)
+  {
+    if(0U == cali->windows)
+    {
+      /* the first window disagrees with the flash record, drop the record */
+      cali->flash_valid = false;
+    }
+    else
+    {
+      for(uint8_t i = 0; i < 3; i++)
+      {
+        if(0U == cali->drift_count || fabsf(mean[i] - cali->drift_mean[i]) > BMI088_CALI_DRIFT_MAX)
+        {
+          agree = false;
+        }
+      }
+      if(false == agree)
+      {
+        cali->drift_count = 0;
+        memcpy(cali->drift_mean,mean,sizeof(cali->drift_mean));
+      }
+      if(++cali->drift_count < BMI088_CALI_DRIFT_WINDOWS)
+      {
+        cali->rejected++;
+        return;
+      }
+    }
+  }
+  cali->drift_count = 0;
+
+  /* update the gyro offsets */
+  BMI088_Info->offset_gyrox += mean[0];
+  BMI088_Info->offset_gyroy += mean[1];
+  BMI088_Info->offset_gyroz += mean[2];
+  BMI088_Info->offset_temperature = BMI088_Info->temperature;
+  BMI088_Info->offsets_init = true;
+  cali->windows++;
+
+  /* request the store of the offsets missing or away from the flash record */
+  if(false == cali->flash_saved
+  && (false == cali->flash_valid
+   || fabsf(BMI088_Info->offset_gyrox - cali->flash_offset[0]) > BMI088_CALI_SAVE_OFFSET
+   || fabsf(BMI088_Info->offset_gyroy - cali->flash_offset[1]) > BMI088_CALI_SAVE_OFFSET
+   || fabsf(BMI088_Info->offset_gyroz - cali->flash_offset[2]) > BMI088_CALI_SAVE_OFFSET
+   || fabsf(BMI088_Info->offset_temperature - cali->flash_temperature) > BMI088_CALI_SAVE_TEMP))
+  {
+    cali->save_pending = true;
+  }
 
 #else /* DISABLE the BMI088 Calibration */
-	/* store the offsets value */
+  (void)BMI088_Info;
+#endif
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Load the offsets from the flash, then calibrated in the background
+  *        by BMI088_Info_Update() while the sensor is still.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval None
+  */
+void BMI088_Offset_Init(BMI088_Info_Typedef *BMI088_Info)
+{
+  uint32_t record[BMI088_CALI_RECORD_NUM] = {0,};
+  BMI088_Cali_Typedef *cali = &BMI088_Info->cali;
+
+  memset(cali,0,sizeof(BMI088_Cali_Typedef));
+
+  /* zero offsets until the first window */
   BMI088_Info->offset_gyrox = 0.f;
   BMI088_Info->offset_gyroy = 0.f;
   BMI088_Info->offset_gyroz = 0.f;
-#endif
+  BMI088_Info->offset_temperature = 0.f;
+  BMI088_Info->offsets_init = false;
 
-  /* set the offset init flag */
+#if IMU_Calibration_ENABLE /* ENABLE the BMI088 Calibration */
+  /* load the offsets of the latest valid record */
+  if(Flash_Record_Read(record,BMI088_CALI_RECORD_NUM) == true && record[0] == BMI088_CALI_MAGIC)
+  {
+    memcpy(cali->flash_offset,&record[1],sizeof(cali->flash_offset));
+    memcpy(&cali->flash_temperature,&record[4],sizeof(cali->flash_temperature));
+    cali->flash_valid = true;
+
+    BMI088_Info->offset_gyrox = cali->flash_offset[0];
+    BMI088_Info->offset_gyroy = cali->flash_offset[1];
+    BMI088_Info->offset_gyroz = cali->flash_offset[2];
+    BMI088_Info->offset_temperature = cali->flash_temperature;
+    BMI088_Info->offsets_init = true;
+  }
+#else /* DISABLE the BMI088 Calibration */
+  (void)record;
   BMI088_Info->offsets_init = true;
+#endif
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Store the offsets in the flash once the background calibration requests it.
+  * @note  the sector may be erased, which stalls the core and the interrupts for about 1s,
+  *        call it outside the sensor path while the actuators are disarmed,
+  *        the request stays pending after a failed write.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval true if the offsets are written
+  */
+bool BMI088_Offset_Store(BMI088_Info_Typedef *BMI088_Info)
+{
+#if IMU_Calibration_ENABLE /* ENABLE the BMI088 Calibration */
+
+  uint32_t record[BMI088_CALI_RECORD_NUM] = {BMI088_CALI_MAGIC,};
+  BMI088_Cali_Typedef *cali = &BMI088_Info->cali;
+  float offset[3] = {0.f};
+  float temperature = 0.f;
+  bool valid = false;
+
+  if(false == cali->save_pending)
+  {
+    return false;
+  }
+
+  /* the offsets are updated by the IMU task meanwhile */
+  taskENTER_CRITICAL();
+  offset[0] = BMI088_Info->offset_gyrox;
+  offset[1] = BMI088_Info->offset_gyroy;
+  offset[2] = BMI088_Info->offset_gyroz;
+  temperature = BMI088_Info->offset_temperature;
+  taskEXIT_CRITICAL();
+
+  memcpy(&record[1],offset,sizeof(offset));
+  memcpy(&record[4],&temperature,sizeof(temperature));
+
+  /* once per boot, the request stays pending for a retry if the write fails */
+  valid = Flash_Record_Write(record,BMI088_CALI_RECORD_NUM);
+  if(false == valid)
+  {
+    return false;
+  }
+
+  taskENTER_CRITICAL();
+  memcpy(cali->flash_offset,offset,sizeof(cali->flash_offset));
+  cali->flash_temperature = temperature;
+  cali->flash_valid = true;
+  cali->flash_saved = true;
+  cali->save_pending = false;
+  taskEXIT_CRITICAL();
+
+  return true;
+
+#else /* DISABLE the BMI088 Calibration */
+  (void)BMI088_Info;
+  return false;
+#endif
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Reset the read schedule, the temperature and the health check are due at once.
+  * @param read: pointer to BMI088_Read_Typedef structure that
+  *         contains the informations of the read schedule.
+  * @retval None
+  */
+static void BMI088_Read_Reset(BMI088_Read_Typedef *read)
+{
+  uint32_t now = osKernelSysTick();
+
+  memset(read,0,sizeof(BMI088_Read_Typedef));
+
+  read->temp_tick = now - BMI088_READ_TEMP_PERIOD;
+  read->health_tick = now - BMI088_READ_HEALTH_PERIOD;
+  read->rate_tick = now;
+  read->health_ok = true;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Count a data ready sample of a channel read every div samples.
+  * @param skip: samples since the last read
+  * @param div: samples per read
+  * @retval true if the sample is read
+  */
+static bool BMI088_Read_Divide(uint16_t *skip,uint16_t div)
+{
+  if(++(*skip) < div)
+  {
+    return false;
+  }
+
+  *skip = 0;
+
+  return true;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Check a channel read every period.
+  * @note  called in the EXTI interrupt as well by the DMA acquisition.
+  * @param tick: tick of the last read, updated if due
+  * @param period: ms per read
+  * @retval true if the read is due
+  */
+static bool BMI088_Read_Due(uint32_t *tick,uint32_t period)
+{
+  uint32_t now = osKernelSysTick();
+
+  if(now - *tick < period)
+  {
+    return false;
+  }
+
+  *tick = now;
+
+  return true;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Check the chip ids read by the health check.
+  * @param read: pointer to BMI088_Read_Typedef structure that
+  *         contains the informations of the read schedule.
+  * @param accel_id: chip id of the accelerator
+  * @param gyro_id: chip id of the gyro
+  * @retval None
+  */
+static void BMI088_Health_Check(BMI088_Read_Typedef *read,uint8_t accel_id,uint8_t gyro_id)
+{
+  read->health_ok = (accel_id == BMI088_ACC_CHIP_ID_VALUE && gyro_id == BMI088_GYRO_CHIP_ID_VALUE);
+
+  if(false == read->health_ok)
+  {
+    read->health_error++;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Update the SPI bytes per second once per BMI088_READ_RATE_PERIOD.
+  * @param read: pointer to BMI088_Read_Typedef structure that
+  *         contains the informations of the read schedule.
+  * @retval None
+  */
+static void BMI088_Read_Rate_Update(BMI088_Read_Typedef *read)
+{
+  uint32_t now = osKernelSysTick();
+  uint32_t elapsed = now - read->rate_tick;
+  uint32_t bytes = read->spi_bytes;
+  uint32_t bytes_full = read->spi_bytes_full;
+
+  if(elapsed < BMI088_READ_RATE_PERIOD)
+  {
+    return;
+  }
+
+  /* scheduled reads against every channel read every cycle */
+  read->bytes_per_second = (bytes - read->rate_bytes) * 1000U / elapsed;
+  read->bytes_per_second_full = (bytes_full - read->rate_bytes_full) * 1000U / elapsed;
+
+  read->rate_tick = now;
+  read->rate_bytes = bytes;
+  read->rate_bytes_full = bytes_full;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Step the initialization of the BMI088, call it every tick under the scheduler
+  *        until BMI088_INIT_DONE or BMI088_INIT_FAILED.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @retval state of the initialization
+  */
+BMI088_Init_State_e BMI088_Init_Update(BMI088_Info_Typedef *BMI088_Info)
+{
+  BMI088_Init_Typedef *init = &BMI088_Info->init;
+  BMI088_Status_e status = BMI088_NO_ERROR;
+  uint8_t res = 0;
+
+  switch(init->state)
+  {
+    case BMI088_INIT_RESET:
+      init->attempt++;
+      init->status = BMI088_NO_ERROR;
+
+      /* a dummy read switches the accelerator to SPI */
+      BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
+
+      /* software reset both sensors, the waits overlap */
+      BMI088_Accel_Write_Single_Reg(BMI088_ACC_SOFTRESET, BMI088_ACC_SOFTRESET_VALUE);
+      BMI088_Gyro_Write_Single_Reg(BMI088_GYRO_SOFTRESET, BMI088_GYRO_SOFTRESET_VALUE);
+      init->tick = osKernelSysTick();
+      init->state = BMI088_INIT_WAIT_RESET;
+    break;
+
+    case BMI088_INIT_WAIT_RESET:
+      /* wait 80ms without blocking the other tasks */
+      if(osKernelSysTick() - init->tick >= BMI088_LONG_DELAY_TIME)
+      {
+        init->state = BMI088_INIT_CHECK_ID;
+      }
+    break;
+
+    case BMI088_INIT_CHECK_ID:
+      /* the reset switches the accelerator back to I2C, dummy read again */
+      BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
+      BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, res);
+      if (res != BMI088_ACC_CHIP_ID_VALUE)
+      {
+        BMI088_Init_Fail(init,BMI088_NO_SENSOR);
+        break;
+      }
+
+      BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, res);
+      if (res != BMI088_GYRO_CHIP_ID_VALUE)
+      {
+        BMI088_Init_Fail(init,BMI088_NO_SENSOR);
+        break;
+      }
+
+      init->accel_index = 0;
+      init->gyro_index = 0;
+      init->state = BMI088_INIT_CONFIG;
+    break;
+
+    case BMI088_INIT_CONFIG:
+      /* a register of each sensor per step, verified in the next step */
+      if(init->accel_index <= BMI088_WRITE_ACCEL_REG_NUM)
+      {
+        status |= BMI088_Accel_Config_Step(init->accel_index++);
+      }
+      if(init->gyro_index <= BMI088_WRITE_GYRO_REG_NUM)
+      {
+        status |= BMI088_Gyro_Config_Step(init->gyro_index++);
+      }
+
+      if(status != BMI088_NO_ERROR)
+      {
+        BMI088_Init_Fail(init,status);
+      }
+      else if(init->accel_index > BMI088_WRITE_ACCEL_REG_NUM && init->gyro_index > BMI088_WRITE_GYRO_REG_NUM)
+      {
+        BMI088_Read_Reset(&BMI088_Info->read);
+        init->state = BMI088_INIT_DONE;
+      }
+    break;
+
+    default:
+      /* BMI088_INIT_DONE or BMI088_INIT_FAILED */
+    break;
+  }
+
+  return init->state;
+}
+//------------------------------------------------------------------------------
+
+#if BMI088_USE_DMA
+
+/**
+  * @brief burst of the SPI1 DMA in progress
+  */
+typedef enum
+{
+  BMI088_DMA_IDLE = 0U,
+  BMI088_DMA_ACCEL,
+  BMI088_DMA_GYRO,
+  BMI088_DMA_GYRO_STATUS,
+  BMI088_DMA_TEMP,
+  BMI088_DMA_ACCEL_ID,
+  BMI088_DMA_GYRO_ID,
+}BMI088_DMA_Burst_e;
+
+#if BMI088_USE_FIFO
+/**
+  * @brief structure that contains the raw frames of a batch.
+  */
+typedef struct
+{
+  uint32_t timestamp;  /*!< DWT timestamp of the last gyro frame */
+  uint8_t gyro_num;    /*!< gyro frames */
+  uint8_t accel_num;   /*!< accelerator frames */
+  int16_t gyro[BMI088_FIFO_GYRO_FRAME_MAX][3];   /*!< raw gyro frames */
+  int16_t accel[BMI088_FIFO_ACCEL_FRAME_MAX][3]; /*!< raw accelerator frames */
+}BMI088_FIFO_Raw_Typedef;
+#endif
+
+/**
+  * @brief structure that contains the informations of the interrupt-driven acquisition.
+  */
+typedef struct
+{
+  BMI088_Info_Typedef *info;         /*!< receives the samples, NULL before the start */
+  osThreadId thread_id;              /*!< thread notified of the gyro samples */
+  volatile BMI088_DMA_Burst_e burst; /*!< burst in progress */
+  volatile bool accel_pending;       /*!< accelerator data ready, waiting for the SPI */
+  volatile bool gyro_pending;        /*!< gyro data ready, waiting for the SPI */
+  volatile bool temp_pending;        /*!< temperature waiting for the SPI */
+  volatile bool accel_id_pending;    /*!< accelerator chip id of the health check waiting for the SPI */
+  volatile bool gyro_id_pending;     /*!< gyro chip id of the health check waiting for the SPI */
+  volatile bool health_wait;         /*!< health check queued and not completed */
+  uint8_t accel_id;                  /*!< accelerator chip id of the health check */
+
+  uint8_t accel_txbuf[BMI088_ACCEL_DMA_LEN]; /*!< transmission of the accelerator burst */
+  uint8_t accel_rxbuf[BMI088_ACCEL_DMA_LEN]; /*!< reception of the accelerator burst */
+  uint8_t gyro_txbuf[BMI088_GYRO_DMA_LEN];   /*!< transmission of the gyro burst */
+  uint8_t gyro_rxbuf[BMI088_GYRO_DMA_LEN];   /*!< reception of the gyro burst */
+  uint8_t temp_txbuf[BMI088_TEMP_DMA_LEN];   /*!< transmission of the temperature burst */
+  uint8_t temp_rxbuf[BMI088_TEMP_DMA_LEN];   /*!< reception of the temperature burst */
+  uint8_t accel_id_txbuf[BMI088_ACCEL_READ_LEN(1U)]; /*!< transmission of the accelerator chip id burst */
+  uint8_t gyro_id_txbuf[BMI088_GYRO_READ_LEN(1U)];   /*!< transmission of the gyro chip id burst */
+  uint8_t id_rxbuf[BMI088_ACCEL_READ_LEN(1U)];       /*!< reception of the chip id bursts */
+
+#if BMI088_USE_FIFO
+  volatile uint32_t timestamp;       /*!< DWT timestamp of the gyro frame at anchor_level */
+  volatile uint8_t anchor_level;     /*!< level of the gyro FIFO at the timestamp, the watermark or the frames left by a batch */
+  volatile bool gyro_data_pending;   /*!< gyro frames counted, waiting for the SPI */
+  uint8_t gyro_read;                 /*!< gyro frames of the data burst */
+  uint8_t gyro_left;                 /*!< gyro frames left in the FIFO by the data burst */
+  uint8_t gyro_status_txbuf[BMI088_GYRO_READ_LEN(1U)]; /*!< transmission of the gyro FIFO status burst */
+  uint8_t gyro_status_rxbuf[BMI088_GYRO_READ_LEN(1U)]; /*!< reception of the gyro FIFO status burst */
+  BMI088_FIFO_Raw_Typedef fill;      /*!< batch being drained */
+  BMI088_FIFO_Raw_Typedef ready;     /*!< latest complete batch */
+  volatile bool batch_ready;         /*!< ready is not fetched yet */
+#endif
+}BMI088_DMA_Info_Typedef;
+
+/**
+  * @brief Instance structure of the interrupt-driven acquisition.
+  */
+static BMI088_DMA_Info_Typedef BMI088_DMA_Info;
+
+/**
+  * @brief Select the sensor and start a burst of the SPI1 DMA.
+  * @param burst: burst to start
+  * @param txbuf: transmission buffer, register address first
+  * @param rxbuf: reception buffer
+  * @param len: length of the burst
+  * @retval None
+  */
+static void BMI088_DMA_Burst(BMI088_DMA_Burst_e burst,uint8_t *txbuf,uint8_t *rxbuf,uint16_t len)
+{
+  BMI088_DMA_Info.burst = burst;
+
+  if(burst == BMI088_DMA_GYRO || burst == BMI088_DMA_GYRO_STATUS || burst == BMI088_DMA_GYRO_ID)
+  {
+    BMI088_GYRO_NS_L();
+  }
+  else
+  {
+    BMI088_ACCEL_NS_L();
+  }
+
+  if(HAL_SPI_TransmitReceive_DMA(&hspi1,txbuf,rxbuf,len) != HAL_OK)
+  {
+    BMI088_ACCEL_NS_H();
+    BMI088_GYRO_NS_H();
+    BMI088_DMA_Info.burst = BMI088_DMA_IDLE;
+    BMI088_DMA_Info.info->dma_error++;
+    return;
+  }
+
+  BMI088_DMA_Info.info->read.spi_bytes += len;
 }
 //------------------------------------------------------------------------------
 
 /**
- * 
-  * @brief Initializes the BMI088.
+  * @brief Start the burst of a pending sample if the SPI1 is idle,
+  *        gyro first, the health check last.
+  * @note  called in the EXTI and SPI1 DMA interrupts.
   * @param None
+  * @retval None
   */
-void BMI088_Init(void)
+static void BMI088_DMA_Start(void)
 {
-	BMI088_Status_e status = BMI088_NO_ERROR;
+  if(BMI088_DMA_Info.burst != BMI088_DMA_IDLE)
+  {
+    return;
+  }
 
-  /* Initializes the BMI088 */
-  do
+#if BMI088_USE_FIFO
+  if(true == BMI088_DMA_Info.gyro_data_pending)
+  {
+    /* read the counted frames of the gyro FIFO */
+    BMI088_DMA_Info.gyro_data_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_GYRO,BMI088_DMA_Info.gyro_txbuf,BMI088_DMA_Info.gyro_rxbuf,BMI088_GYRO_READ_LEN(6U*BMI088_DMA_Info.gyro_read));
+  }
+  else if(true == BMI088_DMA_Info.gyro_pending)
   {
-		status = BMI088_NO_ERROR;
-    /* initialize the accelerator */
-    status |= BMI088_Accel_Init();
-    /* initialize the gyro  */
-    status |= BMI088_Gyro_Init();
-    /* delay 2ms */
-    Delay_ms(2);
-  }while(status);
+    /* count the frames of the gyro FIFO */
+    BMI088_DMA_Info.gyro_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_GYRO_STATUS,BMI088_DMA_Info.gyro_status_txbuf,BMI088_DMA_Info.gyro_status_rxbuf,sizeof(BMI088_DMA_Info.gyro_status_txbuf));
+  }
+#else
+  if(true == BMI088_DMA_Info.gyro_pending)
+  {
+    /* read the gyro values */
+    BMI088_DMA_Info.gyro_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_GYRO,BMI088_DMA_Info.gyro_txbuf,BMI088_DMA_Info.gyro_rxbuf,BMI088_GYRO_DMA_LEN);
+  }
+#endif
+  else if(true == BMI088_DMA_Info.accel_pending)
+  {
+    /* read the accelerator values, or the accelerator FIFO */
+    BMI088_DMA_Info.accel_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_ACCEL,BMI088_DMA_Info.accel_txbuf,BMI088_DMA_Info.accel_rxbuf,BMI088_ACCEL_DMA_LEN);
+  }
+  else if(true == BMI088_DMA_Info.temp_pending)
+  {
+    /* read the temperature value */
+    BMI088_DMA_Info.temp_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_TEMP,BMI088_DMA_Info.temp_txbuf,BMI088_DMA_Info.temp_rxbuf,BMI088_TEMP_DMA_LEN);
+  }
+  else if(true == BMI088_DMA_Info.accel_id_pending)
+  {
+    /* read the accelerator chip id */
+    BMI088_DMA_Info.accel_id_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_ACCEL_ID,BMI088_DMA_Info.accel_id_txbuf,BMI088_DMA_Info.id_rxbuf,sizeof(BMI088_DMA_Info.accel_id_txbuf));
+  }
+  else if(true == BMI088_DMA_Info.gyro_id_pending)
+  {
+    /* read the gyro chip id */
+    BMI088_DMA_Info.gyro_id_pending = false;
+    BMI088_DMA_Burst(BMI088_DMA_GYRO_ID,BMI088_DMA_Info.gyro_id_txbuf,BMI088_DMA_Info.id_rxbuf,sizeof(BMI088_DMA_Info.gyro_id_txbuf));
+  }
 }
 //------------------------------------------------------------------------------
 
+/**
+  * @brief Queue the temperature and the health check once due.
+  * @note  called in the EXTI interrupt, and by BMI088_Read_Schedule() without interrupts.
+  * @param read: pointer to BMI088_Read_Typedef structure that
+  *         contains the informations of the read schedule.
+  * @retval None
+  */
+static void BMI088_DMA_Schedule(BMI088_Read_Typedef *read)
+{
+  if(true == BMI088_Read_Due(&read->temp_tick,BMI088_READ_TEMP_PERIOD))
+  {
+    BMI088_DMA_Info.temp_pending = true;
+  }
+
+  if(true == BMI088_Read_Due(&read->health_tick,BMI088_READ_HEALTH_PERIOD))
+  {
+    /* the last check never completed, the SPI is stuck */
+    if(true == BMI088_DMA_Info.health_wait)
+    {
+      read->health_ok = false;
+      read->health_error++;
+    }
+
+    BMI088_DMA_Info.health_wait = true;
+    BMI088_DMA_Info.accel_id_pending = true;
+    BMI088_DMA_Info.gyro_id_pending = true;
+  }
+}
+//------------------------------------------------------------------------------
+
+#if BMI088_USE_FIFO
+/**
+  * @brief Count the frames of the gyro FIFO, size the data burst and timestamp the batch.
+  * @note  the frames after the anchor arrived at BMI088_GYRO_ODR, the oldest frames are read first.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the overruns of the FIFO.
+  * @retval None
+  */
+static void BMI088_FIFO_Gyro_Status(BMI088_Info_Typedef *BMI088_Info)
+{
+  BMI088_FIFO_Raw_Typedef *raw = &BMI088_DMA_Info.fill;
+  /* skip the address */
+  uint8_t status = BMI088_DMA_Info.gyro_status_rxbuf[1];
+  uint8_t count = status & BMI088_GYRO_FIFO_FRAME_COUNT_MASK;
+  uint32_t frame_cycles = (uint32_t)(SystemCoreClock / BMI088_GYRO_ODR);
+  uint32_t newest = 0;
+
+  if((status & BMI088_GYRO_FIFO_OVERRUN) != 0U)
+  {
+    /* the oldest frames are lost, the newest one is about now */
+    BMI088_Info->fifo_overrun++;
+    newest = Timestamp_Get();
+  }
+  else
+  {
+    newest = BMI088_DMA_Info.timestamp + (uint32_t)(((int32_t)count - (int32_t)BMI088_DMA_Info.anchor_level) * (int32_t)frame_cycles);
+  }
+
+  BMI088_DMA_Info.gyro_read = (count > BMI088_FIFO_GYRO_FRAME_MAX) ? BMI088_FIFO_GYRO_FRAME_MAX : count;
+  BMI088_DMA_Info.gyro_left = count - BMI088_DMA_Info.gyro_read;
+
+  /* the last frame of the burst */
+  raw->timestamp = newest - BMI088_DMA_Info.gyro_left * frame_cycles;
+  raw->gyro_num = 0;
+
+  /* the frames left are timed by the next batch */
+  BMI088_DMA_Info.timestamp = newest;
+  BMI088_DMA_Info.anchor_level = BMI088_DMA_Info.gyro_left;
+
+  /* no batch without gyro frames */
+  if(BMI088_DMA_Info.gyro_read > 0U)
+  {
+    BMI088_DMA_Info.gyro_data_pending = true;
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Store the gyro frames of the FIFO burst in the batch.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the last frame.
+  * @retval None
+  */
+static void BMI088_FIFO_Gyro_Parse(BMI088_Info_Typedef *BMI088_Info)
+{
+  BMI088_FIFO_Raw_Typedef *raw = &BMI088_DMA_Info.fill;
+  /* skip the address, 6 bytes per frame */
+  uint8_t *buf = &BMI088_DMA_Info.gyro_rxbuf[1];
+
+  for(uint8_t i = 0; i < BMI088_DMA_Info.gyro_read; i++, buf += 6)
+  {
+    raw->gyro[i][0] = (int16_t)((buf[1] << 8) | buf[0]);
+    raw->gyro[i][1] = (int16_t)((buf[3] << 8) | buf[2]);
+    raw->gyro[i][2] = (int16_t)((buf[5] << 8) | buf[4]);
+  }
+  raw->gyro_num = BMI088_DMA_Info.gyro_read;
+
+  /* the last frame is the latest sample */
+  BMI088_Info->mpu_info.gyrox = raw->gyro[raw->gyro_num-1][0];
+  BMI088_Info->mpu_info.gyroy = raw->gyro[raw->gyro_num-1][1];
+  BMI088_Info->mpu_info.gyroz = raw->gyro[raw->gyro_num-1][2];
+
+  BMI088_Info->gyro_count += raw->gyro_num;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Store the accelerator frames of the FIFO burst in the batch.
+  * @note  a frame cut by the end of the burst is read again by the next burst,
+  *        the empty frame marks the fill level.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the last frame.
+  * @retval None
+  */
+static void BMI088_FIFO_Accel_Parse(BMI088_Info_Typedef *BMI088_Info)
+{
+  BMI088_FIFO_Raw_Typedef *raw = &BMI088_DMA_Info.fill;
+  /* skip the address and the dummy byte */
+  uint8_t *buf = &BMI088_DMA_Info.accel_rxbuf[2];
+  uint8_t *end = &BMI088_DMA_Info.accel_rxbuf[BMI088_ACCEL_DMA_LEN];
+  uint8_t header = 0;
+
+  raw->accel_num = 0;
+
+  while(buf < end)
+  {
+    header = buf[0] & BMI088_ACC_FIFO_HEADER_MASK;
+
+    if(header == BMI088_ACC_FIFO_HEADER_ACCEL)
+    {
+      if(buf + 7 > end || raw->accel_num >= BMI088_FIFO_ACCEL_FRAME_MAX)
+      {
+        break;
+      }
+      raw->accel[raw->accel_num][0] = (int16_t)((buf[2] << 8) | buf[1]);
+      raw->accel[raw->accel_num][1] = (int16_t)((buf[4] << 8) | buf[3]);
+      raw->accel[raw->accel_num][2] = (int16_t)((buf[6] << 8) | buf[5]);
+      raw->accel_num++;
+      buf += 7;
+    }
+    else if(header == BMI088_ACC_FIFO_HEADER_SKIP || header == BMI088_ACC_FIFO_HEADER_CONFIG
+         || header == BMI088_ACC_FIFO_HEADER_DROP)
+    {
+      buf += 2;
+    }
+    else if(header == BMI088_ACC_FIFO_HEADER_TIME)
+    {
+      buf += 4;
+    }
+    else
+    {
+      /* empty frame, the FIFO is drained */
+      break;
+    }
+  }
+
+  if(raw->accel_num > 0)
+  {
+    /* the last frame is the latest sample */
+    BMI088_Info->mpu_info.accelx = raw->accel[raw->accel_num-1][0];
+    BMI088_Info->mpu_info.accely = raw->accel[raw->accel_num-1][1];
+    BMI088_Info->mpu_info.accelz = raw->accel[raw->accel_num-1][2];
+
+    BMI088_Info->accel_update = true;
+    BMI088_Info->accel_count += raw->accel_num;
+  }
+}
+//------------------------------------------------------------------------------
+#endif
+
+/**
+  * @brief Start the acquisition by the data ready interrupts.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the samples of the DMA.
+  * @param thread_id: thread notified once a gyro sample is in memory.
+  * @retval None
+  */
+void BMI088_Acquire_Start(BMI088_Info_Typedef *BMI088_Info,osThreadId thread_id)
+{
+  /* address of the bursts, the rest transmits the dummy value */
+  memset(BMI088_DMA_Info.accel_txbuf,0x55,BMI088_ACCEL_DMA_LEN);
+  memset(BMI088_DMA_Info.gyro_txbuf,0x55,BMI088_GYRO_DMA_LEN);
+  memset(BMI088_DMA_Info.temp_txbuf,0x55,BMI088_TEMP_DMA_LEN);
+  memset(BMI088_DMA_Info.accel_id_txbuf,0x55,sizeof(BMI088_DMA_Info.accel_id_txbuf));
+  memset(BMI088_DMA_Info.gyro_id_txbuf,0x55,sizeof(BMI088_DMA_Info.gyro_id_txbuf));
+#if BMI088_USE_FIFO
+  BMI088_DMA_Info.accel_txbuf[0] = BMI088_ACC_FIFO_DATA | 0x80;
+  BMI088_DMA_Info.gyro_txbuf[0] = BMI088_GYRO_FIFO_DATA | 0x80;
+  memset(BMI088_DMA_Info.gyro_status_txbuf,0x55,sizeof(BMI088_DMA_Info.gyro_status_txbuf));
+  BMI088_DMA_Info.gyro_status_txbuf[0] = BMI088_GYRO_FIFO_STATUS | 0x80;
+  BMI088_DMA_Info.gyro_data_pending = false;
+  BMI088_DMA_Info.gyro_left = 0;
+  BMI088_DMA_Info.anchor_level = 0;
+  BMI088_DMA_Info.timestamp = Timestamp_Get();
+  BMI088_DMA_Info.batch_ready = false;
+#else
+  BMI088_DMA_Info.accel_txbuf[0] = BMI088_ACCEL_XOUT_L | 0x80;
+  BMI088_DMA_Info.gyro_txbuf[0] = BMI088_GYRO_XOUT_L | 0x80;
+#endif
+  BMI088_DMA_Info.temp_txbuf[0] = BMI088_TEMP_M | 0x80;
+  BMI088_DMA_Info.accel_id_txbuf[0] = BMI088_ACC_CHIP_ID | 0x80;
+  BMI088_DMA_Info.gyro_id_txbuf[0] = BMI088_GYRO_CHIP_ID | 0x80;
+
+  BMI088_DMA_Info.burst = BMI088_DMA_IDLE;
+  BMI088_DMA_Info.accel_pending = false;
+  BMI088_DMA_Info.gyro_pending = false;
+  BMI088_DMA_Info.temp_pending = false;
+  BMI088_DMA_Info.accel_id_pending = false;
+  BMI088_DMA_Info.gyro_id_pending = false;
+  BMI088_DMA_Info.health_wait = false;
+  BMI088_DMA_Info.thread_id = thread_id;
+
+  /* the interrupts are handled from now on */
+  __disable_irq();
+  BMI088_DMA_Info.info = BMI088_Info;
+  __enable_irq();
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief Queue the temperature and the health check once due without the data ready interrupts,
+  *        call it when no sample arrives in time, a dead sensor is found by the health check.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         receives the samples of the DMA.
+  * @retval None
+  */
+void BMI088_Read_Schedule(BMI088_Info_Typedef *BMI088_Info)
+{
+  if(BMI088_DMA_Info.info != BMI088_Info)
+  {
+    return;
+  }
+
+  /* shared with the EXTI and SPI1 DMA interrupts */
+  taskENTER_CRITICAL();
+  BMI088_DMA_Schedule(&BMI088_Info->read);
+  BMI088_DMA_Start();
+  taskEXIT_CRITICAL();
+}
+//------------------------------------------------------------------------------
+
+#if BMI088_USE_FIFO
+/**
+  * @brief Get the latest batch drained from the FIFOs,
+  *        the last frames are stored in the BMI088 Informations as well.
+  * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
+  *         contains the informations of the BMI088.
+  * @param batch: pointer to BMI088_FIFO_Batch_Typedef structure that
+  *         receives the samples.
+  * @retval true if a new batch is received since the last call
+  */
+bool BMI088_FIFO_Batch_Get(BMI088_Info_Typedef *BMI088_Info,BMI088_FIFO_Batch_Typedef *batch)
+{
+  BMI088_FIFO_Raw_Typedef raw;
+  bool batch_ready = false;
+
+  /* copy the latest batch of the DMA */
+  taskENTER_CRITICAL();
+  raw = BMI088_DMA_Info.ready;
+  batch_ready = BMI088_DMA_Info.batch_ready;
+  BMI088_DMA_Info.batch_ready = false;
+
+  /* a late batch left frames in the gyro FIFO, drain them once this one is fetched */
+  if(true == batch_ready && BMI088_DMA_Info.gyro_left > 0U)
+  {
+    BMI088_DMA_Info.gyro_pending = true;
+    BMI088_DMA_Start();
+  }
+  taskEXIT_CRITICAL();
+
+  batch->gyro_dt = 1.f / BMI088_GYRO_ODR;
+
+  if(false == batch_ready)
+  {
+    batch->gyro_num = 0;
+    batch->accel_num = 0;
+    return false;
+  }
+
+  batch->timestamp = raw.timestamp;
+  batch->gyro_num = raw.gyro_num;
+  batch->accel_num = raw.accel_num;
+
+  /* convert the gyro frames */
+  for(uint8_t i = 0; i < raw.gyro_num; i++)
+  {
+    batch->gyro[i][0] = BMI088_GYRO_SEN * raw.gyro[i][0] - BMI088_Info->offset_gyrox;
+    batch->gyro[i][1] = BMI088_GYRO_SEN * raw.gyro[i][1] - BMI088_Info->offset_gyroy;
+    batch->gyro[i][2] = BMI088_GYRO_SEN * raw.gyro[i][2] - BMI088_Info->offset_gyroz;
+  }
+
+  /* convert the accelerator frames */
+  for(uint8_t i = 0; i < raw.accel_num; i++)
+  {
+    batch->accel[i][0] = BMI088_ACCEL_SEN * raw.accel[i][0];
+    batch->accel[i][1] = BMI088_ACCEL_SEN * raw.accel[i][1];
+    batch->accel[i][2] = BMI088_ACCEL_SEN * raw.accel[i][2];
+  }
+
+  /* the last frames and the temperature */
+  BMI088_Info_Update(BMI088_Info);
+
+  return true;
+}
+//------------------------------------------------------------------------------
+#endif
+
+/**
+  * @brief  EXTI line detection callbacks, data ready or FIFO watermark of the BMI088.
+  * @param  GPIO_Pin Specifies the pins connected EXTI line
+  * @retval None
+  */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  BMI088_Read_Typedef *read = NULL;
+
+  if(NULL == BMI088_DMA_Info.info)
+  {
+    return;
+  }
+
+  read = &BMI088_DMA_Info.info->read;
+
+  if(GPIO_Pin == INT1_GYRO_Pin)
+  {
+#if BMI088_USE_FIFO
+    /* the watermark is reached with this frame, the anchor of the frames after it */
+    BMI088_DMA_Info.timestamp = Timestamp_Get();
+    BMI088_DMA_Info.anchor_level = BMI088_FIFO_GYRO_WATERMARK;
+    BMI088_DMA_Info.gyro_pending = true;
+
+    /* every channel of the batch was read with the FIFOs */
+    read->spi_bytes_full += BMI088_GYRO_READ_LEN(6U*BMI088_FIFO_GYRO_WATERMARK) + BMI088_ACCEL_DMA_LEN + BMI088_TEMP_DMA_LEN;
+#else
+    if(true == BMI088_Read_Divide(&read->gyro_skip,BMI088_READ_GYRO_DIV))
+    {
+      BMI088_DMA_Info.gyro_pending = true;
+    }
+
+    /* the chip id was read with every gyro sample */
+    read->spi_bytes_full += BMI088_GYRO_READ_LEN(8U);
+#endif
+  }
+  else if(GPIO_Pin == INT1_ACCEL_Pin)
+  {
+    if(true == BMI088_Read_Divide(&read->accel_skip,BMI088_READ_ACCEL_DIV))
+    {
+      BMI088_DMA_Info.accel_pending = true;
+    }
+
+    /* 0x12 ~ 0x23 was read with every accelerator sample */
+    read->spi_bytes_full += BMI088_ACCEL_READ_LEN(BMI088_TEMP_M + 2U - BMI088_ACCEL_XOUT_L);
+  }
+  else
+  {
+    return;
+  }
+
+  BMI088_DMA_Schedule(read);
+  BMI088_DMA_Start();
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Tx and Rx Transfer completed callback, store the raw values of the burst.
+  * @param  hspi pointer to a SPI_HandleTypeDef structure that contains
+  *               the configuration information for SPI module.
+  * @retval None
+  */
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  BMI088_Info_Typedef *BMI088_Info = BMI088_DMA_Info.info;
+  uint8_t *buf = NULL;
+  bool notify = false;
+
+  if(hspi != &hspi1 || NULL == BMI088_Info)
+  {
+    return;
+  }
+
+  if(BMI088_DMA_Info.burst == BMI088_DMA_ACCEL)
+  {
+    BMI088_ACCEL_NS_H();
+
+#if BMI088_USE_FIFO
+    /* the accelerator FIFO is drained, publish the batch, count the batches never fetched */
+    BMI088_FIFO_Accel_Parse(BMI088_Info);
+    if(true == BMI088_DMA_Info.batch_ready)
+    {
+      BMI088_Info->fifo_overrun++;
+    }
+    BMI088_DMA_Info.ready = BMI088_DMA_Info.fill;
+    BMI088_DMA_Info.batch_ready = true;
+    notify = true;
+#else
+    /* skip the address and the dummy byte, 0x12 at buf[0] */
+    buf = &BMI088_DMA_Info.accel_rxbuf[2];
+    BMI088_Info->mpu_info.accelx = (int16_t)((buf[1] << 8) | buf[0]);
+    BMI088_Info->mpu_info.accely = (int16_t)((buf[3] << 8) | buf[2]);
+    BMI088_Info->mpu_info.accelz = (int16_t)((buf[5] << 8) | buf[4]);
+
+    BMI088_Info->accel_update = true;
+    BMI088_Info->accel_count++;
+#endif
+  }
+  else if(BMI088_DMA_Info.burst == BMI088_DMA_GYRO)
+  {
+    BMI088_GYRO_NS_H();
+
+#if BMI088_USE_FIFO
+    /* the gyro FIFO is drained, then the accelerator FIFO */
+    BMI088_FIFO_Gyro_Parse(BMI088_Info);
+    BMI088_DMA_Info.accel_pending = true;
+#else
+    /* skip the address, 0x02 at buf[0], the chip id is left to the health check */
+    buf = &BMI088_DMA_Info.gyro_rxbuf[1];
+    BMI088_Info->mpu_info.gyrox = (int16_t)((buf[1] << 8) | buf[0]);
+    BMI088_Info->mpu_info.gyroy = (int16_t)((buf[3] << 8) | buf[2]);
+    BMI088_Info->mpu_info.gyroz = (int16_t)((buf[5] << 8) | buf[4]);
+
+    BMI088_Info->gyro_count++;
+    notify = true;
+#endif
+  }
+#if BMI088_USE_FIFO
+  else if(BMI088_DMA_Info.burst == BMI088_DMA_GYRO_STATUS)
+  {
+    BMI088_GYRO_NS_H();
+
+    /* the frames of the gyro FIFO, then the data burst */
+    BMI088_FIFO_Gyro_Status(BMI088_Info);
+  }
+#endif
+  else if(BMI088_DMA_Info.burst == BMI088_DMA_TEMP)
+  {
+    BMI088_ACCEL_NS_H();
+
+    /* skip the address and the dummy byte */
+    buf = &BMI088_DMA_Info.temp_rxbuf[2];
+    BMI088_Info->mpu_info.temperature = (int16_t)((buf[0] << 3) | (buf[1] >> 5));
+    if (BMI088_Info->mpu_info.temperature > 1023) BMI088_Info->mpu_info.temperature -= 2048;
+  }
+  else if(BMI088_DMA_Info.burst == BMI088_DMA_ACCEL_ID)
+  {
+    BMI088_ACCEL_NS_H();
+
+    /* skip the address and the dummy byte */
+    BMI088_DMA_Info.accel_id = BMI088_DMA_Info.id_rxbuf[2];
+  }
+  else if(BMI088_DMA_Info.burst == BMI088_DMA_GYRO_ID)
+  {
+    BMI088_GYRO_NS_H();
+
+    /* skip the address, compare both chip ids */
+    BMI088_Health_Check(&BMI088_Info->read,BMI088_DMA_Info.accel_id,BMI088_DMA_Info.id_rxbuf[1]);
+    BMI088_DMA_Info.health_wait = false;
+  }
+
+  /* start the next pending burst */
+  BMI088_DMA_Info.burst = BMI088_DMA_IDLE;
+  BMI088_DMA_Start();
+
+  /* wake up the thread, a complete gyro sample or batch is in memory */
+  if(true == notify && NULL != BMI088_DMA_Info.thread_id)
+  {
+    vTaskNotifyGiveFromISR(BMI088_DMA_Info.thread_id,&xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  SPI error callback, release the BMI088 and drop the burst.
+  * @param  hspi pointer to a SPI_HandleTypeDef structure that contains
+  *               the configuration information for SPI module.
+  * @retval None
+  */
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+  if(hspi != &hspi1 || NULL == BMI088_DMA_Info.info)
+  {
+    return;
+  }
+
+  BMI088_ACCEL_NS_H();
+  BMI088_GYRO_NS_H();
+  BMI088_DMA_Info.info->dma_error++;
+
+  BMI088_DMA_Info.burst = BMI088_DMA_IDLE;
+  BMI088_DMA_Start();
+}
+//------------------------------------------------------------------------------
+
+#endif
+
 /**
   * @brief Update the BMI088 Informations.
   * @param BMI088_Info: pointer to BMI088_Info_Typedef structure that
@@ -526,47 +1547,112 @@ void BMI088_Init(void)
   */
 void BMI088_Info_Update(BMI088_Info_Typedef *BMI088_Info)
 {
-  uint8_t buf[8] = {0,};
+#if BMI088_USE_DMA
+
+  MPU_Info_Typedef mpu_info;
 
-  if(false == BMI088_Info->offsets_init)
+  /* copy the latest raw values of the DMA */
+  taskENTER_CRITICAL();
+  mpu_info = BMI088_Info->mpu_info;
+  BMI088_Info->accel_ready = BMI088_Info->accel_update;
+  BMI088_Info->accel_update = false;
+  taskEXIT_CRITICAL();
+
+  if(true == BMI088_Info->accel_ready)
   {
-    /* update the bmi088 offset */
-    BMI088_Offset_Update(BMI088_Info);
+    /* convert the accelerator values */
+    BMI088_Info->accel[0] = BMI088_ACCEL_SEN * mpu_info.accelx;
+    BMI088_Info->accel[1] = BMI088_ACCEL_SEN * mpu_info.accely;
+    BMI088_Info->accel[2] = BMI088_ACCEL_SEN * mpu_info.accelz;
   }
 
-  /* receive the accelerator values */
-  BMI088_Accel_Read_Multi_Reg(BMI088_ACCEL_XOUT_L, buf, 6);
-  BMI088_Info->mpu_info.accelx = (int16_t)((buf[1] << 8) | buf[0]);
-  BMI088_Info->mpu_info.accely = (int16_t)((buf[3] << 8) | buf[2]);
-  BMI088_Info->mpu_info.accelz = (int16_t)((buf[5] << 8) | buf[4]);
+  /* convert the temperature value */
+  BMI088_Info->temperature = mpu_info.temperature * BMI088_TEMP_FACTOR + BMI088_TEMP_OFFSET;
 
-  /* convert the accelerator values */
-  BMI088_Info->accel[0] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accelx;
-  BMI088_Info->accel[1] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accely;
-  BMI088_Info->accel[2] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accelz;
+  /* convert the gyro values */
+  BMI088_Info->gyro[0] = BMI088_GYRO_SEN * mpu_info.gyrox - BMI088_Info->offset_gyrox;
+  BMI088_Info->gyro[1] = BMI088_GYRO_SEN * mpu_info.gyroy - BMI088_Info->offset_gyroy;
+  BMI088_Info->gyro[2] = BMI088_GYRO_SEN * mpu_info.gyroz - BMI088_Info->offset_gyroz;
 
-  /* receive the temperature value */
-  BMI088_Accel_Read_Multi_Reg(BMI088_TEMP_M, buf, 2);
-  BMI088_Info->mpu_info.temperature = (int16_t)((buf[0] << 3) | (buf[1] >> 5));
-  if (BMI088_Info->mpu_info.temperature > 1023) BMI088_Info->mpu_info.temperature -= 2048;
+#else
 
-  /* convert the temperature value */
-  BMI088_Info->temperature = BMI088_Info->mpu_info.temperature * BMI088_TEMP_FACTOR + BMI088_TEMP_OFFSET;
+  BMI088_Read_Typedef *read = &BMI088_Info->read;
+  uint8_t buf[6] = {0,};
+  uint8_t status = 0;
+  uint8_t accel_id = 0, gyro_id = 0;
+
+  /* the status, temperature and chip id were read with every update */
+  read->spi_bytes_full += BMI088_ACCEL_READ_LEN(1U) + BMI088_ACCEL_READ_LEN(2U) + BMI088_GYRO_READ_LEN(8U);
+
+  BMI088_Info->accel_ready = false;
+
+  if(true == BMI088_Read_Divide(&read->accel_skip,BMI088_READ_ACCEL_DIV))
+  {
+    /* check the accelerator data ready, cleared by reading the data */
+    BMI088_Accel_Read_Single_Reg(BMI088_ACC_STATUS, status);
+    BMI088_Info->accel_ready = ((status & BMI088_ACCEL_DRDY) != 0);
+    read->spi_bytes += BMI088_ACCEL_READ_LEN(1U);
+  }
 
-  /* receive the gyro values */
-  BMI088_Gyro_Read_Multi_Reg(BMI088_GYRO_CHIP_ID, buf, 8);
-  /* check the ID */
-  if(BMI088_GYRO_CHIP_ID_VALUE == buf[0])   
+  if(true == BMI088_Info->accel_ready)
   {
-    BMI088_Info->mpu_info.gyrox = (int16_t)((buf[3] << 8) | buf[2]);
-    BMI088_Info->mpu_info.gyroy = (int16_t)((buf[5] << 8) | buf[4]);
-    BMI088_Info->mpu_info.gyroz = (int16_t)((buf[7] << 8) | buf[6]);
+    /* receive the accelerator values */
+    BMI088_Accel_Read_Multi_Reg(BMI088_ACCEL_XOUT_L, buf, 6);
+    read->spi_bytes += BMI088_ACCEL_READ_LEN(6U);
+    read->spi_bytes_full += BMI088_ACCEL_READ_LEN(6U);
+    BMI088_Info->mpu_info.accelx = (int16_t)((buf[1] << 8) | buf[0]);
+    BMI088_Info->mpu_info.accely = (int16_t)((buf[3] << 8) | buf[2]);
+    BMI088_Info->mpu_info.accelz = (int16_t)((buf[5] << 8) | buf[4]);
+
+    /* convert the accelerator values */
+    BMI088_Info->accel[0] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accelx;
+    BMI088_Info->accel[1] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accely;
+    BMI088_Info->accel[2] = BMI088_ACCEL_SEN * BMI088_Info->mpu_info.accelz;
+  }
+
+  if(true == BMI088_Read_Due(&read->temp_tick,BMI088_READ_TEMP_PERIOD))
+  {
+    /* receive the temperature value */
+    BMI088_Accel_Read_Multi_Reg(BMI088_TEMP_M, buf, 2);
+    read->spi_bytes += BMI088_ACCEL_READ_LEN(2U);
+    BMI088_Info->mpu_info.temperature = (int16_t)((buf[0] << 3) | (buf[1] >> 5));
+    if (BMI088_Info->mpu_info.temperature > 1023) BMI088_Info->mpu_info.temperature -= 2048;
+
+    /* convert the temperature value */
+    BMI088_Info->temperature = BMI088_Info->mpu_info.temperature * BMI088_TEMP_FACTOR + BMI088_TEMP_OFFSET;
+  }
+
+  if(true == BMI088_Read_Divide(&read->gyro_skip,BMI088_READ_GYRO_DIV))
+  {
+    /* receive the gyro values, the chip id is left to the health check */
+    BMI088_Gyro_Read_Multi_Reg(BMI088_GYRO_XOUT_L, buf, 6);
+    read->spi_bytes += BMI088_GYRO_READ_LEN(6U);
+    BMI088_Info->mpu_info.gyrox = (int16_t)((buf[1] << 8) | buf[0]);
+    BMI088_Info->mpu_info.gyroy = (int16_t)((buf[3] << 8) | buf[2]);
+    BMI088_Info->mpu_info.gyroz = (int16_t)((buf[5] << 8) | buf[4]);
+  }
+
+  if(true == BMI088_Read_Due(&read->health_tick,BMI088_READ_HEALTH_PERIOD))
+  {
+    /* check the chip ids */
+    BMI088_Accel_Read_Single_Reg(BMI088_ACC_CHIP_ID, accel_id);
+    BMI088_Gyro_Read_Single_Reg(BMI088_GYRO_CHIP_ID, gyro_id);
+    read->spi_bytes += BMI088_ACCEL_READ_LEN(1U) + BMI088_GYRO_READ_LEN(1U);
+    BMI088_Health_Check(read,accel_id,gyro_id);
   }
 
   /* convert the gyro values */
   BMI088_Info->gyro[0] = BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyrox - BMI088_Info->offset_gyrox;
   BMI088_Info->gyro[1] = BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyroy - BMI088_Info->offset_gyroy;
   BMI088_Info->gyro[2] = BMI088_GYRO_SEN * BMI088_Info->mpu_info.gyroz - BMI088_Info->offset_gyroz;
+
+#endif
+
+  /* SPI bytes per second of the read schedule */
+  BMI088_Read_Rate_Update(&BMI088_Info->read);
+
+  /* calibrate the offsets in the background */
+  BMI088_Offset_Update(BMI088_Info);
 }
 //------------------------------------------------------------------------------
 
@@ -17,12 +17,75 @@
   */
 /* Includes ------------------------------------------------------------------*/
 #include "stdint.h"
+#include "bmi088.h"
 
 /**
  * @brief radian to degrees , 180.f/PI
  */
 #define RadiansToDegrees 57.295779513f
 
+/**
+ * @brief attitude engine of the IMU_Task
+ */
+#define IMU_ENGINE_QUATEKF             0U  /*!< Quaternion EKF, QuatEKF_Update() */
+#define IMU_ENGINE_QUATEKF_CLOSEDFORM  1U  /*!< Quaternion EKF in closed form */
+#define IMU_ENGINE_QUATESKF            2U  /*!< Quaternion error-state EKF */
+#define IMU_ENGINE_MAHONY              3U  /*!< Mahony complementary filter */
+
+#ifndef IMU_ENGINE
+#define IMU_ENGINE  IMU_ENGINE_QUATEKF_CLOSEDFORM
+#endif
+
+/**
+ * @brief nominal period of the IMU_Task and the limit of the measured period,
+ *        woken by every batch of the FIFOs, by every gyro read of the DMA
+ *        (2 kHz divided by BMI088_READ_GYRO_DIV), or delayed 1 ms when polling
+ */
+#if BMI088_USE_FIFO
+#define IMU_TASK_PERIOD   (BMI088_FIFO_GYRO_WATERMARK/BMI088_GYRO_ODR)
+#elif BMI088_USE_DMA
+#define IMU_TASK_PERIOD   (BMI088_READ_GYRO_DIV/BMI088_GYRO_ODR)
+#else
+#define IMU_TASK_PERIOD   0.001f
+#endif
+#define IMU_DT_MAX        0.01f
+
+/**
+ * @brief gyro samples pre-integrated per update of the attitude engine,
+ *        the engine runs at 500 Hz
+ */
+#ifndef IMU_FILTER_DECIMATION
+#if BMI088_USE_DMA
+#define IMU_FILTER_DECIMATION  4U
+#else
+#define IMU_FILTER_DECIMATION  2U
+#endif
+#endif
+
+/**
+ * @brief wakeups per update of the heat power control, every 2 ms at least
+ */
+#define IMU_HEAT_DECIMATION  ((uint32_t)(0.002f/IMU_TASK_PERIOD + 0.5f))
+
+/**
+ * @brief ticks waiting for the notification of a gyro sample or a batch
+ */
+#define IMU_SAMPLE_TIMEOUT  ((uint32_t)(IMU_TASK_PERIOD*1000.f) + 2U)
+
+/**
+ * @brief store of the calibrated offsets, ms between the attempts after a failed write
+ *        and the attempts per boot, every attempt may stall the core for about 1s
+ */
+#define IMU_OFFSET_STORE_RETRY     10000U
+#define IMU_OFFSET_STORE_ATTEMPTS  3U
+
+/**
+ * @brief histogram of the loop period, IMU_PERIOD_HIST_NUM bins of IMU_PERIOD_HIST_WIDTH,
+ *        the middle bin is centred on IMU_TASK_PERIOD, the outer bins hold the periods out of range
+ */
+#define IMU_PERIOD_HIST_NUM    11U
+#define IMU_PERIOD_HIST_WIDTH  0.00005f
+
 /* Exported types ------------------------------------------------------------*/
 
 /**
@@ -62,12 +125,42 @@ typedef struct
   float angle[3];
 	float gyro[3];	
 	float accel[3];
-	
-	float last_yawangle;
-	int16_t YawRoundCount;
+
+  bool stale;  /*!< no sample within IMU_SAMPLE_TIMEOUT or the health check of the BMI088 failed */
 }IMU_Info_Typedef;
 
+/**
+ * @brief Instance structure that contains the statistics of the IMU_Task period.
+ */
+typedef struct
+{
+  uint32_t timestamp;  /*!< DWT timestamp of the last sample */
+  float dt;            /*!< last period in seconds */
+  float dt_min;        /*!< min period in seconds */
+  float dt_max;        /*!< max period in seconds */
+  uint32_t count;      /*!< number of the periods */
+  uint32_t overrun;    /*!< periods longer than 1.5f*IMU_TASK_PERIOD */
+  uint32_t timeout;    /*!< notifications of the gyro sample timed out */
+  uint32_t histogram[IMU_PERIOD_HIST_NUM]; /*!< histogram of the period */
+}IMU_Timing_Typedef;
+
 /* Exported functions prototypes ---------------------------------------------*/
+/**
+  * @brief  Measure the period since the last sample and update the statistics
+  * @param  timing: point to IMU_Timing_Typedef structure that
+  *         contains the statistics of the IMU_Task period
+  * @param  timestamp: DWT timestamp of the sample
+  * @retval period in seconds, limited to IMU_DT_MAX
+  */
+extern float IMU_Period_Update(IMU_Timing_Typedef *timing,uint32_t timestamp);
+
+/**
+  * @brief  Report the vehicle idle, the flash may stall the core to store the offsets.
+  * @note   weak, override it with the disarm state of the actuators,
+  *         the default is the BMI088 inside a still window of the calibration.
+  * @retval true if the vehicle is idle
+  */
+extern bool IMU_Vehicle_Idle(void);
 
 #endif
 
@@ -17,13 +17,18 @@
   */
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
+#include "main.h"
 #include "cmsis_os.h"
 #include "IMU_Task.h"
 #include "bmi088.h"
 #include "quaternion.h"
+#include "mahony.h"
+#include "gyro_preint.h"
 #include "lpf.h"
 #include "pid.h"
 #include "bsp_tim.h"
+#include "bsp_timebase.h"
+#include "string.h"
 
 /**
   * @brief Instance structure of IMU.
@@ -45,6 +50,7 @@ float Accel_Slpf_alpha[3] = {0.002329458745586203f, 1.929454039488895f, -0.93178
   */
 SecondOrderLowpass_Typedef BMI088_Accel_Slpf[3];
 
+#if (IMU_ENGINE == IMU_ENGINE_QUATEKF) || (IMU_ENGINE == IMU_ENGINE_QUATEKF_CLOSEDFORM)
 /**
   * @brief data of state transition matrix.
   */
@@ -63,6 +69,17 @@ static float QuatEKF_Data_P[36]= {100000, 0.1, 0.1, 0.1, 0.1, 0.1,
                                  0.1, 0.1, 0.1, 100000, 0.1, 0.1,
                                  0.1, 0.1, 0.1, 0.1, 100, 0.1,
                                  0.1, 0.1, 0.1, 0.1, 0.1, 100};
+#elif (IMU_ENGINE == IMU_ENGINE_QUATESKF)
+/**
+  * @brief data of posteriori covariance matrix, rotation error and gyro bias.
+  */
+static float QuatESKF_Data_P[36]={1, 0, 0, 0, 0, 0,
+                                 0, 1, 0, 0, 0, 0,
+                                 0, 0, 1, 0, 0, 0,
+                                 0, 0, 0, 100, 0, 0,
+                                 0, 0, 0, 0, 100, 0,
+                                 0, 0, 0, 0, 0, 100};
+#endif
 
 /**
   * @brief parameters of Heat Power PID.
@@ -79,6 +96,23 @@ PID_Info_TypeDef HeatPower_PID;
   */
 Quat_Info_Typedef Quat_Info;
 
+/**
+  * @brief Instance structure of gyro pre-integration.
+  */
+GyroPreInt_Typedef Gyro_PreInt;
+
+/**
+  * @brief Instance structure of the IMU_Task period statistics.
+  */
+IMU_Timing_Typedef IMU_Timing;
+
+#if BMI088_USE_FIFO
+/**
+  * @brief Instance structure of the batch drained from the BMI088 FIFOs.
+  */
+BMI088_FIFO_Batch_Typedef BMI088_Batch;
+#endif
+
 /**
   * @brief  Update BMI088 Heat Power PWM
   * @param  temp  measure temperature of the BMI088 
@@ -94,13 +128,182 @@ static void BMI088_HeatPower_Control(float temp)
 }
 //------------------------------------------------------------------------------
 
+/**
+  * @brief  Measure the period since the last sample and update the statistics
+  * @param  timing: point to IMU_Timing_Typedef structure that
+  *         contains the statistics of the IMU_Task period
+  * @param  timestamp: DWT timestamp of the sample
+  * @retval period in seconds, limited to IMU_DT_MAX
+  */
+float IMU_Period_Update(IMU_Timing_Typedef *timing,uint32_t timestamp)
+{
+  int32_t bin = 0;
+
+  /* measured period of the DWT timestamp */
+  timing->dt = Timestamp_Get_Interval(&timing->timestamp,timestamp);
+
+  /* min/max and overrun */
+  if(timing->dt < timing->dt_min)
+  {
+    timing->dt_min = timing->dt;
+  }
+  if(timing->dt > timing->dt_max)
+  {
+    timing->dt_max = timing->dt;
+  }
+  if(timing->dt > 1.5f*IMU_TASK_PERIOD)
+  {
+    timing->overrun++;
+  }
+  timing->count++;
+
+  /* histogram centred on the nominal period */
+  bin = (int32_t)((timing->dt - IMU_TASK_PERIOD) / IMU_PERIOD_HIST_WIDTH + IMU_PERIOD_HIST_NUM/2.f);
+  VAL_LIMIT(bin,0,(int32_t)IMU_PERIOD_HIST_NUM-1);
+  timing->histogram[bin]++;
+
+  return (timing->dt > IMU_DT_MAX) ? IMU_DT_MAX : timing->dt;
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Report the vehicle idle, the flash may stall the core to store the offsets.
+  * @note   weak, override it with the disarm state of the actuators,
+  *         the default is the BMI088 inside a still window of the calibration.
+  * @retval true if the vehicle is idle
+  */
+__weak bool IMU_Vehicle_Idle(void)
+{
+  return (BMI088_Info.cali.count > 0U);
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Store the calibrated offsets in the flash while the vehicle is idle,
+  *         called outside the sensor path, a failed write is retried slowly
+  * @retval none
+  */
+static void IMU_Offset_Store(void)
+{
+  // tick and number of the failed attempts
+  static uint32_t retry_tick = 0;
+  static uint32_t attempts = 0;
+
+  if(false == BMI088_Info.cali.save_pending || attempts >= IMU_OFFSET_STORE_ATTEMPTS)
+  {
+    return;
+  }
+
+  /* every attempt may stall the core */
+  if(attempts > 0U && (osKernelSysTick() - retry_tick) < IMU_OFFSET_STORE_RETRY)
+  {
+    return;
+  }
+
+  if(false == IMU_Vehicle_Idle())
+  {
+    return;
+  }
+
+  /* save_pending is cleared by a successful write only */
+  if(false == BMI088_Offset_Store(&BMI088_Info))
+  {
+    attempts++;
+    retry_tick = osKernelSysTick();
+  }
+}
+//------------------------------------------------------------------------------
+
+/**
+  * @brief  Filter a sample, pre-integrate the gyro and update the attitude engine
+  *         every IMU_FILTER_DECIMATION samples
+  * @param  gyro: point to the gyro sample
+  * @param  accel: point to the accel sample, held between the accel samples
+  * @param  accel_ready: accel is a fresh sample
+  * @param  dt: period of the sample
+  * @retval none
+  */
+static void IMU_Sample_Update(const float gyro[3],const float accel[3],bool accel_ready,float dt)
+{
+  // fresh accel sample since the last filter update
+  static bool accel_fresh = false;
+
+  // rate and period of the pre-integrated gyro
+  float gyro_rate[3] = {0.f};
+  float filter_dt = 0.f;
+
+  // store the data of BMI088 accel and gyro
+  IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_PITCH] = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[0],accel[IMU_ACCEL_GYRO_INDEX_PITCH]);
+  IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_YAW]   = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[1],accel[IMU_ACCEL_GYRO_INDEX_YAW])  ;
+  IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_ROLL]  = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[2],accel[IMU_ACCEL_GYRO_INDEX_ROLL]) ;
+
+  IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_PITCH] = gyro[IMU_ACCEL_GYRO_INDEX_PITCH];
+  IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_YAW]   = gyro[IMU_ACCEL_GYRO_INDEX_YAW]  ;
+  IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_ROLL]  = gyro[IMU_ACCEL_GYRO_INDEX_ROLL] ;
+
+  /* accumulate every gyro sample, coning compensated */
+  GyroPreInt_Update(&Gyro_PreInt,IMU_Info.gyro,dt);
+  accel_fresh |= accel_ready;
+
+  if(Gyro_PreInt.count >= IMU_FILTER_DECIMATION)
+  {
+    filter_dt = GyroPreInt_Fetch(&Gyro_PreInt,gyro_rate);
+
+    /* Update the attitude engine, prediction only without a fresh accel sample */
+#if (IMU_ENGINE == IMU_ENGINE_QUATEKF)
+    QuatEKF_Update(&Quat_Info,gyro_rate,(accel_fresh == true) ? IMU_Info.accel : NULL,filter_dt);
+#elif (IMU_ENGINE == IMU_ENGINE_QUATEKF_CLOSEDFORM)
+    QuatEKF_ClosedForm_Update(&Quat_Info,gyro_rate,(accel_fresh == true) ? IMU_Info.accel : NULL,filter_dt);
+#elif (IMU_ENGINE == IMU_ENGINE_QUATESKF)
+    QuatESKF_Update(&Quat_Info,gyro_rate,(accel_fresh == true) ? IMU_Info.accel : NULL,filter_dt);
+#elif (IMU_ENGINE == IMU_ENGINE_MAHONY)
+    Mahony_Update(&Quat_Info,gyro_rate,(accel_fresh == true) ? IMU_Info.accel : NULL,filter_dt);
+#endif
+
+    accel_fresh = false;
+  }
+}
+//------------------------------------------------------------------------------
+
 /**
  * @brief Initialize the IMU_Task.
  */
 static void IMU_Task_Init(void)
 {
+  BMI088_Init_State_e init_state = BMI088_INIT_RESET;
+
+  /* initialize the bmi088 a step per tick, the other tasks run meanwhile */
+  do
+  {
+    init_state = BMI088_Init_Update(&BMI088_Info);
+    osDelay(1);
+  }while(init_state != BMI088_INIT_DONE && init_state != BMI088_INIT_FAILED);
+
+  /* no sensor, the status stays in BMI088_Info.init */
+  if(init_state == BMI088_INIT_FAILED)
+  {
+    osThreadSuspend(osThreadGetId());
+  }
+
+  /* load the offsets of the bmi088, calibrated in the background */
+  BMI088_Offset_Init(&BMI088_Info);
+
+  /* the DWT timestamps the watermarks of the FIFOs */
+  Timestamp_Init();
+
+#if BMI088_USE_DMA
+  /* wait the first sample or batch of the DMA */
+  BMI088_Acquire_Start(&BMI088_Info,osThreadGetId());
+  ulTaskNotifyTake(pdTRUE,IMU_SAMPLE_TIMEOUT);
+#endif
+
+#if BMI088_USE_FIFO
+  // drop the first batch, keep its last frames
+  BMI088_FIFO_Batch_Get(&BMI088_Info,&BMI088_Batch);
+#else
 	// update bmi088 informations
 	BMI088_Info_Update(&BMI088_Info);
+#endif
 	
   /* Initializes the filter output */
   SecondOrderLowpass_Init(&BMI088_Accel_Slpf[0],Accel_Slpf_alpha,BMI088_Info.accel[IMU_ACCEL_GYRO_INDEX_PITCH]);
@@ -110,8 +313,27 @@ static void IMU_Task_Init(void)
   /* Initializes the Temperature Control PID  */
 	PID_Init(&HeatPower_PID,PID_VELOCITY,HeatPower_PID_Param);
 	
-  /* Initializes the Quaternion EKF */
+  /* Initializes the attitude engine */
+#if (IMU_ENGINE == IMU_ENGINE_QUATEKF) || (IMU_ENGINE == IMU_ENGINE_QUATEKF_CLOSEDFORM)
 	QuatEKF_Init(&Quat_Info,10.f, 0.001f, 1000000.f,QuatEKF_Data_A,QuatEKF_Data_P);
+#elif (IMU_ENGINE == IMU_ENGINE_QUATESKF)
+	QuatESKF_Init(&Quat_Info,10.f, 0.001f, 1000000.f,QuatESKF_Data_P);
+#elif (IMU_ENGINE == IMU_ENGINE_MAHONY)
+	Mahony_Init(&Quat_Info,1.f,0.05f);
+#endif
+
+  /* Initializes the gyro pre-integration */
+  GyroPreInt_Reset(&Gyro_PreInt);
+
+  /* Initializes the timestamp of the samples */
+  memset(&IMU_Timing, 0, sizeof(IMU_Timing));
+  IMU_Timing.dt_min = IMU_DT_MAX;
+#if BMI088_USE_FIFO
+  /* the batches are timed from the watermark of the dropped one */
+  IMU_Timing.timestamp = (BMI088_Batch.gyro_num != 0U) ? BMI088_Batch.timestamp : Timestamp_Get();
+#else
+  IMU_Timing.timestamp = Timestamp_Get();
+#endif
 }
 
 /* USER CODE BEGIN Header_IMU_Task */
@@ -128,65 +350,132 @@ void IMU_Task(void const * argument)
   // Initialize the IMU Task
   IMU_Task_Init();
 
+#if !BMI088_USE_DMA
   // Holds the time at the task was last unblocked.
 	TickType_t ticks = 0;
+#endif
+
+  // point to the angle of the quaternion
+  const float *angle = NULL;
+
+  // measured period of the sample
+  float sample_dt = 0.f;
 
+#if BMI088_USE_FIFO
+  // accel frames spread over the gyro frames of a batch
+  float accel_hold[3] = {BMI088_Info.accel[0],BMI088_Info.accel[1],BMI088_Info.accel[2]};
+  uint8_t accel_index = 0;
+  uint8_t accel_due = 0;
+#endif
+
+  // samples since the last heat power control
+  uint32_t heat_count = 0;
+
+#if !BMI088_USE_DMA
   // Initialize the time.
   // Will be update in function osDelayUntil.
   ticks = osKernelSysTick();
+#endif
 
   /* Infinite loop */
   for(;;)
   {
+#if BMI088_USE_DMA
+    // wait for a gyro sample or a batch in memory
+    if(ulTaskNotifyTake(pdTRUE,IMU_SAMPLE_TIMEOUT) == 0U)
+    {
+      IMU_Timing.timeout++;
+
+      /* the values are frozen and the temperature is unknown, stop the heater */
+      IMU_Info.stale = true;
+      Heat_Power_Control(0);
+
+      /* keep checking the sensor without its interrupts */
+      BMI088_Read_Schedule(&BMI088_Info);
+      continue;
+    }
+#endif
+
+#if BMI088_USE_FIFO
+    // drain the batch of the FIFOs
+    if(BMI088_FIFO_Batch_Get(&BMI088_Info,&BMI088_Batch) == false || BMI088_Batch.gyro_num == 0U)
+    {
+      continue;
+    }
+
+    // period between the watermarks of the batches, shared by the gyro frames
+    sample_dt = IMU_Period_Update(&IMU_Timing,BMI088_Batch.timestamp) / BMI088_Batch.gyro_num;
+
+    accel_index = 0;
+    for(uint8_t i = 0; i < BMI088_Batch.gyro_num; i++)
+    {
+      /* accel frames due at the gyro frame, oldest first */
+      accel_due = (uint8_t)((i + 1U) * BMI088_Batch.accel_num / BMI088_Batch.gyro_num);
+      if(accel_due > accel_index)
+      {
+        accel_index = accel_due;
+        memcpy(accel_hold,BMI088_Batch.accel[accel_index-1],sizeof(accel_hold));
+        IMU_Sample_Update(BMI088_Batch.gyro[i],accel_hold,true,sample_dt);
+      }
+      else
+      {
+        IMU_Sample_Update(BMI088_Batch.gyro[i],accel_hold,false,sample_dt);
+      }
+    }
+#else
 		// update bmi088 informations
 		BMI088_Info_Update(&BMI088_Info);
 
-    // store the data of BMI088 accel and gyro
-    IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_PITCH] = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[0],BMI088_Info.accel[IMU_ACCEL_GYRO_INDEX_PITCH]);
-    IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_YAW]   = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[1],BMI088_Info.accel[IMU_ACCEL_GYRO_INDEX_YAW])  ;
-    IMU_Info.accel[IMU_ACCEL_GYRO_INDEX_ROLL]  = SecondOrderLowpass_Update(&BMI088_Accel_Slpf[2],BMI088_Info.accel[IMU_ACCEL_GYRO_INDEX_ROLL]) ;
-
-    IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_PITCH] = BMI088_Info.gyro[IMU_ACCEL_GYRO_INDEX_PITCH];
-    IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_YAW]   = BMI088_Info.gyro[IMU_ACCEL_GYRO_INDEX_YAW]  ;
-    IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_ROLL]  = BMI088_Info.gyro[IMU_ACCEL_GYRO_INDEX_ROLL] ;
+    // timestamp the sample, measure the period
+    sample_dt = IMU_Period_Update(&IMU_Timing,Timestamp_Get());
 
-		/* Update the Quaternion EKF */
-    QuatEKF_Update(&Quat_Info,IMU_Info.gyro,IMU_Info.accel,0.001f);
+    IMU_Sample_Update(BMI088_Info.gyro,BMI088_Info.accel,BMI088_Info.accel_ready,sample_dt);
+#endif
 
-    IMU_Info.angle[IMU_ANGLE_INDEX_YAW] = Quat_Info.angle[IMU_ANGLE_INDEX_YAW];
-    IMU_Info.angle[IMU_ANGLE_INDEX_PITCH] = Quat_Info.angle[IMU_ANGLE_INDEX_PITCH];
-    IMU_Info.angle[IMU_ANGLE_INDEX_ROLL] = Quat_Info.angle[IMU_ANGLE_INDEX_ROLL];  
+    /* get the angle in radians, derived from the quaternion on demand */
+    angle = Quat_Get_Angle(&Quat_Info);
+    IMU_Info.angle[IMU_ANGLE_INDEX_YAW] = angle[IMU_ANGLE_INDEX_YAW];
+    IMU_Info.angle[IMU_ANGLE_INDEX_PITCH] = angle[IMU_ANGLE_INDEX_PITCH];
+    IMU_Info.angle[IMU_ANGLE_INDEX_ROLL] = angle[IMU_ANGLE_INDEX_ROLL];  
 
 		/* store the angle in degrees. */
-    IMU_Info.pit_angle = Quat_Info.angle[IMU_ANGLE_INDEX_PITCH]*RadiansToDegrees;
-    IMU_Info.yaw_angle = Quat_Info.angle[IMU_ANGLE_INDEX_YAW]*RadiansToDegrees;
-    IMU_Info.rol_angle = Quat_Info.angle[IMU_ANGLE_INDEX_ROLL]*RadiansToDegrees;
+    IMU_Info.pit_angle = angle[IMU_ANGLE_INDEX_PITCH]*RadiansToDegrees;
+    IMU_Info.yaw_angle = angle[IMU_ANGLE_INDEX_YAW]*RadiansToDegrees;
+    IMU_Info.rol_angle = angle[IMU_ANGLE_INDEX_ROLL]*RadiansToDegrees;
 
     /* store the yaw total angle */
-		if(IMU_Info.yaw_angle - IMU_Info.last_yawangle < -180.f)
-		{
-			IMU_Info.YawRoundCount++;
-		}
-		else if(IMU_Info.yaw_angle - IMU_Info.last_yawangle > 180.f)
-		{
-			IMU_Info.YawRoundCount--;
-		}
-		IMU_Info.last_yawangle = IMU_Info.yaw_angle;
-		
-		IMU_Info.yaw_tolangle = IMU_Info.yaw_angle + IMU_Info.YawRoundCount*360.f;
+		IMU_Info.yaw_tolangle = Quat_Get_YawTotal(&Quat_Info)*RadiansToDegrees;
 
     /* Update the INS gyro in degrees */
     IMU_Info.pit_gyro = IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_PITCH]*RadiansToDegrees;
     IMU_Info.yaw_gyro = IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_YAW]*RadiansToDegrees;
     IMU_Info.rol_gyro = IMU_Info.gyro[IMU_ACCEL_GYRO_INDEX_ROLL]*RadiansToDegrees;
 
-		if(ticks%2 == 0)
+    /* fresh values, unless the chip ids of the health check are wrong */
+    IMU_Info.stale = (false == BMI088_Info.read.health_ok);
+
+		if(++heat_count >= IMU_HEAT_DECIMATION)
 		{
-			BMI088_HeatPower_Control(BMI088_Info.temperature);
+			heat_count = 0;
+
+      /* no heat on the temperature of a failed sensor */
+      if(true == IMU_Info.stale)
+      {
+        Heat_Power_Control(0);
+      }
+      else
+      {
+        BMI088_HeatPower_Control(BMI088_Info.temperature);
+      }
 		}
 
+    /* store the calibrated offsets after the sample, the flash stalls the core */
+    IMU_Offset_Store();
+
+#if !BMI088_USE_DMA
     // Delay the task until 1 ms
     osDelayUntil(&ticks,1);
+#endif
   }
   /* USER CODE END IMU_Task */
 }
@@ -0,0 +1,491 @@
+#!/usr/bin/env python3
+"""
+Generate a specialized, fully unrolled Kalman_Filter_Update() from a filter description.
+
+usage: python3 kalman_codegen.py <description.json> [output directory]
+
+The description is a JSON object:
+  name     : name of the filter, the generated function is Kalman_<name>_Update()
+  xhatSize : size of state vector
+  uSize    : size of control vector
+  zSize    : size of measurement vector
+  A, B, H  : sparsity pattern, one string of '0'/'1' per row, omitted if dense
+  skip     : steps skipped statically (1-5), the other steps still honor SkipStepN
+  hooks    : User_Function0-6 called by the filter, the others are never called
+  brief    : optional one line description
+
+The generated code works on the data of a Kalman_Info_TypeDef initialized by
+Kalman_Filter_Init()/Kalman_Filter_Static_Init(): structural zeros are skipped,
+the model and covariance elements are loaded once into locals and the products
+A·P and H·Pminus are shared by all elements that use them. The covariance is
+propagated in the symmetric form of the core (SymmetricP). The core update is
+called instead when SteadyState, UDFactor, SequentialUpdate or JosephForm is set,
+when SymmetricP is cleared or when only a part of the measurements is fresh.
+The telemetry and, with KALMAN_PROFILE_ENABLE, the cycles of every step, user
+function and update are recorded like the core.
+"""
+
+import json
+import os
+import sys
+
+SEPARATOR = "//------------------------------------------------------------------------------"
+
+
+def parse_pattern(desc, key, rows, cols):
+    """Return the sparsity pattern as a list of rows of bool."""
+    if key not in desc or desc[key] is None:
+        return [[True] * cols for _ in range(rows)]
+    pattern = desc[key]
+    if len(pattern) != rows or any(len(row) != cols for row in pattern):
+        raise ValueError("%s must be %d rows of %d columns" % (key, rows, cols))
+    return [[c == "1" for c in row] for row in pattern]
+
+
+def sum_of(terms, first="0.f"):
+    """Sum of products accumulated left to right like the loops of the core."""
+    if not terms:
+        return first
+    return " + ".join(terms)
+
+
+class Generator:
+    def __init__(self, desc):
+        self.name = desc["name"]
+        self.x = int(desc["xhatSize"])
+        self.u = int(desc.get("uSize", 0))
+        self.z = int(desc["zSize"])
+        self.A = parse_pattern(desc, "A", self.x, self.x)
+        self.B = parse_pattern(desc, "B", self.x, self.u)
+        self.H = parse_pattern(desc, "H", self.z, self.x)
+        self.skip = set(int(s) for s in desc.get("skip", []))
+        self.hooks = set(int(h) for h in desc.get("hooks", []))
+        self.brief = desc.get("brief", "specialized update of the %s kalman filter" % self.name)
+        if self.x > 32 or self.z > 32:
+            raise ValueError("xhatSize and zSize are limited to 32")
+        self.lines = []
+
+    # -------------------------------------------------------------------------
+    def emit(self, text="", indent=1):
+        self.lines.append(("  " * indent + text) if text else "")
+
+    def hook(self, index):
+        if index in self.hooks:
+            self.emit("/* User Function %d */" % index)
+            self.emit("%s_User_Function(kf, kf->User_Function%d, %d);" % (self.name, index, index))
+
+    def begin_step(self, step, text):
+        self.emit()
+        self.emit("/* %s */" % text)
+        self.emit("kf->Telemetry.ActiveFlag = KALMAN_ERROR_STEP(%d);" % step)
+        self.emit("step = KALMAN_PROFILE_START();")
+
+    def end_step(self, step):
+        self.emit("KALMAN_PROFILE_STORE(kf->Telemetry.StepCycles[%d], step);" % (step - 1))
+
+    # -------------------------------------------------------------------------
+    def step1(self):
+        x, u = self.x, self.u
+        self.begin_step(1, "Update the priori state estimate: xhatminus(k) = A·xhat(k-1) + B·u(k)")
+        if 1 in self.skip:
+            self.emit("/* skipped */")
+            return
+        self.emit("if(kf->SkipStep1 == 0)")
+        self.emit("{")
+        for i in range(x):
+            terms = ["A[%d]*xhat[%d]" % (i * x + l, l) for l in range(x) if self.A[i][l]]
+            expr = sum_of(terms)
+            if u > 0:
+                bterms = ["B[%d]*u[%d]" % (i * u + l, l) for l in range(u) if self.B[i][l]]
+                if bterms:
+                    expr = "(%s) + (%s)" % (expr, sum_of(bterms))
+            self.emit("xhatminus[%d] = %s;" % (i, expr), 2)
+        self.emit("}")
+
+    def step2(self):
+        x = self.x
+        self.begin_step(2, "Update the priori covariance: Pminus(k) = A·P(k-1)·AT + Q, upper triangle mirrored")
+        if 2 in self.skip:
+            self.emit("/* skipped */")
+            return
+        self.emit("if(kf->SkipStep2 == 0)")
+        self.emit("{")
+        # A·P, only the columns of P used by the nonzero elements of A
+        self.emit("/* AP = A·P(k-1) */", 2)
+        for i in range(x):
+            for j in range(x):
+                # only the elements used by the upper triangle of Pminus
+                if not any(self.A[k][j] for k in range(i, x)):
+                    continue
+                terms = ["A[%d]*P[%d]" % (i * x + l, l * x + j) for l in range(x) if self.A[i][l]]
+                self.emit("const float AP_%d_%d = %s;" % (i, j, sum_of(terms)), 2)
+        self.emit("/* Pminus = AP·AT + Q */", 2)
+        for i in range(x):
+            for j in range(i, x):
+                terms = ["AP_%d_%d*A[%d]" % (i, l, j * x + l) for l in range(x) if self.A[j][l]]
+                q = "0.5f*(Q[%d] + Q[%d])" % (i * x + j, j * x + i)
+                target = "Pminus[%d]" % (i * x + j)
+                if i == j:
+                    self.emit("%s = (%s) + %s;" % (target, sum_of(terms), q), 2)
+                else:
+                    self.emit("%s = Pminus[%d] = (%s) + %s;" % (target, j * x + i, sum_of(terms), q), 2)
+        self.emit("}")
+
+    def emit_HP(self, source, indent):
+        x, z = self.x, self.z
+        self.emit("/* HP = H·Pminus(k) */", indent)
+        for i in range(z):
+            for j in range(x):
+                terms = ["H[%d]*%s[%d]" % (i * x + l, source, l * x + j) for l in range(x) if self.H[i][l]]
+                self.emit("const float HP_%d_%d = %s;" % (i, j, sum_of(terms)), indent)
+
+    def step3(self):
+        x, z = self.x, self.z
+        self.begin_step(3, "Update the kalman gain: K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R)")
+        self.emit("if(measured == false)")
+        self.emit("{")
+        self.emit("/* xhat(k) = xhatminus(k), P(k) = Pminus(k) */", 2)
+        self.emit("memcpy(xhat, xhatminus, sizeof(float) * %d);" % x, 2)
+        self.emit("memcpy(P, Pminus, sizeof(float) * %d);" % (x * x), 2)
+        self.emit("}")
+        if 3 in self.skip:
+            return
+        self.emit("else if(kf->SkipStep3 == 0)")
+        self.emit("{")
+        self.emit("if(%s_K_Update(kf) != ARM_MATH_SUCCESS)" % self.name, 2)
+        self.emit("{", 2)
+        self.emit("/* no gain from an invalid innovation covariance */", 3)
+        self.emit("%s_Status_Record(kf, ARM_MATH_SINGULAR);" % self.name, 3)
+        self.emit("memset(K, 0, sizeof(float) * %d);" % (x * z), 3)
+        self.emit("}", 2)
+        self.emit("}")
+
+    def gain(self):
+        """Body of the kalman gain function, straight-line cholesky solve of S·KT = HP."""
+        x, z = self.x, self.z
+        self.lines = []
+        self.emit("const float *Pminus = kf->pdata.Pminus, *H = kf->pdata.H, *R = kf->pdata.R;")
+        self.emit("float *K = kf->pdata.K;")
+        self.emit("float d = 0.f;")
+        self.emit()
+        self.emit_HP("Pminus", 1)
+        self.emit()
+        self.emit("/* S = HP·HT + R */")
+        for i in range(z):
+            for j in range(i, z):
+                terms = ["HP_%d_%d*H[%d]" % (i, l, j * x + l) for l in range(x) if self.H[j][l]]
+                r = "0.5f*(R[%d] + R[%d])" % (i * z + j, j * z + i)
+                self.emit("const float S_%d_%d = (%s) + %s;" % (i, j, sum_of(terms), r))
+        self.emit()
+        self.emit("/* L = cholesky(S), S must be positive definite */")
+        for j in range(z):
+            diag = "S_%d_%d" % (j, j) + "".join(" - L_%d_%d*L_%d_%d" % (j, k, j, k) for k in range(j))
+            self.emit("d = %s;" % diag)
+            self.emit("if(!(d > 0.f))")
+            self.emit("{")
+            self.emit("return ARM_MATH_SINGULAR;", 2)
+            self.emit("}")
+            self.emit("const float L_%d_%d = sqrtf(d);" % (j, j))
+            for i in range(j + 1, z):
+                off = "S_%d_%d" % (j, i) + "".join(" - L_%d_%d*L_%d_%d" % (i, k, j, k) for k in range(j))
+                self.emit("const float L_%d_%d = (%s) / L_%d_%d;" % (i, j, off, j, j))
+        self.emit()
+        self.emit("/* K = (inverse(L·LT)·HP)T, forward and back substitution per column of HP */")
+        for c in range(x):
+            for i in range(z):
+                fw = "HP_%d_%d" % (i, c) + "".join(" - L_%d_%d*Y_%d_%d" % (i, k, k, c) for k in range(i))
+                self.emit("const float Y_%d_%d = (%s) / L_%d_%d;" % (i, c, fw, i, i))
+            for i in reversed(range(z)):
+                bw = "Y_%d_%d" % (i, c) + "".join(" - L_%d_%d*K[%d]" % (k, i, c * z + k) for k in range(i + 1, z))
+                self.emit("K[%d] = (%s) / L_%d_%d;" % (c * z + i, bw, i, i))
+        self.emit()
+        self.emit("return ARM_MATH_SUCCESS;")
+        return self.lines
+
+    def step4(self):
+        x, z = self.x, self.z
+        self.begin_step(4, "Update the posteriori state estimate: xhat(k) = xhatminus(k) + K(k)·(z(k) - H·xhatminus(k))")
+        if 4 in self.skip:
+            self.emit("/* skipped */")
+            return
+        self.emit("if(measured == true && kf->SkipStep4 == 0)")
+        self.emit("{")
+        for i in range(z):
+            terms = ["H[%d]*xhatminus[%d]" % (i * x + l, l) for l in range(x) if self.H[i][l]]
+            self.emit("const float r_%d = zk[%d] - (%s);" % (i, i, sum_of(terms)), 2)
+        for i in range(x):
+            terms = ["K[%d]*r_%d" % (i * z + k, k) for k in range(z)]
+            self.emit("xhat[%d] = xhatminus[%d] + (%s);" % (i, i, sum_of(terms)), 2)
+        self.emit("}")
+
+    def step5(self):
+        x, z = self.x, self.z
+        self.begin_step(5, "Update the posteriori covariance: P(k) = Pminus(k) - K(k)·H·Pminus(k), upper triangle mirrored")
+        if 5 in self.skip:
+            self.emit("/* skipped */")
+            return
+        self.emit("if(measured == true && kf->SkipStep5 == 0)")
+        self.emit("{")
+        self.emit_HP("Pminus", 2)
+        self.emit("/* P = Pminus - K·HP */", 2)
+        for i in range(x):
+            for j in range(i, x):
+                terms = ["K[%d]*HP_%d_%d" % (i * z + k, k, j) for k in range(z)]
+                pm = "0.5f*(Pminus[%d] + Pminus[%d])" % (i * x + j, j * x + i)
+                target = "P[%d]" % (i * x + j)
+                if i == j:
+                    self.emit("%s = %s - (%s);" % (target, pm, sum_of(terms)), 2)
+                else:
+                    self.emit("%s = P[%d] = %s - (%s);" % (target, j * x + i, pm, sum_of(terms)), 2)
+        self.emit("}")
+
+    # -------------------------------------------------------------------------
+    def source(self, description):
+        name, x, u, z = self.name, self.x, self.u, self.z
+        zmask = "0x%XU" % ((1 << z) - 1)
+        out = []
+        out.append("/* USER CODE BEGIN Header */")
+        out.append("/**")
+        out.append("  ******************************************************************************")
+        out.append("  * File Name          : kalman_%s.c" % name.lower())
+        out.append("  * Description        : %s." % self.brief)
+        out.append("  ******************************************************************************")
+        out.append("  * @attention      : generated by script/kalman_codegen.py from %s," % description)
+        out.append("  *                   do not edit, regenerate after the description is changed.")
+        out.append("  *")
+        out.append("  * Copyright 2024 COD USTL.")
+        out.append("  * All rights reserved.")
+        out.append("  *")
+        out.append("  ******************************************************************************")
+        out.append("  */")
+        out.append("/* USER CODE END Header */")
+        out.append("")
+        out.append("/* Includes ------------------------------------------------------------------*/")
+        out.append('#include "kalman_%s.h"' % name.lower())
+        out.append("")
+        out.append("#if KALMAN_PROFILE_ENABLE")
+        out.append('#include "stm32f4xx.h"')
+        out.append("#endif")
+        out.append("")
+        out.append("/* Private function ----------------------------------------------------------*/")
+        out.append("/**")
+        out.append("  * @brief store a failure status in the telemetry of the kalman filter.")
+        out.append("  * @param kf: point to a Kalman_Info_TypeDef structure that")
+        out.append("  *         contains the informations of kalman filter.")
+        out.append("  * @param status: failure status")
+        out.append("  * @retval none")
+        out.append("  */")
+        out.append("static void %s_Status_Record(Kalman_Info_TypeDef *kf,arm_status status)" % name)
+        out.append("{")
+        out.append("  kf->ErrorStatus = status;")
+        out.append("  kf->Telemetry.ErrorFlags |= kf->Telemetry.ActiveFlag;")
+        out.append("  kf->Telemetry.LastError = status;")
+        out.append("  if(status == ARM_MATH_SINGULAR)")
+        out.append("  {")
+        out.append("    kf->Telemetry.SingularCnt++;")
+        out.append("  }")
+        out.append("}")
+        out.append(SEPARATOR)
+        out.append("")
+        if self.hooks:
+            out.append("/**")
+            out.append("  * @brief Call a user function and record its status in the telemetry.")
+            out.append("  * @param kf: point to a Kalman_Info_TypeDef structure that")
+            out.append("  *         contains the informations of kalman filter.")
+            out.append("  * @param User_Function: user function, skipped if NULL")
+            out.append("  * @param index: index of the user function, 0-6")
+            out.append("  * @retval none")
+            out.append("  */")
+            out.append("static void %s_User_Function(Kalman_Info_TypeDef *kf,void (*User_Function)(Kalman_Info_TypeDef *kf),uint8_t index)" % name)
+            out.append("{")
+            out.append("  uint32_t start = 0;")
+            out.append("")
+            out.append("  if(User_Function == NULL)")
+            out.append("  {")
+            out.append("    return;")
+            out.append("  }")
+            out.append("")
+            out.append("  kf->Telemetry.ActiveFlag = KALMAN_ERROR_HOOK(index);")
+            out.append("  start = KALMAN_PROFILE_START();")
+            out.append("")
+            out.append("  kf->ErrorStatus = ARM_MATH_SUCCESS;")
+            out.append("  User_Function(kf);")
+            out.append("  if(kf->ErrorStatus != ARM_MATH_SUCCESS)")
+            out.append("  {")
+            out.append("    %s_Status_Record(kf, kf->ErrorStatus);" % name)
+            out.append("  }")
+            out.append("")
+            out.append("  KALMAN_PROFILE_STORE(kf->Telemetry.HookCycles[index], start);")
+            out.append("}")
+            out.append(SEPARATOR)
+            out.append("")
+        if 3 not in self.skip:
+            out.append("/**")
+            out.append("  * @brief Update the kalman gain: K(k) = Pminus(k)·HT/(H·Pminus(k)·HT + R)")
+            out.append("  * @param kf: point to a Kalman_Info_TypeDef structure that")
+            out.append("  *         contains the informations of kalman filter.")
+            out.append("  * @retval arm_status, ARM_MATH_SINGULAR if S is not positive definite")
+            out.append("  */")
+            out.append("static arm_status %s_K_Update(Kalman_Info_TypeDef *kf)" % name)
+            out.append("{")
+            out.extend(self.gain())
+            out.append("}")
+            out.append(SEPARATOR)
+            out.append("")
+        out.append("/**")
+        out.append("  * @brief Update the %s kalman filter, drop-in for Kalman_Filter_Update()." % name)
+        out.append("  * @param kf: point to a Kalman_Info_TypeDef structure that")
+        out.append("  *         contains the informations of kalman filter, xhatSize %d, uSize %d, zSize %d." % (x, u, z))
+        out.append("  * @retval point of kalman filter output")
+        out.append("  */")
+        out.append("float *Kalman_%s_Update(Kalman_Info_TypeDef *kf)" % name)
+        out.append("{")
+        self.lines = []
+        self.emit("float *xhat = kf->pdata.xhat, *xhatminus = kf->pdata.xhatminus, *zk = kf->pdata.z;")
+        self.emit("float *P = kf->pdata.P, *Pminus = kf->pdata.Pminus, *K = kf->pdata.K;")
+        model = ["*A = kf->pdata.A"]
+        if not (4 in self.skip and 5 in self.skip):
+            model.append("*H = kf->pdata.H")
+        if 2 not in self.skip:
+            model.append("*Q = kf->pdata.Q")
+        self.emit("const float %s;" % ", ".join(model))
+        if u > 0:
+            self.emit("const float *B = kf->pdata.B, *u = kf->pdata.u;")
+        self.emit("uint32_t valid = kf->MeasureValid & %s;" % zmask)
+        self.emit("bool measured = (valid != 0U);")
+        self.emit("uint32_t start = KALMAN_PROFILE_START(), step = 0;")
+        self.emit()
+        self.emit("/* modes and partial measurements of the core */")
+        self.emit("if(kf->xhatSize != %d || kf->uSize != %d || kf->zSize != %d" % (x, u, z))
+        self.emit("|| kf->SymmetricP == 0 || kf->JosephForm == 1")
+        self.emit("|| kf->SteadyState == 1 || kf->UDFactor == 1 || kf->SequentialUpdate == 1")
+        self.emit("|| (valid != 0U && valid != %s))" % zmask)
+        self.emit("{")
+        self.emit("return Kalman_Filter_Update(kf);", 2)
+        self.emit("}")
+        self.emit()
+        self.emit("kf->Telemetry.UpdateCnt++;")
+        self.emit()
+        self.emit("/* Update the input */")
+        self.emit("memcpy(zk, kf->MeasureInput, sizeof(float) * %d);" % z)
+        self.emit("memset(kf->MeasureInput, 0, sizeof(float) * %d);" % z)
+        if u > 0:
+            self.emit("memcpy(kf->pdata.u, kf->ControlInput, sizeof(float) * %d);" % u)
+        if 0 in self.hooks:
+            self.emit()
+        self.hook(0)
+        self.step1()
+        self.end_step(1)
+        self.hook(1)
+        self.step2()
+        self.end_step(2)
+        self.hook(2)
+        self.step3()
+        self.end_step(3)
+        self.hook(3)
+        self.step4()
+        self.end_step(4)
+        self.hook(4)
+        self.step5()
+        self.end_step(5)
+        self.hook(5)
+        if 6 in self.hooks:
+            self.emit()
+        self.hook(6)
+        self.emit()
+        self.emit("kf->Telemetry.ActiveFlag = 0;")
+        self.emit()
+        self.emit("/* count the updates with a non-finite state */")
+        self.emit("for(uint8_t i = 0; i < %d; i++)" % x)
+        self.emit("{")
+        self.emit("if(!isfinite(xhat[i]))", 2)
+        self.emit("{", 2)
+        self.emit("kf->Telemetry.ErrorFlags |= KALMAN_ERROR_NANINF;", 3)
+        self.emit("kf->Telemetry.LastError = ARM_MATH_NANINF;", 3)
+        self.emit("kf->Telemetry.NaNCnt++;", 3)
+        self.emit("break;", 3)
+        self.emit("}", 2)
+        self.emit("}")
+        self.emit()
+        self.emit("/* store the output */")
+        self.emit("memcpy(kf->Output, xhat, sizeof(float) * %d);" % x)
+        self.emit()
+        self.emit("#if KALMAN_PROFILE_ENABLE", 0)
+        self.emit("KALMAN_PROFILE_STORE(kf->Telemetry.TotalCycles, start);")
+        self.emit("if(kf->Telemetry.TotalCycles > kf->Telemetry.MaxCycles)")
+        self.emit("{")
+        self.emit("kf->Telemetry.MaxCycles = kf->Telemetry.TotalCycles;", 2)
+        self.emit("}")
+        self.emit("#else", 0)
+        self.emit("(void)start;")
+        self.emit("(void)step;")
+        self.emit("#endif", 0)
+        self.emit()
+        self.emit("return kf->Output;")
+        out.extend(self.lines)
+        out.append("}")
+        out.append(SEPARATOR)
+        return "\n".join(out) + "\n"
+
+    def header(self):
+        name = self.name
+        guard = "__KALMAN_%s_H" % name.upper()
+        out = []
+        out.append("#ifndef %s" % guard)
+        out.append("#define %s" % guard)
+        out.append("/* USER CODE BEGIN Header */")
+        out.append("/**")
+        out.append("  ******************************************************************************")
+        out.append("  * @file           : kalman_%s.h" % name.lower())
+        out.append("  * @brief          : Prototypes of the %s kalman filter." % self.brief)
+        out.append("  *")
+        out.append("  ******************************************************************************")
+        out.append("  * @attention      : generated by script/kalman_codegen.py, do not edit")
+        out.append("  *")
+        out.append("  * Copyright 2024 COD USTL.")
+        out.append("  * All rights reserved.")
+        out.append("  *")
+        out.append("  ******************************************************************************")
+        out.append("  */")
+        out.append("/* USER CODE END Header */")
+        out.append("")
+        out.append("/* Includes ------------------------------------------------------------------*/")
+        out.append('#include "kalman.h"')
+        out.append("")
+        out.append("/* Exported functions prototypes ---------------------------------------------*/")
+        out.append("/**")
+        out.append("  * @brief Update the %s kalman filter, drop-in for Kalman_Filter_Update()." % name)
+        out.append("  */")
+        out.append("extern float *Kalman_%s_Update(Kalman_Info_TypeDef *kf);" % name)
+        out.append("")
+        out.append("#endif")
+        return "\n".join(out) + "\n"
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__)
+        return 1
+
+    with open(argv[1], "r", encoding="utf-8") as f:
+        desc = json.load(f)
+
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Algorithm")
+    out_dir = argv[2] if len(argv) > 2 else root
+
+    gen = Generator(desc)
+    name = gen.name.lower()
+    source = gen.source(os.path.basename(argv[1]))
+    header = gen.header()
+
+    os.makedirs(os.path.join(out_dir, "Src"), exist_ok=True)
+    os.makedirs(os.path.join(out_dir, "Inc"), exist_ok=True)
+    with open(os.path.join(out_dir, "Src", "kalman_%s.c" % name), "w", encoding="utf-8", newline="\r\n") as f:
+        f.write(source)
+    with open(os.path.join(out_dir, "Inc", "kalman_%s.h" % name), "w", encoding="utf-8", newline="\r\n") as f:
+        f.write(header)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))